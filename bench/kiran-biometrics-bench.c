@@ -0,0 +1,406 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+/*
+ * 模板库和1:N比对的性能测试
+ *
+ * 对每个模板库规模, 使用合成的模板测量:
+ *   load        重新打开模板库并映射全部模板
+ *   save        kiran_fprint_store_save 保存一个新模板
+ *   match_hit   在模板库中查找一个存在的指纹
+ *   match_miss  在模板库中查找一个不存在的指纹
+ *   peak_rss    进程的最大常驻内存
+ * 结果每行一个JSON对象, 输出到标准输出
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "kiran-biometrics-types.h"
+#include "kiran-fprint-matcher.h"
+#include "kiran-fprint-store.h"
+
+#define BENCH_FEATURELEN 256                    //特征长度, 和虚拟指纹模块一致
+#define BENCH_TEMPLATELEN (3 * BENCH_FEATURELEN) //合并后的模板长度
+#define BENCH_THRESHOLD (BENCH_FEATURELEN * 8 / 10)
+#define BENCH_NOISE_BITS 16                     //查找存在的指纹时, 探针和模板不同的位数
+
+static gchar *sizes_option = "100,1000,10000,100000";
+static gint iterations = 50;
+static gint save_samples = 20;
+static gint threads = 0;
+static gchar *dir_option = NULL;
+
+static GOptionEntry entries[] = {
+    {"sizes", 0, 0, G_OPTION_ARG_STRING, &sizes_option, "Comma separated gallery sizes", "N,N,..."},
+    {"iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Samples per load and match measurement", "N"},
+    {"save-samples", 0, 0, G_OPTION_ARG_INT, &save_samples, "Samples per save measurement", "N"},
+    {"threads", 0, 0, G_OPTION_ARG_INT, &threads, "Matcher threads, 0 for the number of CPUs", "N"},
+    {"dir", 0, 0, G_OPTION_ARG_FILENAME, &dir_option, "Directory for the template stores", "DIR"},
+    {NULL}};
+
+static gint64
+bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+    gint64 va = *(const gint64 *)a;
+    gint64 vb = *(const gint64 *)b;
+
+    return va < vb ? -1 : (va > vb ? 1 : 0);
+}
+
+//输出一项延迟测量, samples 会被排序
+static void
+bench_report(int size, const char *metric, gint64 *samples, int count)
+{
+    if (count <= 0)
+        return;
+
+    qsort(samples, count, sizeof(gint64), bench_compare);
+
+    printf("{\"size\":%d,\"metric\":\"%s\",\"unit\":\"ns\",\"samples\":%d,"
+           "\"p50\":%" G_GINT64_FORMAT ",\"p99\":%" G_GINT64_FORMAT ",\"max\":%" G_GINT64_FORMAT "}\n",
+           size, metric, count,
+           samples[(count - 1) * 50 / 100],
+           samples[(count - 1) * 99 / 100],
+           samples[count - 1]);
+    fflush(stdout);
+}
+
+static void
+bench_report_rss(int size)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"size\":%d,\"metric\":\"peak_rss\",\"unit\":\"kB\",\"value\":%ld}\n",
+           size, usage.ru_maxrss);
+    fflush(stdout);
+}
+
+static void
+bench_random_template(GRand *rand, unsigned char *template)
+{
+    int i;
+
+    for (i = 0; i < BENCH_TEMPLATELEN; i++)
+        template[i] = g_rand_int_range(rand, 0, 256);
+}
+
+//和虚拟指纹模块相同的软件比对: 任意两个特征不同的位数不超过阈值即匹配
+static int
+bench_match_func(gpointer user_data,
+                 unsigned char *fpTemplate1,
+                 unsigned int cbfpTemplate1,
+                 unsigned char *fpTemplate2,
+                 unsigned int cbfpTemplate2)
+{
+    unsigned int distance;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+
+    for (i = 0; i + BENCH_FEATURELEN <= cbfpTemplate1; i += BENCH_FEATURELEN)
+    {
+        for (j = 0; j + BENCH_FEATURELEN <= cbfpTemplate2; j += BENCH_FEATURELEN)
+        {
+            distance = 0;
+            for (k = 0; k < BENCH_FEATURELEN && distance <= BENCH_THRESHOLD; k++)
+                distance += __builtin_popcount(fpTemplate1[i + k] ^ fpTemplate2[j + k]);
+
+            if (distance <= BENCH_THRESHOLD)
+                return FPRINT_RESULT_OK;
+        }
+    }
+
+    return FPRINT_RESULT_FAIL;
+}
+
+static void
+bench_remove_dir(const gchar *path)
+{
+    GDir *dir;
+    const gchar *name;
+
+    dir = g_dir_open(path, 0, NULL);
+    if (dir == NULL)
+        return;
+
+    while ((name = g_dir_read_name(dir)))
+    {
+        gchar *file = g_build_filename(path, name, NULL);
+        g_remove(file);
+        g_free(file);
+    }
+    g_dir_close(dir);
+    g_rmdir(path);
+}
+
+/*
+ * 用旧版本每个模板一个文件的格式生成模板库, 由 kiran_fprint_store_new 一次导入
+ * 逐个调用 kiran_fprint_store_save 每次都会重新加载模板库, 生成大模板库太慢
+ */
+static gboolean
+bench_populate(GRand *rand, const gchar *path, int size)
+{
+    unsigned char template[BENCH_TEMPLATELEN];
+    int i;
+
+    if (g_mkdir_with_parents(path, S_IRWXU) != 0)
+        return FALSE;
+
+    for (i = 0; i < size; i++)
+    {
+        gchar *id;
+        gchar *name;
+        gchar *file;
+        gboolean ok;
+
+        bench_random_template(rand, template);
+        id = g_compute_checksum_for_data(G_CHECKSUM_MD5, template, sizeof(template));
+        name = g_strconcat(id, ".bat", NULL);
+        file = g_build_filename(path, name, NULL);
+        ok = g_file_set_contents(file, (const gchar *)template, sizeof(template), NULL);
+
+        g_free(file);
+        g_free(name);
+        g_free(id);
+
+        if (!ok)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+bench_load(const gchar *path, int size)
+{
+    gint64 *samples = g_new0(gint64, iterations);
+    int i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        KiranFprintStore *store;
+        KiranFprintGallery *gallery;
+        gint64 start;
+
+        start = bench_now();
+        store = kiran_fprint_store_new(path);
+        gallery = kiran_fprint_store_get_gallery(store);
+        samples[i] = bench_now() - start;
+
+        if (gallery->number < size)
+            g_warning("gallery has %d templates, expect %d", gallery->number, size);
+
+        kiran_fprint_gallery_unref(gallery);
+        g_object_unref(store);
+    }
+
+    bench_report(size, "load", samples, iterations);
+    g_free(samples);
+}
+
+static void
+bench_save(GRand *rand, KiranFprintStore *store, int size)
+{
+    unsigned char template[BENCH_TEMPLATELEN];
+    gint64 *samples = g_new0(gint64, save_samples);
+    int count = 0;
+    int i;
+
+    for (i = 0; i < save_samples; i++)
+    {
+        gchar *id = NULL;
+        gint64 start;
+        int ret;
+
+        bench_random_template(rand, template);
+
+        start = bench_now();
+        ret = kiran_fprint_store_save(store, template, sizeof(template), 0, "bench", &id);
+        if (ret == 0)
+            samples[count++] = bench_now() - start;
+
+        g_free(id);
+    }
+
+    bench_report(size, "save", samples, count);
+    g_free(samples);
+}
+
+static void
+bench_match(GRand *rand, KiranFprintMatcher *matcher, KiranFprintStore *store, int size)
+{
+    unsigned char probe[BENCH_FEATURELEN];
+    KiranFprintGallery *gallery;
+    gint64 *hits = g_new0(gint64, iterations);
+    gint64 *misses = g_new0(gint64, iterations);
+    int nhits = 0;
+    int nmisses = 0;
+    int i;
+    int j;
+
+    gallery = kiran_fprint_store_get_gallery(store);
+
+    for (i = 0; i < iterations && gallery->number > 0; i++)
+    {
+        int target;
+        int index = -1;
+        gint64 start;
+
+        //与随机选择的模板中的一个特征相近的探针
+        target = g_rand_int_range(rand, 0, gallery->number);
+        memcpy(probe,
+               gallery->templates[target] + g_rand_int_range(rand, 0, 3) * BENCH_FEATURELEN,
+               BENCH_FEATURELEN);
+        for (j = 0; j < BENCH_NOISE_BITS; j++)
+            probe[g_rand_int_range(rand, 0, BENCH_FEATURELEN)] ^= 1 << g_rand_int_range(rand, 0, 8);
+
+        start = bench_now();
+        if (kiran_fprint_matcher_search(matcher, bench_match_func, NULL,
+                                        probe, sizeof(probe),
+                                        gallery->templates, gallery->lens, gallery->number,
+                                        &index) == FPRINT_RESULT_OK)
+            hits[nhits++] = bench_now() - start;
+        else
+            g_warning("probe for template %d not found", target);
+
+        //随机探针与所有模板都不匹配
+        bench_random_template(rand, probe);
+        start = bench_now();
+        if (kiran_fprint_matcher_search(matcher, bench_match_func, NULL,
+                                        probe, sizeof(probe),
+                                        gallery->templates, gallery->lens, gallery->number,
+                                        &index) != FPRINT_RESULT_OK)
+            misses[nmisses++] = bench_now() - start;
+    }
+
+    bench_report(size, "match_hit", hits, nhits);
+    bench_report(size, "match_miss", misses, nmisses);
+
+    kiran_fprint_gallery_unref(gallery);
+    g_free(hits);
+    g_free(misses);
+}
+
+int main(int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    KiranFprintMatcher *matcher;
+    GRand *rand;
+    gchar **sizes;
+    gchar *base;
+    int i;
+
+    g_type_init();
+
+    context = g_option_context_new("- benchmark fingerprint template store and matching");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if (iterations <= 0)
+        iterations = 1;
+    if (save_samples < 0)
+        save_samples = 0;
+
+    if (dir_option)
+    {
+        base = g_strdup(dir_option);
+        g_mkdir_with_parents(base, S_IRWXU);
+    }
+    else
+    {
+        base = g_dir_make_tmp("kiran-biometrics-bench-XXXXXX", &error);
+        if (base == NULL)
+        {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+            return 1;
+        }
+    }
+
+    //固定种子, 每次运行使用相同的模板
+    rand = g_rand_new_with_seed(20210101);
+    matcher = kiran_fprint_matcher_new(threads);
+
+    printf("{\"metric\":\"config\",\"threads\":%d,\"iterations\":%d,\"save_samples\":%d,\"template_size\":%d}\n",
+           kiran_fprint_matcher_get_threads(matcher), iterations, save_samples, BENCH_TEMPLATELEN);
+
+    sizes = g_strsplit(sizes_option, ",", -1);
+    for (i = 0; sizes[i]; i++)
+    {
+        KiranFprintStore *store;
+        gchar *path;
+        int size;
+
+        size = atoi(sizes[i]);
+        if (size <= 0)
+            continue;
+
+        path = g_strdup_printf("%s/%d", base, size);
+        bench_remove_dir(path);
+        if (!bench_populate(rand, path, size))
+        {
+            g_printerr("populate %s failed\n", path);
+            bench_remove_dir(path);
+            g_free(path);
+            continue;
+        }
+
+        //第一次打开时导入模板, 之后的加载都是直接映射
+        store = kiran_fprint_store_new(path);
+        bench_load(path, size);
+        bench_match(rand, matcher, store, size);
+        bench_save(rand, store, size);
+        bench_report_rss(size);
+
+        g_object_unref(store);
+        bench_remove_dir(path);
+        g_free(path);
+    }
+
+    if (dir_option == NULL)
+        g_rmdir(base);
+
+    g_strfreev(sizes);
+    g_object_unref(matcher);
+    g_rand_free(rand);
+    g_free(base);
+
+    return 0;
+}
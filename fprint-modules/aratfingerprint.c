@@ -19,21 +19,44 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include "aratek/aratek.h"
+#include "kiran-fprint-acquire.h"
 #include "kiran-fprint-module.h"
+#include "kiran-fprint-pool.h"
 
 #ifndef FEATURELEN
 #define FEATURELEN 1024
 #endif
 
-static int do_acquire = 0;
+#define ARAT_PROBE_INTERVAL 1000  //采集失败时检查设备是否还在的最小间隔, 毫秒
+#define ARAT_QUALITY_THRESHOLD 100 //默认图像质量阈值
 
-unsigned int
-GetTickCount()  //获取当前时间
+/*
+ * 每个打开的设备的上下文, kiran_fprint_open_device 返回它的指针
+ * 不同设备可以在不同线程中同时采集和比对
+ */
+typedef struct
+{
+    HANDLE hDevice;              //SDK设备句柄
+    KiranFprintAcquire acquire;  //采集等待和取消
+
+    int width;  //图像宽高, 打开设备时查询一次
+    int height;
+    int quality_threshold;         //图像质量阈值, 低于阈值的图像不提取特征
+    unsigned char *rawdata;        //原始图像缓冲区, width * height
+    KiranFprintTemplatePool pool;  //模板缓冲池, 每个缓冲区可以放下合并后的模板
+} AratDevice;
+
+static const KiranFprintCapabilities capabilities = {
+    .version = KIRAN_FPRINT_CAPABILITIES_VERSION,
+    .flags = KIRAN_FPRINT_CAP_MERGE | KIRAN_FPRINT_CAP_BATCH_MATCH,
+    .template_format = KIRAN_FPRINT_FORMAT_ARATEK,
+    .max_template_size = 3 * FEATURELEN,
+};
+
+const KiranFprintCapabilities *
+kiran_fprint_get_capabilities()
 {
-    struct timeval tv;
-    struct timezone tz;
-    gettimeofday(&tv, &tz);
-    return (tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    return &capabilities;
 }
 
 int kiran_fprint_init()
@@ -55,13 +78,58 @@ int kiran_fprint_get_dev_count()
     return count;
 }
 
+static void
+free_device(AratDevice *device)
+{
+    kiran_fprint_template_pool_destroy(&device->pool);
+    free(device->rawdata);
+    kiran_fprint_acquire_destroy(&device->acquire);
+    free(device);
+}
+
 HANDLE kiran_fprint_open_device(int index)
 {
-    HANDLE handle = NULL;
+    AratDevice *device;
+    int dpi = 0;
+
+    device = (AratDevice *)calloc(1, sizeof(AratDevice));
+    if (device == NULL)
+        return NULL;
+
+    if (kiran_fprint_acquire_init(&device->acquire) != 0)
+    {
+        free(device);
+        return NULL;
+    }
+
+    kiran_fprint_template_pool_init(&device->pool, 3 * FEATURELEN);
+    device->quality_threshold = ARAT_QUALITY_THRESHOLD;
+
+    ARAFPSCAN_OpenDevice(&device->hDevice, index);
+    if (device->hDevice == NULL)
+    {
+        free_device(device);
+        return NULL;
+    }
 
-    ARAFPSCAN_OpenDevice(&handle, index);
+    //图像尺寸在设备打开期间不会变化, 缓冲区只分配一次
+    if (ARAFPSCAN_GetImageInfo(device->hDevice, &device->width, &device->height, &dpi) != FPRINT_RESULT_OK ||
+        device->width <= 0 || device->height <= 0)
+    {
+        ARAFPSCAN_CloseDevice(&device->hDevice);
+        free_device(device);
+        return NULL;
+    }
 
-    return handle;
+    device->rawdata = malloc((size_t)device->width * device->height);
+    if (device->rawdata == NULL)
+    {
+        ARAFPSCAN_CloseDevice(&device->hDevice);
+        free_device(device);
+        return NULL;
+    }
+
+    return device;
 }
 
 int kiran_fprint_acquire_finger_print(HANDLE hDevice,
@@ -69,78 +137,117 @@ int kiran_fprint_acquire_finger_print(HANDLE hDevice,
                                       unsigned int *cbTemplate,
                                       unsigned int timeout)
 {
-    unsigned int preTime = GetTickCount();
-    unsigned char featureBuff[FEATURELEN];
+    AratDevice *device = (AratDevice *)hDevice;
+    unsigned char *feature = NULL;
+    unsigned int lastProbe;
+    unsigned int now;
     int width = 0;
     int height = 0;
     int dpi = 0;
-    unsigned char *rawdate = NULL;
     int ret = FPRINT_RESULT_FAIL;
-    unsigned int curTime;
     int quality;
 
-    do_acquire = 0;
+    *cbTemplate = 0;
+    *fpTemplate = NULL;
 
-    ret = ARAFPSCAN_GetImageInfo(hDevice, &width, &height, &dpi);
-    if (ret != FPRINT_RESULT_OK)
+    //特征直接提取到模板缓冲区中, 不再复制
+    feature = kiran_fprint_template_pool_alloc(&device->pool);
+    if (feature == NULL)
         return FPRINT_RESULT_FAIL;
 
-    rawdate = malloc(width * height);
-    if (rawdate == NULL)
-        return FPRINT_RESULT_FAIL;
+    kiran_fprint_acquire_begin(&device->acquire, timeout);
+    lastProbe = device->acquire.start;
 
-    while (0 == do_acquire)
+    do
     {
-        curTime = GetTickCount();
-        if (curTime - preTime >= timeout)
-        {
-            ret = FPRINT_RESULT_FAIL;
-            break;
-        }
-
-        usleep(100000);
-
-        ret = ARAFPSCAN_CaptureRawData(hDevice, 5, rawdate);
+        ret = ARAFPSCAN_CaptureRawData(device->hDevice, 5, device->rawdata);
         if (ret != FPRINT_RESULT_OK)
+        {
+            //没有手指和设备被拔出都会采集失败, 隔一段时间检查一次设备是否还在
+            //设备被拔出后句柄失效, 由调用者重新打开设备
+            now = kiran_fprint_acquire_now();
+            if (now - lastProbe >= ARAT_PROBE_INTERVAL)
+            {
+                lastProbe = now;
+                if (ARAFPSCAN_GetImageInfo(device->hDevice, &width, &height, &dpi) != FPRINT_RESULT_OK)
+                {
+                    kiran_fprint_acquire_end(&device->acquire);
+                    kiran_fprint_template_pool_free(&device->pool, feature);
+                    return FPRINT_RESULT_NO_DEVICE;
+                }
+            }
             continue;
+        }
 
         quality = 0;
-        ARAFPSCAN_ImgQuality(width, height, rawdate, &quality);
-        if (quality < 100)
+        ARAFPSCAN_ImgQuality(device->width, device->height, device->rawdata, &quality);
+        if (quality < device->quality_threshold)
+        {
+            ret = FPRINT_RESULT_FAIL;
             continue;
+        }
 
-        ret = ARAFPSCAN_ExtractFeature(hDevice, 0, featureBuff);
-        if (ret != FPRINT_RESULT_OK)
-            continue;
-        else
+        ret = ARAFPSCAN_ExtractFeature(device->hDevice, 0, feature);
+        if (ret == FPRINT_RESULT_OK)
             break;
-    }
+    } while (kiran_fprint_acquire_wait(&device->acquire) <= KIRAN_FPRINT_ACQUIRE_NOTIFIED);
+    kiran_fprint_acquire_end(&device->acquire);
 
-    if (ret == FPRINT_RESULT_OK)
-    {
-        *cbTemplate = FEATURELEN;
-        *fpTemplate = (unsigned char *)malloc(*cbTemplate);
-        memcpy(*fpTemplate, featureBuff, *cbTemplate);
-    }
-    else
+    //超时或被取消
+    if (ret != FPRINT_RESULT_OK)
     {
-        *cbTemplate = 0;
-        *fpTemplate = NULL;
+        kiran_fprint_template_pool_free(&device->pool, feature);
+        return FPRINT_RESULT_FAIL;
     }
 
-    free(rawdate);
+    *cbTemplate = FEATURELEN;
+    *fpTemplate = feature;
 
-    return ret;
+    return FPRINT_RESULT_OK;
 }
 
 void kiran_fprint_acquire_finger_print_stop(HANDLE hDevice)
 {
-    do_acquire = -1;
+    AratDevice *device = (AratDevice *)hDevice;
+
+    kiran_fprint_acquire_cancel(&device->acquire);
 }
 
 int kiran_fprint_close_device(HANDLE hDevice)
 {
-    return ARAFPSCAN_CloseDevice(&hDevice);
+    AratDevice *device = (AratDevice *)hDevice;
+    int ret;
+
+    ret = ARAFPSCAN_CloseDevice(&device->hDevice);
+    free_device(device);
+
+    return ret;
+}
+
+void kiran_fprint_template_free(HANDLE hDevice,
+                                unsigned char *fpTemplate)
+{
+    AratDevice *device = (AratDevice *)hDevice;
+
+    kiran_fprint_template_pool_free(&device->pool, fpTemplate);
+}
+
+int kiran_fprint_set_parameter(HANDLE hDevice,
+                               const char *name,
+                               int value)
+{
+    AratDevice *device = (AratDevice *)hDevice;
+
+    if (strcmp(name, KIRAN_FPRINT_PARAM_QUALITY_THRESHOLD) == 0)
+    {
+        if (value < 0)
+            return FPRINT_RESULT_FAIL;
+
+        device->quality_threshold = value;
+        return FPRINT_RESULT_OK;
+    }
+
+    return FPRINT_RESULT_UNSUPPORT;
 }
 
 int kiran_fprint_template_merge(HANDLE hDevice,
@@ -150,10 +257,15 @@ int kiran_fprint_template_merge(HANDLE hDevice,
                                 unsigned char **regTemplate,
                                 unsigned int *cbRegTemplate)
 {
+    AratDevice *device = (AratDevice *)hDevice;
+
     *cbRegTemplate = 3 * FEATURELEN;
-    *regTemplate = (unsigned char *)malloc(*cbRegTemplate);
+    *regTemplate = kiran_fprint_template_pool_alloc(&device->pool);
     if (*regTemplate == NULL)
+    {
+        *cbRegTemplate = 0;
         return FPRINT_RESULT_FAIL;
+    }
 
     memcpy(*regTemplate, fpTemplate1, FEATURELEN);
     memcpy(*regTemplate + FEATURELEN, fpTemplate2, FEATURELEN);
@@ -162,33 +274,141 @@ int kiran_fprint_template_merge(HANDLE hDevice,
     return FPRINT_RESULT_OK;
 }
 
+//与连续存放的num个特征比对, 任意一个匹配即认为匹配
+static int
+verify_features(AratDevice *device,
+                unsigned char *feature,
+                unsigned char *features,
+                int num,
+                int *similarity)
+{
+    int pnSimilarity = 0;
+    int pMatch;
+
+    ARAFPSCAN_VerifyExt(device->hDevice,
+                        4,
+                        feature,
+                        num,
+                        features,
+                        &pnSimilarity,
+                        &pMatch);
+    if (similarity)
+        *similarity = pnSimilarity;
+
+    return pMatch;
+}
+
 int kiran_fprint_template_match(HANDLE hDevice,
                                 unsigned char *fpTemplate1,
                                 unsigned int cbfpTemplate1,
                                 unsigned char *fpTemplate2,
                                 unsigned int cbfpTemplate2)
 {
-    int ret;
-    int pnSimilarity;
-    int pMatch;
-    int num = 0;
-
-    num = cbfpTemplate2 / FEATURELEN;
-    ret = ARAFPSCAN_VerifyExt(hDevice,
-                              4,
-                              fpTemplate1,
-                              num,
-                              fpTemplate2,
-                              &pnSimilarity,
-                              &pMatch);
-    return pMatch;
+    return verify_features(hDevice,
+                           fpTemplate1,
+                           fpTemplate2,
+                           cbfpTemplate2 / FEATURELEN,
+                           NULL);
 }
 
-int kiran_fprint_verify_finger_print(HANDLE hDevice,
-                                     unsigned char **fpTemplate,
-                                     unsigned int *cbTemplate,
-                                     unsigned int *number,
-                                     unsigned int timeout)
+/*
+ * 在模板 [start, end) 中查找匹配的模板
+ * first[i] 为第i个模板的第一个特征在 features 中的序号
+ * VerifyExt 只返回是否匹配, 匹配时二分缩小范围找到具体的模板
+ */
+static int
+match_range(HANDLE hDevice,
+            unsigned char *feature,
+            unsigned char *features,
+            unsigned int *first,
+            unsigned int start,
+            unsigned int end,
+            int *index,
+            int *score)
 {
-    return FPRINT_RESULT_UNSUPPORT;
+    unsigned int mid;
+
+    if (verify_features(hDevice,
+                        feature,
+                        features + (size_t)first[start] * FEATURELEN,
+                        first[end] - first[start],
+                        score) != FPRINT_RESULT_OK)
+        return FPRINT_RESULT_FAIL;
+
+    if (end - start == 1)
+    {
+        *index = start;
+        return FPRINT_RESULT_OK;
+    }
+
+    mid = start + (end - start) / 2;
+    if (match_range(hDevice, feature, features, first, start, mid, index, score) == FPRINT_RESULT_OK)
+        return FPRINT_RESULT_OK;
+
+    return match_range(hDevice, feature, features, first, mid, end, index, score);
 }
+
+int kiran_fprint_template_match_batch(HANDLE hDevice,
+                                      unsigned char *fpTemplate,
+                                      unsigned int cbfpTemplate,
+                                      unsigned char **fpTemplates,
+                                      unsigned int *cbTemplates,
+                                      unsigned int number,
+                                      int *index,
+                                      int *score)
+{
+    unsigned char *features = NULL;
+    unsigned int *first = NULL;
+    int contiguous = 1;
+    unsigned int i;
+    int ret;
+
+    if (number == 0)
+        return FPRINT_RESULT_FAIL;
+
+    first = (unsigned int *)malloc((number + 1) * sizeof(unsigned int));
+    if (first == NULL)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    first[0] = 0;
+    for (i = 0; i < number; i++)
+    {
+        //模板必须由完整的特征组成, 否则退回到逐个比对
+        if (cbTemplates[i] == 0 || cbTemplates[i] % FEATURELEN != 0)
+        {
+            free(first);
+            return FPRINT_RESULT_UNSUPPORT;
+        }
+
+        first[i + 1] = first[i] + cbTemplates[i] / FEATURELEN;
+        if (i > 0 && fpTemplates[i] != fpTemplates[i - 1] + cbTemplates[i - 1])
+            contiguous = 0;
+    }
+
+    //模板库中的模板通常是连续存放的, 此时不需要复制
+    if (contiguous)
+    {
+        features = fpTemplates[0];
+    }
+    else
+    {
+        features = (unsigned char *)malloc((size_t)first[number] * FEATURELEN);
+        if (features == NULL)
+        {
+            free(first);
+            return FPRINT_RESULT_UNSUPPORT;
+        }
+
+        for (i = 0; i < number; i++)
+            memcpy(features + (size_t)first[i] * FEATURELEN, fpTemplates[i], cbTemplates[i]);
+    }
+
+    ret = match_range(hDevice, fpTemplate, features, first, 0, number, index, score);
+
+    if (!contiguous)
+        free(features);
+    free(first);
+
+    return ret;
+}
+
@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_FPRINT_ACQUIRE_H__
+#define __KIRAN_FPRINT_ACQUIRE_H__
+
+/*
+ * 指纹模块采集辅助函数, 指纹厂家可以选择使用
+ *
+ * 采集循环在一个管道上等待, 而不是固定 usleep:
+ * kiran_fprint_acquire_finger_print_stop 调用 kiran_fprint_acquire_cancel 立即唤醒采集循环,
+ * 回调方式采集的SDK在回调中调用 kiran_fprint_acquire_notify 唤醒采集循环,
+ * 阻塞方式采集的SDK可以用 kiran_fprint_acquire_get_fd 获取描述符, 与SDK自身的描述符一起等待
+ *
+ * 轮询方式采集的SDK, 开始采集后的一段时间内快速轮询, 之后逐渐增大轮询间隔
+ *
+ * 开始采集时不丢弃管道中的事件, 开始之前收到的取消同样有效, 采集结束时才丢弃剩余的事件
+ *
+ * 用法:
+ *   kiran_fprint_acquire_begin(&acquire, timeout);
+ *   do
+ *   {
+ *       if (采集成功)
+ *           break;
+ *   } while (kiran_fprint_acquire_wait(&acquire) <= KIRAN_FPRINT_ACQUIRE_NOTIFIED);
+ *   kiran_fprint_acquire_end(&acquire);
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KIRAN_FPRINT_ACQUIRE_MIN_INTERVAL 5     //最小轮询间隔, 毫秒
+#define KIRAN_FPRINT_ACQUIRE_MAX_INTERVAL 100   //最大轮询间隔, 毫秒
+#define KIRAN_FPRINT_ACQUIRE_FAST_PERIOD 2000   //开始采集后保持最小轮询间隔的时间, 毫秒
+
+enum
+{
+    KIRAN_FPRINT_ACQUIRE_AGAIN = 0,     //继续采集
+    KIRAN_FPRINT_ACQUIRE_NOTIFIED = 1,  //SDK通知有数据, 继续采集
+    KIRAN_FPRINT_ACQUIRE_CANCELLED = 2, //采集被取消
+    KIRAN_FPRINT_ACQUIRE_TIMEOUT = 3,   //采集超时
+};
+
+typedef struct
+{
+    int fds[2];            //fds[0] 等待, fds[1] 唤醒
+    unsigned int start;    //开始采集的时间
+    unsigned int timeout;  //采集超时时间
+    unsigned int interval; //当前轮询间隔
+} KiranFprintAcquire;
+
+static inline unsigned int
+kiran_fprint_acquire_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline int
+kiran_fprint_acquire_init(KiranFprintAcquire *acquire)
+{
+    int i;
+
+    acquire->start = 0;
+    acquire->timeout = 0;
+    acquire->interval = KIRAN_FPRINT_ACQUIRE_MIN_INTERVAL;
+
+    if (pipe(acquire->fds) != 0)
+    {
+        acquire->fds[0] = -1;
+        acquire->fds[1] = -1;
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        fcntl(acquire->fds[i], F_SETFL, fcntl(acquire->fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(acquire->fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    return 0;
+}
+
+static inline void
+kiran_fprint_acquire_destroy(KiranFprintAcquire *acquire)
+{
+    if (acquire->fds[0] >= 0)
+        close(acquire->fds[0]);
+    if (acquire->fds[1] >= 0)
+        close(acquire->fds[1]);
+
+    acquire->fds[0] = -1;
+    acquire->fds[1] = -1;
+}
+
+static inline int
+kiran_fprint_acquire_get_fd(KiranFprintAcquire *acquire)
+{
+    return acquire->fds[0];
+}
+
+//读出管道中所有的事件, 返回是否收到了取消事件
+static inline int
+kiran_fprint_acquire_drain(KiranFprintAcquire *acquire)
+{
+    char buf[16];
+    int cancelled = 0;
+    ssize_t n;
+    ssize_t i;
+
+    while ((n = read(acquire->fds[0], buf, sizeof(buf))) > 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (buf[i] == 'c')
+                cancelled = 1;
+        }
+    }
+
+    return cancelled;
+}
+
+//开始一次采集, 在开始之前收到的取消会在第一次等待时返回
+static inline void
+kiran_fprint_acquire_begin(KiranFprintAcquire *acquire,
+                           unsigned int timeout)
+{
+    acquire->start = kiran_fprint_acquire_now();
+    acquire->timeout = timeout;
+    acquire->interval = KIRAN_FPRINT_ACQUIRE_MIN_INTERVAL;
+}
+
+//结束一次采集, 丢弃本次采集中没有处理的事件, 采集成功, 失败和取消时都要调用
+static inline void
+kiran_fprint_acquire_end(KiranFprintAcquire *acquire)
+{
+    kiran_fprint_acquire_drain(acquire);
+}
+
+static inline void
+kiran_fprint_acquire_wakeup(KiranFprintAcquire *acquire, char event)
+{
+    ssize_t n;
+
+    do
+    {
+        n = write(acquire->fds[1], &event, 1);
+    } while (n < 0 && errno == EINTR);
+}
+
+//取消采集, 可以在任意线程中调用
+static inline void
+kiran_fprint_acquire_cancel(KiranFprintAcquire *acquire)
+{
+    kiran_fprint_acquire_wakeup(acquire, 'c');
+}
+
+//SDK有数据时调用, 可以在SDK的回调线程中调用
+static inline void
+kiran_fprint_acquire_notify(KiranFprintAcquire *acquire)
+{
+    kiran_fprint_acquire_wakeup(acquire, 'n');
+}
+
+/*
+ * 等待下一次采集, 直到轮询间隔到达, 收到通知, 取消或超时
+ * 返回 KIRAN_FPRINT_ACQUIRE_AGAIN 或 KIRAN_FPRINT_ACQUIRE_NOTIFIED 时继续采集
+ */
+static inline int
+kiran_fprint_acquire_wait(KiranFprintAcquire *acquire)
+{
+    struct pollfd pfd;
+    unsigned int elapsed;
+    unsigned int wait;
+    int ret;
+
+    elapsed = kiran_fprint_acquire_now() - acquire->start;
+    if (elapsed >= acquire->timeout)
+        return KIRAN_FPRINT_ACQUIRE_TIMEOUT;
+
+    wait = acquire->interval;
+    if (wait > acquire->timeout - elapsed)
+        wait = acquire->timeout - elapsed;
+
+    pfd.fd = acquire->fds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    do
+    {
+        ret = poll(&pfd, 1, wait);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0)
+        return kiran_fprint_acquire_drain(acquire) ? KIRAN_FPRINT_ACQUIRE_CANCELLED
+                                                   : KIRAN_FPRINT_ACQUIRE_NOTIFIED;
+
+    //一段时间内没有手指, 逐渐降低轮询频率
+    if (elapsed >= KIRAN_FPRINT_ACQUIRE_FAST_PERIOD &&
+        acquire->interval < KIRAN_FPRINT_ACQUIRE_MAX_INTERVAL)
+    {
+        acquire->interval *= 2;
+        if (acquire->interval > KIRAN_FPRINT_ACQUIRE_MAX_INTERVAL)
+            acquire->interval = KIRAN_FPRINT_ACQUIRE_MAX_INTERVAL;
+    }
+
+    return KIRAN_FPRINT_ACQUIRE_AGAIN;
+}
+
+#endif /* __KIRAN_FPRINT_ACQUIRE_H__ */
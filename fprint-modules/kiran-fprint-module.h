@@ -34,8 +34,46 @@ enum
     FPRINT_RESULT_ENROLL_COMPLETE = 10,
 };
 
+#define KIRAN_FPRINT_CAPABILITIES_VERSION 1
+
+//指纹模块能力
+enum
+{
+    KIRAN_FPRINT_CAP_IDENTIFY = 1 << 0,        //实现了 kiran_fprint_verify_finger_print
+    KIRAN_FPRINT_CAP_MERGE = 1 << 1,           //实现了 kiran_fprint_template_merge
+    KIRAN_FPRINT_CAP_BATCH_MATCH = 1 << 2,     //实现了 kiran_fprint_template_match_batch
+    KIRAN_FPRINT_CAP_REENTRANT_MATCH = 1 << 3, //kiran_fprint_template_match 可以在多个线程中同时调用
+};
+
+//kiran_fprint_set_parameter 的参数名
+#define KIRAN_FPRINT_PARAM_QUALITY_THRESHOLD "quality-threshold" //指纹图像质量阈值, 低于阈值的图像不提取特征
+#define KIRAN_FPRINT_PARAM_GALLERY_SERIAL "gallery-serial"       //下一次1:N比对传入的模板库序号, 序号相同时模板库没有变化, 0表示未知
+
+//指纹模板格式
+enum
+{
+    KIRAN_FPRINT_FORMAT_UNKNOWN = 0,
+    KIRAN_FPRINT_FORMAT_ARATEK = 1,
+    KIRAN_FPRINT_FORMAT_ZK = 2,
+};
+
+typedef struct
+{
+    unsigned int version;           //KIRAN_FPRINT_CAPABILITIES_VERSION, 以后的版本只在末尾增加字段
+    unsigned int flags;             //KIRAN_FPRINT_CAP_* 的组合
+    unsigned int template_format;   //KIRAN_FPRINT_FORMAT_*
+    unsigned int max_template_size; //模板最大长度, 0表示不限制
+} KiranFprintCapabilities;
+
 /*
  * 指纹模块头文件，每个指纹厂家都需要实现这些函数才能使用
+ * kiran_fprint_verify_finger_print, kiran_fprint_template_merge,
+ * kiran_fprint_template_match 可以不实现, 由 kiran_fprint_get_capabilities 说明
+ *
+ * 守护进程会同时打开模块中的多个设备, 并在不同线程中同时操作不同的设备,
+ * 因此设备相关的可变状态(采集取消标志, 算法缓冲区等)不能放在全局变量中,
+ * 应保存在 kiran_fprint_open_device 返回的句柄指向的上下文中。
+ * 同一个设备上的操作不会同时调用, kiran_fprint_acquire_finger_print_stop 除外
  */
 
 /*
@@ -87,8 +125,8 @@ int kiran_fprint_get_dev_count();
  * 	设备索引
  *
  * [返回值]
- * 设备操作句柄
- * 
+ * 设备操作句柄, 失败时返回 NULL
+ * 句柄由模块自行定义, 通常指向模块分配的设备上下文, 在 kiran_fprint_close_device 中释放
  */
 HANDLE kiran_fprint_open_device(int index);
 
@@ -100,7 +138,7 @@ HANDLE kiran_fprint_open_device(int index);
  * hDevice
  *       设备操作实例句柄
  * fpTemplate [out]
- *       指向指纹模板地址
+ *       指向指纹模板地址, 由 malloc 分配, 调用者用完后通过 kiran_fprint_template_free 归还
  *
  * cbTemplate [out]
  *       实际返回指纹模板数据大小
@@ -111,6 +149,7 @@ HANDLE kiran_fprint_open_device(int index);
  * [返回值]
  * 0 表示成功
  * FPRINT_RESULT_ENROLL_COMPLETE 表示指纹驱动内部进行采集完成时返回，如libfprint库
+ * FPRINT_RESULT_NO_DEVICE 表示设备已断开, 调用者会重新打开设备后再试一次
  * 其它表示失败
  */
 int kiran_fprint_acquire_finger_print(HANDLE hDevice,
@@ -120,6 +159,8 @@ int kiran_fprint_acquire_finger_print(HANDLE hDevice,
 /* 
  * [功能]
  * 停止采集指纹模板
+ * 在采集线程以外的线程中调用, 应尽快使正在进行的 kiran_fprint_acquire_finger_print 返回,
+ * 可以使用 kiran-fprint-acquire.h 中的辅助函数实现
  *
  * [参数]
  * hDevice
@@ -160,7 +201,7 @@ int kiran_fprint_verify_finger_print(HANDLE hDevice,
 
 /*
  * [功能]
- * 关闭设备
+ * 关闭设备, 并释放 kiran_fprint_open_device 分配的设备上下文
  *
  * [参数]
  * hDevice 
@@ -187,7 +228,7 @@ int kiran_fprint_close_device(HANDLE hDevice);
  *       指纹模板3
  *
  * regfpTemplate [out]
- *       合并后的指纹模板
+ *       合并后的指纹模板, 和采集的模板一样通过 kiran_fprint_template_free 归还
  *
  * cbRegTemplate [out]
  *       实际返回指纹模板数据大小
@@ -233,4 +274,118 @@ int kiran_fprint_template_match(HANDLE hDevice,
                                 unsigned char *fpTemplate2,
                                 unsigned int cbfpTemplate2);
 
+/*
+ * 以下为可选接口, 指纹模块可以不实现
+ */
+
+/*
+ * [功能]
+ * 获取指纹模块的能力, 守护进程在打开设备时据此选择比对方式,
+ * 不会再通过调用接口返回 FPRINT_RESULT_UNSUPPORT 来判断
+ *
+ * [参数]
+ * 无
+ *
+ * [返回值]
+ * 指向静态能力描述的指针, 未实现时根据导出的接口推断
+ */
+const KiranFprintCapabilities *kiran_fprint_get_capabilities();
+
+/*
+ * [功能]
+ * 声明 kiran_fprint_template_match 是否可重入
+ * 非0时, 与大量模板比对会被拆分到多个线程中同时调用 kiran_fprint_template_match
+ * 未导出此变量时按不可重入处理, 所有比对都在同一个线程中进行
+ * 实现了 kiran_fprint_get_capabilities 时忽略此变量, 使用 KIRAN_FPRINT_CAP_REENTRANT_MATCH
+ *
+ * [示例]
+ * const int kiran_fprint_template_match_reentrant = 1;
+ */
+extern const int kiran_fprint_template_match_reentrant;
+
+/*
+ * [功能]
+ * 在一组指纹模板中查找和给定模板匹配的模板, 用于1:N比对
+ * 未实现时, 会逐个调用 kiran_fprint_template_match 进行比对
+ *
+ * [参数]
+ * hDevice
+ *       设备操作实例句柄
+ *
+ * fpTemplate
+ *       待比对的指纹模板
+ *
+ * cbfpTemplate
+ *       待比对的指纹模板数据长度
+ *
+ * fpTemplates
+ *       指纹模板数组
+ *
+ * cbTemplates
+ *       指纹模板长度数组
+ *
+ * number
+ *       指纹模板个数
+ *
+ * index [out]
+ *       匹配的指纹模板下标
+ *
+ * score [out]
+ *       匹配的相似度, 由指纹模块定义, 可以为NULL
+ *
+ * [返回值]
+ * 0 表示匹配
+ * -1 表示不支持, 会退回到逐个比对
+ * 其它表示没有匹配的模板
+ */
+int kiran_fprint_template_match_batch(HANDLE hDevice,
+                                      unsigned char *fpTemplate,
+                                      unsigned int cbfpTemplate,
+                                      unsigned char **fpTemplates,
+                                      unsigned int *cbTemplates,
+                                      unsigned int number,
+                                      int *index,
+                                      int *score);
+
+/*
+ * [功能]
+ * 归还 kiran_fprint_acquire_finger_print 和 kiran_fprint_template_merge 返回的指纹模板
+ * 模块可以把模板缓冲区放回设备的缓冲池中重复使用, 见 kiran-fprint-pool.h
+ * 未实现时, 调用者使用 free 释放模板
+ *
+ * [参数]
+ * hDevice
+ *       设备操作实例句柄, 模板由这个设备返回
+ *
+ * fpTemplate
+ *       指纹模板, 可以为NULL
+ */
+void kiran_fprint_template_free(HANDLE hDevice,
+                                unsigned char *fpTemplate);
+
+/*
+ * [功能]
+ * 设置设备的运行参数, 守护进程在每次录入或认证开始时根据配置文件调用
+ * 调用 kiran_fprint_verify_finger_print 和 kiran_fprint_template_match_batch 前设置模板库序号
+ * 参数名见 KIRAN_FPRINT_PARAM_*, 模块可以忽略不支持的参数
+ *
+ * [参数]
+ * hDevice
+ *       设备操作实例句柄
+ *
+ * name
+ *       参数名
+ *
+ * value
+ *       参数值
+ *
+ * [返回值]
+ * 0 表示成功
+ * -1 表示不支持此参数
+ * 其它表示参数值不合法
+ */
+int kiran_fprint_set_parameter(HANDLE hDevice,
+                               const char *name,
+                               int value);
+
 #endif /* __KIRAN_FPRINT_MODULE_H__ */
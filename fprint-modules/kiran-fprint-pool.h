@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_FPRINT_POOL_H__
+#define __KIRAN_FPRINT_POOL_H__
+
+/*
+ * 指纹模板缓冲池辅助函数, 指纹厂家可以选择使用
+ *
+ * 每个设备一个缓冲池, 采集和合并直接把模板写入池中的缓冲区,
+ * 守护进程用完后通过 kiran_fprint_template_free 归还, 录入和认证的重试循环中不再分配内存
+ *
+ * 缓冲区用 malloc 分配, 不认识 kiran_fprint_template_free 的守护进程直接 free 也是安全的
+ * 同一个设备的操作不会并发, 缓冲池不加锁
+ */
+
+#include <stdlib.h>
+
+#define KIRAN_FPRINT_POOL_SIZE 8  //缓冲池保留的空闲缓冲区个数, 录入时最多同时持有3个采集模板和1个登记模板
+
+typedef struct
+{
+    unsigned int slot_size;                           //每个缓冲区的大小
+    unsigned int n_free;                              //空闲缓冲区个数
+    unsigned char *free_slots[KIRAN_FPRINT_POOL_SIZE]; //空闲缓冲区
+} KiranFprintTemplatePool;
+
+static inline void
+kiran_fprint_template_pool_init(KiranFprintTemplatePool *pool,
+                                unsigned int slot_size)
+{
+    pool->slot_size = slot_size;
+    pool->n_free = 0;
+}
+
+static inline void
+kiran_fprint_template_pool_destroy(KiranFprintTemplatePool *pool)
+{
+    while (pool->n_free > 0)
+        free(pool->free_slots[--pool->n_free]);
+}
+
+//取出一个大小为 slot_size 的缓冲区, 池为空时新分配
+static inline unsigned char *
+kiran_fprint_template_pool_alloc(KiranFprintTemplatePool *pool)
+{
+    if (pool->n_free > 0)
+        return pool->free_slots[--pool->n_free];
+
+    return (unsigned char *)malloc(pool->slot_size);
+}
+
+//归还缓冲区, 池满时直接释放
+static inline void
+kiran_fprint_template_pool_free(KiranFprintTemplatePool *pool,
+                                unsigned char *slot)
+{
+    if (slot == NULL)
+        return;
+
+    if (pool->n_free < KIRAN_FPRINT_POOL_SIZE)
+        pool->free_slots[pool->n_free++] = slot;
+    else
+        free(slot);
+}
+
+#endif /* __KIRAN_FPRINT_POOL_H__ */
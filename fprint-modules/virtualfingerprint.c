@@ -0,0 +1,616 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+/*
+ * 虚拟指纹模块, 不需要指纹设备, 用于性能测试和持续集成
+ *
+ * 通过环境变量配置, 没有设置 KIRAN_VIRTUAL_FPRINT_SPOOL 时不提供任何设备:
+ *   KIRAN_VIRTUAL_FPRINT_SPOOL      投递目录, 第i个设备从 <SPOOL>/<i> 读取采集的指纹
+ *   KIRAN_VIRTUAL_FPRINT_DEVICES    设备个数, 默认为1
+ *   KIRAN_VIRTUAL_FPRINT_DELAY      每次采集的模拟耗时, 毫秒, 默认为0
+ *   KIRAN_VIRTUAL_FPRINT_THRESHOLD  比对时允许的最大不同位数, 默认为特征长度的十分之一
+ *   KIRAN_VIRTUAL_FPRINT_CAPS       声明的模块能力, 逗号分隔, 可选 identify, merge, batch-match,
+ *                                   reentrant-match, 默认为 merge,reentrant-match,
+ *                                   由守护进程自己完成1:N比对和模板检索
+ *
+ * <SPOOL>/<i> 可以是目录或FIFO:
+ *   目录中的文件按文件名顺序逐个采集, 采集后删除
+ *   文件内容为指纹特征, 后缀为 .err 的文件内容为十进制的返回值, 用于模拟采集失败
+ *   FIFO中每行一次采集, 十六进制字符串为指纹特征, '!' 开头为十进制的返回值
+ *
+ * 特征不足 VIRTUAL_FEATURELEN 时补0, 超出时截断
+ * 两个特征不同的位数不超过阈值时认为匹配, 结果是确定的, 比对可以在多个线程中同时调用
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "kiran-fprint-acquire.h"
+#include "kiran-fprint-module.h"
+#include "kiran-fprint-pool.h"
+
+#define VIRTUAL_FEATURELEN 256  //特征长度
+#define VIRTUAL_PATH_SIZE 4096
+#define VIRTUAL_LINE_SIZE (VIRTUAL_FEATURELEN * 2 + 32)
+#define VIRTUAL_SPOOL_EMPTY (-100)  //没有投递的采集, 与 FPRINT_RESULT_* 不冲突
+
+typedef struct
+{
+    char path[VIRTUAL_PATH_SIZE];  //投递目录或FIFO
+    KiranFprintAcquire acquire;    //采集等待和取消
+    KiranFprintTemplatePool pool;  //模板缓冲池, 每个缓冲区可以放下合并后的模板
+
+    int fifo;                      //已打开的FIFO, 没有时为-1
+    char line[VIRTUAL_LINE_SIZE];  //FIFO中未读完的内容
+    unsigned int lineLen;
+} VirtualDevice;
+
+#define VIRTUAL_DEFAULT_CAPS (KIRAN_FPRINT_CAP_MERGE | KIRAN_FPRINT_CAP_REENTRANT_MATCH)
+
+static KiranFprintCapabilities capabilities = {
+    .version = KIRAN_FPRINT_CAPABILITIES_VERSION,
+    .flags = VIRTUAL_DEFAULT_CAPS,
+    .template_format = KIRAN_FPRINT_FORMAT_UNKNOWN,
+    .max_template_size = 3 * VIRTUAL_FEATURELEN,
+};
+
+static const struct
+{
+    const char *name;
+    unsigned int flag;
+} cap_names[] = {
+    {"identify", KIRAN_FPRINT_CAP_IDENTIFY},
+    {"merge", KIRAN_FPRINT_CAP_MERGE},
+    {"batch-match", KIRAN_FPRINT_CAP_BATCH_MATCH},
+    {"reentrant-match", KIRAN_FPRINT_CAP_REENTRANT_MATCH},
+};
+
+static unsigned int m_delay = 0;
+static unsigned int m_threshold = VIRTUAL_FEATURELEN * 8 / 10;
+
+static unsigned int
+env_uint(const char *name, unsigned int def)
+{
+    const char *value = getenv(name);
+    char *end = NULL;
+    unsigned long ret;
+
+    if (value == NULL || *value == '\0')
+        return def;
+
+    ret = strtoul(value, &end, 10);
+    if (end == NULL || *end != '\0')
+        return def;
+
+    return ret;
+}
+
+/* 解析 KIRAN_VIRTUAL_FPRINT_CAPS, 有无法识别的名称时使用默认能力 */
+static unsigned int
+env_caps(const char *name, unsigned int def)
+{
+    const char *value = getenv(name);
+    unsigned int flags = 0;
+    const char *p;
+
+    if (value == NULL)
+        return def;
+
+    for (p = value; *p != '\0';)
+    {
+        size_t len = strcspn(p, ",");
+        unsigned int i;
+
+        for (i = 0; i < sizeof(cap_names) / sizeof(cap_names[0]); i++)
+        {
+            if (strlen(cap_names[i].name) == len &&
+                strncmp(cap_names[i].name, p, len) == 0)
+                break;
+        }
+
+        if (len > 0)
+        {
+            if (i == sizeof(cap_names) / sizeof(cap_names[0]))
+                return def;
+            flags |= cap_names[i].flag;
+        }
+
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+
+    return flags;
+}
+
+const KiranFprintCapabilities *
+kiran_fprint_get_capabilities()
+{
+    //可能在 kiran_fprint_init 之前调用, 每次都从环境变量读取
+    capabilities.flags = env_caps("KIRAN_VIRTUAL_FPRINT_CAPS", VIRTUAL_DEFAULT_CAPS);
+    return &capabilities;
+}
+
+int kiran_fprint_init()
+{
+    m_delay = env_uint("KIRAN_VIRTUAL_FPRINT_DELAY", 0);
+    m_threshold = env_uint("KIRAN_VIRTUAL_FPRINT_THRESHOLD", VIRTUAL_FEATURELEN * 8 / 10);
+
+    return FPRINT_RESULT_OK;
+}
+
+int kiran_fprint_finalize()
+{
+    return FPRINT_RESULT_OK;
+}
+
+int kiran_fprint_get_dev_count()
+{
+    const char *spool = getenv("KIRAN_VIRTUAL_FPRINT_SPOOL");
+
+    if (spool == NULL || *spool == '\0')
+        return 0;
+
+    return env_uint("KIRAN_VIRTUAL_FPRINT_DEVICES", 1);
+}
+
+HANDLE kiran_fprint_open_device(int index)
+{
+    const char *spool = getenv("KIRAN_VIRTUAL_FPRINT_SPOOL");
+    VirtualDevice *device;
+
+    if (spool == NULL || *spool == '\0')
+        return NULL;
+
+    device = (VirtualDevice *)calloc(1, sizeof(VirtualDevice));
+    if (device == NULL)
+        return NULL;
+
+    if (kiran_fprint_acquire_init(&device->acquire) != 0)
+    {
+        free(device);
+        return NULL;
+    }
+
+    kiran_fprint_template_pool_init(&device->pool, 3 * VIRTUAL_FEATURELEN);
+    snprintf(device->path, sizeof(device->path), "%s/%d", spool, index);
+    device->fifo = -1;
+
+    return device;
+}
+
+int kiran_fprint_close_device(HANDLE hDevice)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+
+    if (device->fifo >= 0)
+        close(device->fifo);
+    kiran_fprint_template_pool_destroy(&device->pool);
+    kiran_fprint_acquire_destroy(&device->acquire);
+    free(device);
+
+    return FPRINT_RESULT_OK;
+}
+
+static int
+hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+//投递的返回值, 0 没有特征可以返回, 按失败处理
+static int
+spool_result(const char *value)
+{
+    int ret = atoi(value);
+
+    return ret == FPRINT_RESULT_OK ? FPRINT_RESULT_FAIL : ret;
+}
+
+/*
+ * 解析一行投递内容
+ * 返回 FPRINT_RESULT_OK 表示得到了特征, 其它为投递的返回值
+ */
+static int
+parse_line(const char *line, unsigned char *feature)
+{
+    unsigned int len = 0;
+    int hi;
+    int lo;
+
+    if (line[0] == '!')
+        return spool_result(line + 1);
+
+    memset(feature, 0, VIRTUAL_FEATURELEN);
+    while (len < VIRTUAL_FEATURELEN && line[0] && line[1])
+    {
+        hi = hex_value(line[0]);
+        lo = hex_value(line[1]);
+        if (hi < 0 || lo < 0)
+            break;
+
+        feature[len++] = (hi << 4) | lo;
+        line += 2;
+    }
+
+    return len > 0 ? FPRINT_RESULT_OK : FPRINT_RESULT_FAIL;
+}
+
+/*
+ * 从FIFO读取一次采集
+ * 返回 FPRINT_RESULT_OK 或投递的返回值, 没有数据时返回 VIRTUAL_SPOOL_EMPTY
+ */
+static int
+read_fifo(VirtualDevice *device, unsigned char *feature)
+{
+    char *newline;
+    ssize_t n;
+    int ret;
+
+    if (device->fifo < 0)
+    {
+        device->fifo = open(device->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (device->fifo < 0)
+            return VIRTUAL_SPOOL_EMPTY;
+    }
+
+    for (;;)
+    {
+        newline = memchr(device->line, '\n', device->lineLen);
+        if (newline)
+        {
+            *newline = '\0';
+            ret = newline == device->line ? VIRTUAL_SPOOL_EMPTY : parse_line(device->line, feature);
+            device->lineLen -= newline + 1 - device->line;
+            memmove(device->line, newline + 1, device->lineLen);
+
+            //跳过空行
+            if (ret != VIRTUAL_SPOOL_EMPTY)
+                return ret;
+            continue;
+        }
+
+        //过长的行直接丢弃
+        if (device->lineLen >= sizeof(device->line) - 1)
+            device->lineLen = 0;
+
+        n = read(device->fifo,
+                 device->line + device->lineLen,
+                 sizeof(device->line) - 1 - device->lineLen);
+        if (n <= 0)
+            return VIRTUAL_SPOOL_EMPTY;
+
+        device->lineLen += n;
+    }
+}
+
+static int
+spool_filter(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.';
+}
+
+/*
+ * 从目录读取一次采集, 读取后删除文件
+ * 返回 FPRINT_RESULT_OK 或投递的返回值, 没有数据时返回 VIRTUAL_SPOOL_EMPTY
+ */
+static int
+read_spool_dir(VirtualDevice *device, unsigned char *feature)
+{
+    struct dirent **entries = NULL;
+    char filename[VIRTUAL_PATH_SIZE + NAME_MAX + 2];
+    char buf[32];
+    size_t len;
+    FILE *fp;
+    int count;
+    int ret = VIRTUAL_SPOOL_EMPTY;
+    int i;
+
+    count = scandir(device->path, &entries, spool_filter, alphasort);
+    if (count <= 0)
+    {
+        free(entries);
+        return VIRTUAL_SPOOL_EMPTY;
+    }
+
+    snprintf(filename, sizeof(filename), "%s/%s", device->path, entries[0]->d_name);
+    len = strlen(entries[0]->d_name);
+
+    fp = fopen(filename, "rb");
+    if (fp)
+    {
+        if (len > 4 && strcmp(entries[0]->d_name + len - 4, ".err") == 0)
+        {
+            memset(buf, 0, sizeof(buf));
+            ret = fread(buf, 1, sizeof(buf) - 1, fp) > 0 ? spool_result(buf) : FPRINT_RESULT_FAIL;
+        }
+        else
+        {
+            memset(feature, 0, VIRTUAL_FEATURELEN);
+            ret = fread(feature, 1, VIRTUAL_FEATURELEN, fp) > 0 ? FPRINT_RESULT_OK : FPRINT_RESULT_FAIL;
+        }
+        fclose(fp);
+    }
+    unlink(filename);
+
+    for (i = 0; i < count; i++)
+        free(entries[i]);
+    free(entries);
+
+    return ret;
+}
+
+static int
+read_spool(VirtualDevice *device, unsigned char *feature)
+{
+    struct stat st;
+
+    if (stat(device->path, &st) != 0)
+        return VIRTUAL_SPOOL_EMPTY;
+
+    if (S_ISFIFO(st.st_mode))
+        return read_fifo(device, feature);
+
+    if (S_ISDIR(st.st_mode))
+        return read_spool_dir(device, feature);
+
+    return VIRTUAL_SPOOL_EMPTY;
+}
+
+//模拟采集耗时, 被取消时返回非0
+static int
+simulate_delay(VirtualDevice *device)
+{
+    struct pollfd pfd;
+    unsigned int start;
+    unsigned int elapsed;
+    int ret;
+
+    start = kiran_fprint_acquire_now();
+    elapsed = 0;
+
+    while (elapsed < m_delay)
+    {
+        pfd.fd = kiran_fprint_acquire_get_fd(&device->acquire);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        ret = poll(&pfd, 1, m_delay - elapsed);
+        if (ret > 0 && kiran_fprint_acquire_drain(&device->acquire))
+            return -1;
+
+        elapsed = kiran_fprint_acquire_now() - start;
+    }
+
+    return 0;
+}
+
+int kiran_fprint_acquire_finger_print(HANDLE hDevice,
+                                      unsigned char **fpTemplate,
+                                      unsigned int *cbTemplate,
+                                      unsigned int timeout)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+    unsigned char *feature;
+    int ret = FPRINT_RESULT_FAIL;
+
+    *cbTemplate = 0;
+    *fpTemplate = NULL;
+
+    feature = kiran_fprint_template_pool_alloc(&device->pool);
+    if (feature == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    kiran_fprint_acquire_begin(&device->acquire, timeout);
+
+    do
+    {
+        ret = read_spool(device, feature);
+        if (ret != VIRTUAL_SPOOL_EMPTY)
+            break;
+    } while (kiran_fprint_acquire_wait(&device->acquire) <= KIRAN_FPRINT_ACQUIRE_NOTIFIED);
+
+    if (ret == FPRINT_RESULT_OK && simulate_delay(device) != 0)
+        ret = FPRINT_RESULT_FAIL;
+    kiran_fprint_acquire_end(&device->acquire);
+
+    //超时或被取消
+    if (ret == VIRTUAL_SPOOL_EMPTY)
+        ret = FPRINT_RESULT_FAIL;
+
+    if (ret != FPRINT_RESULT_OK)
+    {
+        kiran_fprint_template_pool_free(&device->pool, feature);
+        return ret;
+    }
+
+    *cbTemplate = VIRTUAL_FEATURELEN;
+    *fpTemplate = feature;
+
+    return FPRINT_RESULT_OK;
+}
+
+void kiran_fprint_acquire_finger_print_stop(HANDLE hDevice)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+
+    kiran_fprint_acquire_cancel(&device->acquire);
+}
+
+void kiran_fprint_template_free(HANDLE hDevice,
+                                unsigned char *fpTemplate)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+
+    kiran_fprint_template_pool_free(&device->pool, fpTemplate);
+}
+
+int kiran_fprint_template_merge(HANDLE hDevice,
+                                unsigned char *fpTemplate1,
+                                unsigned char *fpTemplate2,
+                                unsigned char *fpTemplate3,
+                                unsigned char **regTemplate,
+                                unsigned int *cbRegTemplate)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+
+    *cbRegTemplate = 3 * VIRTUAL_FEATURELEN;
+    *regTemplate = kiran_fprint_template_pool_alloc(&device->pool);
+    if (*regTemplate == NULL)
+    {
+        *cbRegTemplate = 0;
+        return FPRINT_RESULT_FAIL;
+    }
+
+    memcpy(*regTemplate, fpTemplate1, VIRTUAL_FEATURELEN);
+    memcpy(*regTemplate + VIRTUAL_FEATURELEN, fpTemplate2, VIRTUAL_FEATURELEN);
+    memcpy(*regTemplate + 2 * VIRTUAL_FEATURELEN, fpTemplate3, VIRTUAL_FEATURELEN);
+
+    return FPRINT_RESULT_OK;
+}
+
+//两个特征不同的位数
+static unsigned int
+feature_distance(const unsigned char *feature1,
+                 const unsigned char *feature2)
+{
+    unsigned int distance = 0;
+    unsigned int i;
+
+    for (i = 0; i < VIRTUAL_FEATURELEN; i++)
+        distance += __builtin_popcount(feature1[i] ^ feature2[i]);
+
+    return distance;
+}
+
+/*
+ * 模板由一个或多个特征组成, 任意两个特征匹配即认为匹配
+ * 返回最小的不同位数, 模板长度不是特征长度的整数倍时返回 -1
+ */
+static int
+template_distance(unsigned char *fpTemplate1,
+                  unsigned int cbfpTemplate1,
+                  unsigned char *fpTemplate2,
+                  unsigned int cbfpTemplate2)
+{
+    unsigned int best = VIRTUAL_FEATURELEN * 8 + 1;
+    unsigned int distance;
+    unsigned int i;
+    unsigned int j;
+
+    if (cbfpTemplate1 == 0 || cbfpTemplate1 % VIRTUAL_FEATURELEN != 0 ||
+        cbfpTemplate2 == 0 || cbfpTemplate2 % VIRTUAL_FEATURELEN != 0)
+        return -1;
+
+    for (i = 0; i < cbfpTemplate1; i += VIRTUAL_FEATURELEN)
+    {
+        for (j = 0; j < cbfpTemplate2; j += VIRTUAL_FEATURELEN)
+        {
+            distance = feature_distance(fpTemplate1 + i, fpTemplate2 + j);
+            if (distance < best)
+                best = distance;
+        }
+    }
+
+    return best;
+}
+
+int kiran_fprint_template_match(HANDLE hDevice,
+                                unsigned char *fpTemplate1,
+                                unsigned int cbfpTemplate1,
+                                unsigned char *fpTemplate2,
+                                unsigned int cbfpTemplate2)
+{
+    int distance;
+
+    distance = template_distance(fpTemplate1, cbfpTemplate1,
+                                 fpTemplate2, cbfpTemplate2);
+    if (distance < 0 || (unsigned int)distance > m_threshold)
+        return FPRINT_RESULT_FAIL;
+
+    return FPRINT_RESULT_OK;
+}
+
+int kiran_fprint_template_match_batch(HANDLE hDevice,
+                                      unsigned char *fpTemplate,
+                                      unsigned int cbfpTemplate,
+                                      unsigned char **fpTemplates,
+                                      unsigned int *cbTemplates,
+                                      unsigned int number,
+                                      int *index,
+                                      int *score)
+{
+    int distance;
+    unsigned int i;
+
+    //按顺序比对, 返回第一个匹配的模板, 结果是确定的
+    for (i = 0; i < number; i++)
+    {
+        distance = template_distance(fpTemplate, cbfpTemplate,
+                                     fpTemplates[i], cbTemplates[i]);
+        if (distance >= 0 && (unsigned int)distance <= m_threshold)
+        {
+            *index = i;
+            if (score)
+                *score = VIRTUAL_FEATURELEN * 8 - distance;
+
+            return FPRINT_RESULT_OK;
+        }
+    }
+
+    return FPRINT_RESULT_FAIL;
+}
+
+int kiran_fprint_verify_finger_print(HANDLE hDevice,
+                                     unsigned char **fpTemplate,
+                                     unsigned int *cbTemplate,
+                                     unsigned int *number,
+                                     unsigned int timeout)
+{
+    VirtualDevice *device = (VirtualDevice *)hDevice;
+    unsigned char *probe = NULL;
+    unsigned int cbProbe = 0;
+    int index = -1;
+    int ret;
+
+    ret = kiran_fprint_acquire_finger_print(hDevice, &probe, &cbProbe, timeout);
+    if (ret != FPRINT_RESULT_OK)
+        return ret;
+
+    ret = kiran_fprint_template_match_batch(hDevice,
+                                            probe, cbProbe,
+                                            fpTemplate, cbTemplate,
+                                            *number,
+                                            &index, NULL);
+    if (ret == FPRINT_RESULT_OK)
+        *number = index;
+
+    kiran_fprint_template_pool_free(&device->pool, probe);
+
+    return ret;
+}
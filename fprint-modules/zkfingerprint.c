@@ -14,30 +14,64 @@
 
 #include <dlfcn.h>  //Linux动态库的显示调用
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include "kiran-fprint-acquire.h"
 #include "kiran-fprint-module.h"
+#include "kiran-fprint-pool.h"
 #include "zk/libzkfp.h"
 #include "zk/libzkfperrdef.h"
 #include "zk/libzkfptype.h"
 #include "zk/zkinterface.h"
 
-static HANDLE m_libHandle = NULL;
-static HANDLE m_hDBCache = NULL;  //算法缓冲区
+#define ZK_PARAM_IMAGE_SIZE 106  //采集器参数 图像数据大小
+#define ZK_PROBE_INTERVAL 1000   //采集失败时检查设备是否还在的最小间隔, 毫秒
 
-static int do_acquire = 0;
+//SDK的函数指针是全局的, 动态库在模块初始化时加载一次, 所有设备共用
+static HANDLE m_libHandle = NULL;
 
-unsigned int
-GetTickCount()  //获取当前时间
+/*
+ * 算法缓冲区中已加载的模板, 按模板内容摘要排序
+ * 守护进程每次比对都会传入完整的模板库, 和缓冲区比较后只增删变化的模板
+ */
+typedef struct
 {
-    struct timeval tv;
-    struct timezone tz;
-    gettimeofday(&tv, &tz);
-    return (tv.tv_sec * 1000 + tv.tv_usec / 1000);
-}
+    uint64_t digest;     //模板内容摘要
+    unsigned int fid;    //模板在算法缓冲区中的ID
+    unsigned int index;  //模板在最近一次传入的模板库中的下标
+} DBEntry;
+
+/*
+ * 每个打开的设备的上下文, kiran_fprint_open_device 返回它的指针
+ * 设备相关的可变状态都保存在这里, 不同设备可以在不同线程中同时采集和比对
+ */
+typedef struct
+{
+    HANDLE hDevice;              //SDK设备句柄
+    HANDLE hDBCache;             //算法缓冲区
+    KiranFprintAcquire acquire;  //采集等待和取消
+
+    unsigned int imageBufferSize;  //图像数据大小, 打开设备时查询一次
+    unsigned char *imageBuffer;    //图像缓冲区
+    KiranFprintTemplatePool pool;  //模板缓冲池
+
+    DBEntry *dbEntries;  //算法缓冲区中已加载的模板
+    unsigned int dbCount;
+    unsigned int nextFid;
+    int dbSerial;        //算法缓冲区中模板库的序号, 0表示未知
+    int gallerySerial;   //下一次比对传入的模板库序号, 由守护进程设置, 使用一次后清零
+} ZKDevice;
+
+static const KiranFprintCapabilities capabilities = {
+    .version = KIRAN_FPRINT_CAPABILITIES_VERSION,
+    .flags = KIRAN_FPRINT_CAP_IDENTIFY | KIRAN_FPRINT_CAP_MERGE | KIRAN_FPRINT_CAP_BATCH_MATCH,
+    .template_format = KIRAN_FPRINT_FORMAT_ZK,
+    .max_template_size = MAX_TEMPLATE_SIZE,
+};
 
 static int
 loadlib()
@@ -76,6 +110,12 @@ loadlib()
     return 0;
 }
 
+const KiranFprintCapabilities *
+kiran_fprint_get_capabilities()
+{
+    return &capabilities;
+}
+
 int kiran_fprint_init()
 {
     int ret;
@@ -89,26 +129,23 @@ int kiran_fprint_init()
     if (ret != ZKFP_ERR_OK)
         return FPRINT_RESULT_FAIL;
 
-    m_hDBCache = ZKFPM_DBInit();  //创建算法缓冲区   返回值：缓冲区句柄
-    if (NULL == m_hDBCache)
-    {
-        ZKFPM_Terminate();  //释放资源
-        return FPRINT_RESULT_FAIL;
-    }
-
     return FPRINT_RESULT_OK;
 }
 
+static void
+db_cache_reset(ZKDevice *device)
+{
+    free(device->dbEntries);
+    device->dbEntries = NULL;
+    device->dbCount = 0;
+    device->nextFid = 1;
+    device->dbSerial = 0;
+}
+
 int kiran_fprint_finalize()
 {
     int ret;
 
-    if (m_hDBCache)
-    {
-        ZKFPM_DBFree(m_hDBCache);
-        m_hDBCache = NULL;
-    }
-
     ret = ZKFPM_Terminate();
 
     if (m_libHandle)
@@ -125,9 +162,78 @@ int kiran_fprint_get_dev_count()
     return ZKFPM_GetDeviceCount();
 }
 
+//查询图像数据大小, 也用来检查设备是否还在
+static int
+get_image_buffer_size(ZKDevice *device, unsigned int *size)
+{
+    unsigned char paramValue[4] = {0x0};
+    unsigned int cbParamValue = 4;
+    int ret;
+
+    /* |   设备  |   参数类型     |  参数值     |  参数数据长度  */
+    ret = ZKFPM_GetParameters(device->hDevice, ZK_PARAM_IMAGE_SIZE, paramValue, &cbParamValue);
+    if (ret != ZKFP_ERR_OK)
+        return FPRINT_RESULT_FAIL;
+
+    *size = *((unsigned int *)paramValue);
+
+    return FPRINT_RESULT_OK;
+}
+
+static void
+free_device(ZKDevice *device)
+{
+    if (device->hDBCache)
+        ZKFPM_DBFree(device->hDBCache);
+    if (device->hDevice)
+        ZKFPM_CloseDevice(device->hDevice);
+    kiran_fprint_template_pool_destroy(&device->pool);
+    free(device->imageBuffer);
+    kiran_fprint_acquire_destroy(&device->acquire);
+    free(device);
+}
+
 HANDLE kiran_fprint_open_device(int index)
 {
-    return ZKFPM_OpenDevice(index);
+    ZKDevice *device;
+
+    device = (ZKDevice *)calloc(1, sizeof(ZKDevice));
+    if (device == NULL)
+        return NULL;
+
+    if (kiran_fprint_acquire_init(&device->acquire) != 0)
+    {
+        free(device);
+        return NULL;
+    }
+
+    kiran_fprint_template_pool_init(&device->pool, MAX_TEMPLATE_SIZE);
+
+    device->nextFid = 1;
+    device->hDevice = ZKFPM_OpenDevice(index);
+    device->hDBCache = ZKFPM_DBInit();  //创建算法缓冲区   返回值：缓冲区句柄
+    if (device->hDevice == NULL || device->hDBCache == NULL)
+    {
+        free_device(device);
+        return NULL;
+    }
+
+    //图像尺寸在设备打开期间不会变化, 缓冲区只分配一次
+    if (get_image_buffer_size(device, &device->imageBufferSize) != FPRINT_RESULT_OK ||
+        device->imageBufferSize == 0)
+    {
+        free_device(device);
+        return NULL;
+    }
+
+    device->imageBuffer = (unsigned char *)malloc(device->imageBufferSize);
+    if (device->imageBuffer == NULL)
+    {
+        free_device(device);
+        return NULL;
+    }
+
+    return device;
 }
 
 int kiran_fprint_acquire_finger_print(HANDLE hDevice,
@@ -135,88 +241,106 @@ int kiran_fprint_acquire_finger_print(HANDLE hDevice,
                                       unsigned int *cbTemplate,
                                       unsigned int timeout)
 {
-    unsigned int preTime = GetTickCount();
-    char paramValue[4] = {0x0};
-    unsigned int cbParamValue = 4;
-    int imageBufferSize = 0;
-    unsigned char *m_pImgBuf = NULL;
-    unsigned char szTemplate[MAX_TEMPLATE_SIZE];
+    ZKDevice *device = (ZKDevice *)hDevice;
+    unsigned char *szTemplate = NULL;
     unsigned int tempLen = MAX_TEMPLATE_SIZE;
-    unsigned int curTime;
+    unsigned int imageBufferSize = 0;
+    unsigned int lastProbe;
+    unsigned int now;
     int ret;
 
-    do_acquire = 0;
-
-    memset(paramValue, 0x0, 4);                                                   //初始化paramValue[4]
-    cbParamValue = 4;                                                             //初始化cbParamValue
-                                                                                  /* |   设备  |   参数类型     |  参数值     |  参数数据长度  */
-    ZKFPM_GetParameters(hDevice, 1, (unsigned char *)paramValue, &cbParamValue);  //获取采集器参数 图像宽
-
-    memset(paramValue, 0x0, 4);                                                   //初始化paramValue[4]
-    cbParamValue = 4;                                                             //初始化cbParamValue
-                                                                                  /* |   设备  |   参数类型     |  参数值     |  参数数据长度  */
-    ZKFPM_GetParameters(hDevice, 2, (unsigned char *)paramValue, &cbParamValue);  //获取采集器参数 图像高
+    *cbTemplate = 0;
+    *fpTemplate = NULL;
 
-    memset(paramValue, 0x0, 4);                                                     //初始化paramValue[4]
-    cbParamValue = 4;                                                               //初始化cbParamValue
-                                                                                    /* |   设备  |   参数类型     |  参数值     |  参数数据长度  */
-    ZKFPM_GetParameters(hDevice, 106, (unsigned char *)paramValue, &cbParamValue);  //获取采集器参数 图像数据大小
-    if (ret != 0)
+    //模板直接写入模板缓冲区中, 不再复制
+    szTemplate = kiran_fprint_template_pool_alloc(&device->pool);
+    if (szTemplate == NULL)
         return FPRINT_RESULT_FAIL;
 
-    imageBufferSize = *((int *)paramValue);
-    m_pImgBuf = (unsigned char *)malloc(imageBufferSize);
-    if (m_pImgBuf == NULL)
-        return FPRINT_RESULT_FAIL;
+    kiran_fprint_acquire_begin(&device->acquire, timeout);
+    lastProbe = device->acquire.start;
 
-    ret = FPRINT_RESULT_FAIL;
-
-    while (0 == do_acquire)
+    do
     {
-        ret = ZKFPM_AcquireFingerprint(hDevice,
-                                       m_pImgBuf, imageBufferSize,
+        tempLen = MAX_TEMPLATE_SIZE;
+        ret = ZKFPM_AcquireFingerprint(device->hDevice,
+                                       device->imageBuffer, device->imageBufferSize,
                                        szTemplate, &tempLen);
         if (ret == 0)
-        {
             break;
-        }
 
-        curTime = GetTickCount();
-        if (curTime - preTime >= timeout)
+        //没有手指和设备被拔出都会采集失败, 隔一段时间检查一次设备是否还在
+        //设备被拔出后句柄失效, 由调用者重新打开设备
+        now = kiran_fprint_acquire_now();
+        if (now - lastProbe >= ZK_PROBE_INTERVAL)
         {
-            ret = FPRINT_RESULT_FAIL;
-            break;
+            lastProbe = now;
+            if (get_image_buffer_size(device, &imageBufferSize) != FPRINT_RESULT_OK)
+            {
+                kiran_fprint_acquire_end(&device->acquire);
+                kiran_fprint_template_pool_free(&device->pool, szTemplate);
+                return FPRINT_RESULT_NO_DEVICE;
+            }
         }
+    } while (kiran_fprint_acquire_wait(&device->acquire) <= KIRAN_FPRINT_ACQUIRE_NOTIFIED);
+    kiran_fprint_acquire_end(&device->acquire);
 
-        usleep(100000);
-    }
-
-    if (ret == 0)
-    {
-        *cbTemplate = tempLen;
-        *fpTemplate = (unsigned char *)malloc(*cbTemplate);
-        memcpy(*fpTemplate, szTemplate, *cbTemplate);
-    }
-    else
+    //超时或被取消
+    if (ret != 0)
     {
-        *cbTemplate = 0;
-        *fpTemplate = NULL;
+        kiran_fprint_template_pool_free(&device->pool, szTemplate);
+        return FPRINT_RESULT_FAIL;
     }
 
-    free(m_pImgBuf);
-    m_pImgBuf = NULL;
+    *cbTemplate = tempLen;
+    *fpTemplate = szTemplate;
 
-    return ret;
+    return FPRINT_RESULT_OK;
 }
 
 void kiran_fprint_acquire_finger_print_stop(HANDLE hDevice)
 {
-    do_acquire = -1;
+    ZKDevice *device = (ZKDevice *)hDevice;
+
+    kiran_fprint_acquire_cancel(&device->acquire);
 }
 
 int kiran_fprint_close_device(HANDLE hDevice)
 {
-    return ZKFPM_CloseDevice(hDevice);
+    ZKDevice *device = (ZKDevice *)hDevice;
+    int ret;
+
+    db_cache_reset(device);
+    ZKFPM_DBFree(device->hDBCache);
+    device->hDBCache = NULL;
+    ret = ZKFPM_CloseDevice(device->hDevice);
+    device->hDevice = NULL;
+    free_device(device);
+
+    return ret;
+}
+
+void kiran_fprint_template_free(HANDLE hDevice,
+                                unsigned char *fpTemplate)
+{
+    ZKDevice *device = (ZKDevice *)hDevice;
+
+    kiran_fprint_template_pool_free(&device->pool, fpTemplate);
+}
+
+int kiran_fprint_set_parameter(HANDLE hDevice,
+                               const char *name,
+                               int value)
+{
+    ZKDevice *device = (ZKDevice *)hDevice;
+
+    if (strcmp(name, KIRAN_FPRINT_PARAM_GALLERY_SERIAL) == 0)
+    {
+        device->gallerySerial = value;
+        return FPRINT_RESULT_OK;
+    }
+
+    return FPRINT_RESULT_UNSUPPORT;
 }
 
 int kiran_fprint_template_merge(HANDLE hDevice,
@@ -226,25 +350,30 @@ int kiran_fprint_template_merge(HANDLE hDevice,
                                 unsigned char **regTemplate,
                                 unsigned int *cbRegTemplate)
 {
-    unsigned char szTemplate[MAX_TEMPLATE_SIZE];
+    ZKDevice *device = (ZKDevice *)hDevice;
+    unsigned char *szTemplate = NULL;
     unsigned int tempLen = MAX_TEMPLATE_SIZE;
     int ret;
 
-    ret = FPRINT_RESULT_FAIL;
-    ret = ZKFPM_DBMerge(m_hDBCache,
+    *cbRegTemplate = 0;
+    *regTemplate = NULL;
+
+    szTemplate = kiran_fprint_template_pool_alloc(&device->pool);
+    if (szTemplate == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    ret = ZKFPM_DBMerge(device->hDBCache,
                         fpTemplate1, fpTemplate2, fpTemplate3,
                         szTemplate, &tempLen);  //将3枚预登记指纹模板合并为一枚登记指纹
 
     if (ret == 0)
     {
         *cbRegTemplate = tempLen;
-        *regTemplate = (unsigned char *)malloc(*cbRegTemplate);
-        memcpy(*regTemplate, szTemplate, *cbRegTemplate);
+        *regTemplate = szTemplate;
     }
     else
     {
-        *cbRegTemplate = 0;
-        *regTemplate = NULL;
+        kiran_fprint_template_pool_free(&device->pool, szTemplate);
     }
 
     return ret;
@@ -256,20 +385,199 @@ int kiran_fprint_template_match(HANDLE hDevice,
                                 unsigned char *fpTemplate2,
                                 unsigned int cbfpTemplate2)
 {
+    ZKDevice *device = (ZKDevice *)hDevice;
     int score = 0;
 
-    score = ZKFPM_DBMatch(m_hDBCache,
+    score = ZKFPM_DBMatch(device->hDBCache,
                           fpTemplate1, cbfpTemplate1,
                           fpTemplate2, cbfpTemplate2);
 
     return score > 0 ? FPRINT_RESULT_OK : FPRINT_RESULT_FAIL;
 }
 
+//64位FNV-1a
+static uint64_t
+template_digest(const unsigned char *data, unsigned int len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash ^ len;
+}
+
+static int
+db_entry_compare(const void *a, const void *b)
+{
+    const DBEntry *ea = a;
+    const DBEntry *eb = b;
+
+    if (ea->digest != eb->digest)
+        return ea->digest < eb->digest ? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * 将传入的模板库同步到算法缓冲区
+ * 模板库序号与缓冲区中的相同时模板库没有变化, 不需要同步
+ * 否则缓冲区中有而模板库中没有的模板被删除, 新的模板被添加, 未变化的模板保留
+ */
+static int
+db_cache_sync(ZKDevice *device,
+              unsigned char **fpTemplates,
+              unsigned int *cbTemplates,
+              unsigned int number)
+{
+    DBEntry *entries;
+    unsigned int count = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    int serial = device->gallerySerial;
+
+    device->gallerySerial = 0;
+    if (serial != 0 && serial == device->dbSerial)
+        return FPRINT_RESULT_OK;
+
+    entries = (DBEntry *)malloc((number + 1) * sizeof(DBEntry));
+    if (entries == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    for (i = 0; i < number; i++)
+    {
+        entries[i].digest = template_digest(fpTemplates[i], cbTemplates[i]);
+        entries[i].fid = 0;
+        entries[i].index = i;
+    }
+    qsort(entries, number, sizeof(DBEntry), db_entry_compare);
+
+    //有序合并, 相同的模板只保留一份
+    i = 0;
+    while (i < number || j < device->dbCount)
+    {
+        if (i < number && count > 0 && entries[count - 1].digest == entries[i].digest)
+        {
+            i++;
+            continue;
+        }
+
+        if (j < device->dbCount &&
+            (i >= number || device->dbEntries[j].digest < entries[i].digest))
+        {
+            ZKFPM_DBDel(device->hDBCache, device->dbEntries[j].fid);
+            j++;
+            continue;
+        }
+
+        entries[count] = entries[i];
+        if (j < device->dbCount && device->dbEntries[j].digest == entries[i].digest)
+        {
+            entries[count].fid = device->dbEntries[j].fid;
+            j++;
+        }
+        else
+        {
+            entries[count].fid = device->nextFid++;
+            if (ZKFPM_DBAdd(device->hDBCache,
+                            entries[count].fid,
+                            fpTemplates[entries[count].index],
+                            cbTemplates[entries[count].index]) != ZKFP_ERR_OK)
+            {
+                //缓冲区状态未知, 清空后下次重新加载
+                ZKFPM_DBClear(device->hDBCache);
+                free(entries);
+                db_cache_reset(device);
+                return FPRINT_RESULT_FAIL;
+            }
+        }
+        count++;
+        i++;
+    }
+
+    free(device->dbEntries);
+    device->dbEntries = entries;
+    device->dbCount = count;
+    device->dbSerial = serial;
+
+    return FPRINT_RESULT_OK;
+}
+
+static int
+db_cache_identify(ZKDevice *device,
+                  unsigned char *fpTemplate,
+                  unsigned int cbTemplate,
+                  int *index,
+                  int *score)
+{
+    unsigned int fid = 0;
+    unsigned int fpScore = 0;
+    unsigned int i;
+
+    if (ZKFPM_DBIdentify(device->hDBCache, fpTemplate, cbTemplate, &fid, &fpScore) != ZKFP_ERR_OK)
+        return FPRINT_RESULT_FAIL;
+
+    for (i = 0; i < device->dbCount; i++)
+    {
+        if (device->dbEntries[i].fid == fid)
+        {
+            *index = device->dbEntries[i].index;
+            if (score)
+                *score = fpScore;
+
+            return FPRINT_RESULT_OK;
+        }
+    }
+
+    return FPRINT_RESULT_FAIL;
+}
+
 int kiran_fprint_verify_finger_print(HANDLE hDevice,
                                      unsigned char **fpTemplate,
                                      unsigned int *cbTemplate,
                                      unsigned int *number,
                                      unsigned int timeout)
 {
-    return FPRINT_RESULT_UNSUPPORT;
+    ZKDevice *device = (ZKDevice *)hDevice;
+    unsigned char *probe = NULL;
+    unsigned int cbProbe = 0;
+    int index = -1;
+    int ret;
+
+    //无法加载到算法缓冲区时由调用者逐个比对
+    if (db_cache_sync(device, fpTemplate, cbTemplate, *number) != FPRINT_RESULT_OK)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    ret = kiran_fprint_acquire_finger_print(hDevice, &probe, &cbProbe, timeout);
+    if (ret != FPRINT_RESULT_OK)
+        return ret;
+
+    ret = db_cache_identify(device, probe, cbProbe, &index, NULL);
+    if (ret == FPRINT_RESULT_OK)
+        *number = index;
+
+    kiran_fprint_template_pool_free(&device->pool, probe);
+
+    return ret;
+}
+
+int kiran_fprint_template_match_batch(HANDLE hDevice,
+                                      unsigned char *fpTemplate,
+                                      unsigned int cbfpTemplate,
+                                      unsigned char **fpTemplates,
+                                      unsigned int *cbTemplates,
+                                      unsigned int number,
+                                      int *index,
+                                      int *score)
+{
+    ZKDevice *device = (ZKDevice *)hDevice;
+
+    if (db_cache_sync(device, fpTemplates, cbTemplates, number) != FPRINT_RESULT_OK)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    return db_cache_identify(device, fpTemplate, cbfpTemplate, index, score);
 }
@@ -30,13 +30,17 @@
 #include "kiran-pam.h"
 #include "kiran-user-gen.h"
 
+/*
+ * 解析认证项, all为TRUE时返回所有data_id, 以','分隔, 否则只返回第一个
+ */
 static char *
-parser_auth_items_json_data(pam_handle_t *pamh, char *data)
+parser_auth_items_json_data(pam_handle_t *pamh, char *data, gboolean all)
 {
     JsonParser *jparse = json_parser_new();
     JsonNode *root;
     JsonReader *reader;
     GError *error = NULL;
+    GString *ids;
     char *id = NULL;
     gboolean ret;
 
@@ -57,6 +61,7 @@ parser_auth_items_json_data(pam_handle_t *pamh, char *data)
         GList *list = json_array_get_elements(array);
         GList *iter;
 
+        ids = g_string_new(NULL);
         reader = json_reader_new(NULL);
         for (iter = list; iter; iter = iter->next)
         {
@@ -65,13 +70,24 @@ parser_auth_items_json_data(pam_handle_t *pamh, char *data)
             json_reader_set_root(reader, iter->data);
             json_reader_read_member(reader, "data_id");
             data_id = json_reader_get_string_value(reader);
+            json_reader_end_member(reader);
             if (data_id)
             {
-                id = strdup(data_id);
-                break;
+                if (ids->len > 0)
+                    g_string_append_c(ids, ',');
+                g_string_append(ids, data_id);
+
+                if (!all)
+                    break;
             }
         }
         g_object_unref(reader);
+        g_list_free(list);
+
+        if (ids->len > 0)
+            id = g_string_free(ids, FALSE);
+        else
+            g_string_free(ids, TRUE);
     }
 
     g_object_unref(jparse);
@@ -88,7 +104,8 @@ data_cleanup(pam_handle_t *pamh, void *data, int error_status)
 static char *
 get_auth_item(KiranAccountsUser *user,
               pam_handle_t *pamh,
-              int mod)
+              int mod,
+              gboolean all)
 {
     GError *error;
     gchar *auth_items = NULL;
@@ -110,7 +127,7 @@ get_auth_item(KiranAccountsUser *user,
     else
     {
         char *id;
-        id = parser_auth_items_json_data(pamh, auth_items);
+        id = parser_auth_items_json_data(pamh, auth_items, all);
         if (id)
         {
             auth = id;
@@ -199,7 +216,7 @@ do_authmode_set(pam_handle_t *pamh, const char *username)
 
     //指纹认证
     if (authmode & ACCOUNTS_AUTH_MODE_FINGERPRINT)
-        auth = get_auth_item(user, pamh, ACCOUNTS_AUTH_MODE_FINGERPRINT);
+        auth = get_auth_item(user, pamh, ACCOUNTS_AUTH_MODE_FINGERPRINT, TRUE);
     else
         auth = g_strdup(NOT_NEED_DATA);
     pam_set_data(pamh, FINGER_MODE, auth, data_cleanup);
@@ -213,7 +230,7 @@ do_authmode_set(pam_handle_t *pamh, const char *username)
 
     //人脸认证
     if (authmode & ACCOUNTS_AUTH_MODE_FACE)
-        auth = get_auth_item(user, pamh, ACCOUNTS_AUTH_MODE_FACE);
+        auth = get_auth_item(user, pamh, ACCOUNTS_AUTH_MODE_FACE, FALSE);
     else
         auth = g_strdup(NOT_NEED_DATA);
     pam_set_data(pamh, FACE_MODE, auth, data_cleanup);
@@ -38,10 +38,10 @@
 typedef struct
 {
     char *result;
-    char *id;
+    char **ids; /* 当前用户的指纹模板ID */
     pam_handle_t *pamh;
     GMainLoop *loop;
-    gboolean should_handle;
+    gboolean queued; /* 设备正在被其它会话使用, 认证在排队 */
     gboolean match;
 } verify_data;
 
@@ -86,13 +86,7 @@ verify_result(GObject *object, const char *result, gboolean done, gboolean found
 
     D(data->pamh, "Verify result: %s and id: %s\n", result, id);
 
-    if (!data->should_handle)
-    {
-        data->should_handle = TRUE;
-        return;
-    }
-
-    if (found && (g_strcmp0(id, data->id) == 0))
+    if (found && data->ids && g_strv_contains((const gchar *const *)data->ids, id))
         data->match = TRUE;
 
     if (done != FALSE || data->match)
@@ -108,6 +102,26 @@ verify_result(GObject *object, const char *result, gboolean done, gboolean found
         send_info_msg(data->pamh, result);
 }
 
+static void
+queue_position(GObject *object, const char *action, guint position, gpointer user_data)
+{
+    verify_data *data = user_data;
+    char *msg;
+
+    D(data->pamh, "Queue position of %s: %u\n", action, position);
+
+    if (g_strcmp0(action, "verify") != 0)
+        return;
+
+    data->queued = position > 0;
+    if (data->queued)
+    {
+        msg = g_strdup_printf(_("Fingerprint device is in use, waiting (position %u)"), position);
+        send_info_msg(data->pamh, msg);
+        g_free(msg);
+    }
+}
+
 static gboolean
 verify_timeout_cb(gpointer user_data)
 {
@@ -119,6 +133,20 @@ verify_timeout_cb(gpointer user_data)
     return FALSE;
 }
 
+/*
+ * 知道当前用户的模板ID时, 只和这些模板进行比对
+ */
+static gboolean
+verify_start(DBusGProxy *biometrics, char **ids, GError **error)
+{
+    if (ids)
+        return com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_start_for_ids(biometrics,
+                                                                                      (const char **)ids,
+                                                                                      error);
+
+    return com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_start(biometrics, error);
+}
+
 static int
 do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *biometrics, const char *auth)
 {
@@ -131,8 +159,10 @@ do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *biometrics, const cha
     data->pamh = pamh;
     data->loop = loop;
     data->result = NULL;
-    data->id = g_strdup(auth);
-    data->should_handle = TRUE;
+    data->ids = NULL;
+    if (auth && g_strcmp0(auth, NEED_DATA) != 0)
+        data->ids = g_strsplit(auth, ",", -1);
+    data->queued = FALSE;
     data->match = FALSE;
 
     dbus_g_proxy_add_signal(biometrics,
@@ -143,30 +173,32 @@ do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *biometrics, const cha
                                 "VerifyFprintStatus",
                                 G_CALLBACK(verify_result),
                                 data, NULL);
+
+    //设备忙时认证会排队, 不再停止其它会话的认证
+    dbus_g_proxy_add_signal(biometrics,
+                            "FprintQueuePosition",
+                            G_TYPE_STRING, G_TYPE_UINT, NULL);
+
+    dbus_g_proxy_connect_signal(biometrics,
+                                "FprintQueuePosition",
+                                G_CALLBACK(queue_position),
+                                data, NULL);
+
     ret = PAM_AUTH_ERR;
     D(data->pamh, "Verify id: %s\n", auth);
 
-    if (!com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_start(biometrics, &error))
+    if (!verify_start(biometrics, data->ids, &error))
     {
-        if (dbus_g_error_has_name(error, "com.kylinsec.Kiran.SystemDaemon.Biometrics.Error.DeviceBusy"))
-        {
-            //取消先前的认证
-            data->should_handle = FALSE;
-            com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_stop(biometrics, NULL);
-            g_error_free(error);
-        }
-
-        error = NULL;
-        if (!com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_start(biometrics, &error))
-        {
-            D(pamh, "VerifyFprintStart failed: %s", error->message);
-            send_info_msg(pamh, error->message);
-            g_error_free(error);
-
-            g_free(data->result);
-            g_free(data);
-            return PAM_AUTH_ERR;
-        }
+        D(pamh, "VerifyFprintStart failed: %s", error->message);
+        send_info_msg(pamh, error->message);
+        g_error_free(error);
+
+        dbus_g_proxy_disconnect_signal(biometrics, "VerifyFprintStatus", G_CALLBACK(verify_result), data);
+        dbus_g_proxy_disconnect_signal(biometrics, "FprintQueuePosition", G_CALLBACK(queue_position), data);
+        g_free(data->result);
+        g_strfreev(data->ids);
+        g_free(data);
+        return PAM_AUTH_ERR;
     }
 
     source = g_timeout_source_new_seconds(120);
@@ -180,6 +212,7 @@ do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *biometrics, const cha
 
     com_kylinsec_Kiran_SystemDaemon_Biometrics_verify_fprint_stop(biometrics, NULL);  //关闭指纹认证
     dbus_g_proxy_disconnect_signal(biometrics, "VerifyFprintStatus", G_CALLBACK(verify_result), data);
+    dbus_g_proxy_disconnect_signal(biometrics, "FprintQueuePosition", G_CALLBACK(queue_position), data);
 
     if (data->match)
     {
@@ -194,7 +227,7 @@ do_verify(GMainLoop *loop, pam_handle_t *pamh, DBusGProxy *biometrics, const cha
     }
 
     g_free(data->result);
-    g_free(data->id);
+    g_strfreev(data->ids);
     g_free(data);
 
     return ret;
@@ -285,6 +318,8 @@ PAM_EXTERN int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc,
 
     dbus_g_object_register_marshaller(biometrics_marshal_VOID__STRING_BOOLEAN_BOOLEAN_STRING,
                                       G_TYPE_NONE, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN, G_TYPE_STRING, G_TYPE_INVALID);
+    dbus_g_object_register_marshaller(biometrics_marshal_VOID__STRING_UINT,
+                                      G_TYPE_NONE, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_INVALID);
 
     pam_get_item(pamh, PAM_RHOST, (const void **)(const void *)&rhost);
 
@@ -0,0 +1,1624 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#include <gio/gio.h>
+#include <glib/gi18n.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-biometrics-device-gen.h"
+#include "kiran-biometrics-device.h"
+#include "kiran-biometrics-trace.h"
+#include "kiran-biometrics-types.h"
+#include "kiran-biometrics.h"
+#include "kiran-event-queue.h"
+#include "kiran-operation.h"
+#include "kiran-settings.h"
+#include "kiran-stats.h"
+
+#define BUFFER_SIZE 1024
+
+typedef enum
+{
+    ACTION_NONE = 0,
+    FP_ACTION_VERIFY,
+    FP_ACTION_ENROLL,
+} FprintAction;
+
+/*
+ * 操作的优先级, 高优先级的操作会抢占正在执行的低优先级操作
+ * 认证(登录, 解锁, 提权)优先于录入
+ */
+typedef enum
+{
+    JOB_PRIORITY_LOW = 0,  //录入
+    JOB_PRIORITY_HIGH = 1, //认证
+} KiranBiometricsPriority;
+
+/*
+ * 一次录入或认证操作, 由设备的工作线程执行
+ * 交给工作线程后只读, 取消通过设备的状态机进行
+ */
+typedef struct
+{
+    FprintAction action;
+    KiranBiometricsPriority priority;
+    guint32 owner;  /* 发起指纹录入的用户 */
+    gchar **ids;    /* 指纹认证时参与比对的模板ID, NULL表示所有模板 */
+    gchar *sender;  /* 发起操作的总线连接, 只能由它停止 */
+    guint position; /* 在等待队列中的位置, 0表示正在执行 */
+    gboolean preempted; /* 被高优先级的操作抢占, 在取消操作之前设置 */
+    gboolean requeue;   /* 工作线程设置, 操作被抢占而中断, 需要重新排队 */
+    gboolean stopped;   /* 被抢占后发起者停止了操作, 不再重新排队, 只在主循环中访问 */
+    guint generation;   /* 交给工作线程时分配的代数, 代数变化表示操作被取消 */
+    gboolean via_root;  /* 从根对象发起, 状态信号也要在根对象上发出 */
+    KiranSettings *settings; /* 工作线程开始执行时的配置 */
+} KiranBiometricsJob;
+
+struct _KiranBiometricsDevicePrivate
+{
+    KiranFprintDevice *device;
+    KiranFprintStore *store; /* 已保存的指纹模板, 所有设备共用 */
+    gchar *object_path;
+    KiranDbusBiometricsFprintDevice *skeleton; /* 导出到总线的设备接口 */
+    KiranEventQueue *events;                   /* 操作线程产生的状态事件, 在主循环中发出信号 */
+
+    KiranBiometricsJob *job; /* 正在执行的操作, 只在主循环中访问, 操作结束后置空 */
+    KiranBiometricsJob *status_job; /* 正在发出的状态信号所属的操作 */
+    GQueue pending;          /* 等待执行的操作, 按优先级排列, 只在主循环中访问 */
+    GHashTable *senders;     /* 有操作的发起者, 唯一名 -> 名字监视, 断开时停止它的操作 */
+    GAsyncQueue *jobs;       /* 交给工作线程的操作 */
+    GThread *worker;         /* 设备的工作线程, 和设备对象同生命周期 */
+    KiranOperation operation; /* 正在执行的操作所处的阶段, 不加锁读取 */
+};
+
+static gboolean kiran_biometrics_device_enroll_fprint_start(KiranDbusBiometricsFprintDevice *skeleton,
+                                                            GDBusMethodInvocation *invocation,
+                                                            KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_enroll_fprint_stop(KiranDbusBiometricsFprintDevice *skeleton,
+                                                           GDBusMethodInvocation *invocation,
+                                                           KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_verify_fprint_start(KiranDbusBiometricsFprintDevice *skeleton,
+                                                            GDBusMethodInvocation *invocation,
+                                                            KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_verify_fprint_start_for_ids(KiranDbusBiometricsFprintDevice *skeleton,
+                                                                    GDBusMethodInvocation *invocation,
+                                                                    const gchar *const *ids,
+                                                                    KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_verify_fprint_stop(KiranDbusBiometricsFprintDevice *skeleton,
+                                                           GDBusMethodInvocation *invocation,
+                                                           KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_get_module(KiranDbusBiometricsFprintDevice *skeleton,
+                                                   GDBusMethodInvocation *invocation,
+                                                   KiranBiometricsDevice *device);
+static gboolean kiran_biometrics_device_get_operation_state(KiranDbusBiometricsFprintDevice *skeleton,
+                                                            GDBusMethodInvocation *invocation,
+                                                            KiranBiometricsDevice *device);
+
+#define KIRAN_BIOMETRICS_DEVICE_GET_PRIVATE(O) \
+    (G_TYPE_INSTANCE_GET_PRIVATE((O), KIRAN_TYPE_BIOMETRICS_DEVICE, KiranBiometricsDevicePrivate))
+
+enum kiran_biometrics_device_signals
+{
+    SIGNAL_FPRINT_VERIFY_STATUS,
+    SIGNAL_FPRINT_ENROLL_STATUS,
+    SIGNAL_QUEUE_POSITION,
+    NUM_SIGNAL,
+};
+
+//工作线程完成一次操作, 不对应信号
+#define EVENT_JOB_DONE NUM_SIGNAL
+
+static gpointer kiran_biometrics_device_worker(gpointer data);
+static void kiran_biometrics_device_unwatch_sender(gpointer data);
+static void kiran_biometrics_device_release_sender(KiranBiometricsDevice *device,
+                                                   const gchar *sender);
+
+static void kiran_biometrics_device_dispatch_event(KiranEvent *event,
+                                                   gpointer user_data);
+static void kiran_biometrics_device_queue_job(KiranBiometricsDevice *device,
+                                              KiranBiometricsJob *job,
+                                              gboolean resume);
+static void kiran_biometrics_device_schedule(KiranBiometricsDevice *device);
+
+static guint signals[NUM_SIGNAL] = {
+    0,
+};
+
+G_DEFINE_TYPE(KiranBiometricsDevice, kiran_biometrics_device, G_TYPE_OBJECT);
+
+static KiranBiometricsJob *
+kiran_biometrics_job_new(FprintAction action,
+                         const gchar *sender)
+{
+    KiranBiometricsJob *job;
+
+    job = g_slice_new0(KiranBiometricsJob);
+    job->action = action;
+    job->priority = action == FP_ACTION_VERIFY ? JOB_PRIORITY_HIGH : JOB_PRIORITY_LOW;
+    job->owner = G_MAXUINT32;
+    job->sender = g_strdup(sender);
+
+    return job;
+}
+
+static void
+kiran_biometrics_job_free(KiranBiometricsJob *job)
+{
+    g_strfreev(job->ids);
+    g_free(job->sender);
+    kiran_settings_unref(job->settings);
+    g_slice_free(KiranBiometricsJob, job);
+}
+
+//被抢占的操作重新排队时使用新的副本, 原来的操作随完成事件释放
+static KiranBiometricsJob *
+kiran_biometrics_job_copy(KiranBiometricsJob *job)
+{
+    KiranBiometricsJob *copy;
+
+    copy = kiran_biometrics_job_new(job->action, job->sender);
+    copy->owner = job->owner;
+    copy->ids = g_strdupv(job->ids);
+    copy->via_root = job->via_root;
+
+    return copy;
+}
+
+static const gchar *
+kiran_biometrics_job_get_name(KiranBiometricsJob *job)
+{
+    return job->action == FP_ACTION_ENROLL ? "enroll" : "verify";
+}
+
+static gboolean
+kiran_biometrics_device_job_is_cancelled(KiranBiometricsDevice *device,
+                                         KiranBiometricsJob *job)
+{
+    return kiran_operation_is_cancelled(&device->priv->operation, job->generation);
+}
+
+//工作线程进入操作的下一个阶段, 操作已被取消时返回 FALSE
+static gboolean
+kiran_biometrics_device_enter_state(KiranBiometricsDevice *device,
+                                    KiranBiometricsJob *job,
+                                    KiranOperationState state)
+{
+    return kiran_operation_enter(&device->priv->operation, job->generation, state);
+}
+
+//取消正在执行的操作, 不等待工作线程
+static void
+kiran_biometrics_device_cancel_running(KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    if (kiran_operation_cancel(&priv->operation, priv->job->generation))
+        kiran_fprint_device_acquire_finger_print_stop(priv->device);
+}
+
+static void
+kiran_biometrics_device_finalize(GObject *object)
+{
+    KiranBiometricsDevice *device;
+    KiranBiometricsDevicePrivate *priv;
+
+    device = KIRAN_BIOMETRICS_DEVICE(object);
+    priv = device->priv;
+
+    g_hash_table_destroy(priv->senders);
+
+    //丢弃等待的操作, 结束正在进行的操作, 等待工作线程退出
+    while (!g_queue_is_empty(&priv->pending))
+    {
+        kiran_fprint_device_close(priv->device);
+        kiran_biometrics_job_free(g_queue_pop_head(&priv->pending));
+    }
+    if (priv->job)
+        kiran_biometrics_device_cancel_running(device);
+    g_async_queue_push(priv->jobs, kiran_biometrics_job_new(ACTION_NONE, NULL));
+    g_thread_join(priv->worker);
+    g_async_queue_unref(priv->jobs);
+
+    //未分发的完成事件会释放对应的操作
+    kiran_event_queue_free(priv->events);
+
+    if (g_dbus_interface_skeleton_get_connection(G_DBUS_INTERFACE_SKELETON(priv->skeleton)))
+        g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(priv->skeleton));
+    g_signal_handlers_disconnect_by_data(priv->skeleton, device);
+    g_object_unref(priv->skeleton);
+
+    g_object_unref(priv->device);
+    g_object_unref(priv->store);
+    g_free(priv->object_path);
+
+    G_OBJECT_CLASS(kiran_biometrics_device_parent_class)->finalize(object);
+}
+
+static void
+kiran_biometrics_device_class_init(KiranBiometricsDeviceClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->finalize = kiran_biometrics_device_finalize;
+
+    g_type_class_add_private(klass, sizeof(KiranBiometricsDevicePrivate));
+
+    signals[SIGNAL_FPRINT_VERIFY_STATUS] =
+        g_signal_new("verify-fprint-status",
+                     G_TYPE_FROM_CLASS(gobject_class),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     NULL, NULL, NULL,
+                     G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN, G_TYPE_STRING);
+
+    signals[SIGNAL_FPRINT_ENROLL_STATUS] =
+        g_signal_new("enroll-fprint-status",
+                     G_TYPE_FROM_CLASS(gobject_class),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     NULL, NULL, NULL,
+                     G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_BOOLEAN);
+
+    //只发给发起操作的连接: 发起者, 操作名, 排队位置
+    signals[SIGNAL_QUEUE_POSITION] =
+        g_signal_new("queue-position",
+                     G_TYPE_FROM_CLASS(gobject_class),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     NULL, NULL, NULL,
+                     G_TYPE_NONE, 3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
+}
+
+static void
+kiran_biometrics_device_init(KiranBiometricsDevice *self)
+{
+    KiranBiometricsDevicePrivate *priv;
+
+    priv = self->priv = KIRAN_BIOMETRICS_DEVICE_GET_PRIVATE(self);
+    priv->device = NULL;
+    priv->store = NULL;
+    priv->object_path = NULL;
+    priv->skeleton = NULL;
+    priv->job = NULL;
+    priv->status_job = NULL;
+    g_queue_init(&priv->pending);
+    priv->senders = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, kiran_biometrics_device_unwatch_sender);
+    kiran_operation_init(&priv->operation);
+    priv->events = kiran_event_queue_new(NULL,
+                                         kiran_biometrics_device_dispatch_event,
+                                         self);
+    priv->jobs = g_async_queue_new();
+    priv->worker = g_thread_new("fprint-worker",
+                                kiran_biometrics_device_worker,
+                                self);
+}
+
+//在主循环中发出录入结束的状态, job 为状态所属的操作
+static void
+kiran_biometrics_device_emit_enroll_done(KiranBiometricsDevice *device,
+                                         KiranBiometricsJob *job,
+                                         const gchar *msg)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    priv->status_job = job;
+    g_signal_emit(device,
+                  signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
+                  msg, "", 0, TRUE);
+    priv->status_job = NULL;
+}
+
+/*
+ * 被抢占的录入没有发出结束状态, 重新排队,
+ * 发起者已经停止或设备打开失败时代替工作线程发出结束状态
+ */
+static void
+kiran_biometrics_device_requeue_job(KiranBiometricsDevice *device,
+                                    KiranBiometricsJob *job)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    if (job->stopped)
+    {
+        kiran_biometrics_device_emit_enroll_done(device, job, _("Cancel fprint enroll!"));
+        return;
+    }
+
+    if (kiran_fprint_device_open(priv->device) != FPRINT_RESULT_OK)
+    {
+        dzlog_error("reopen %s for preempted %s failed",
+                    priv->object_path, kiran_biometrics_job_get_name(job));
+        kiran_biometrics_device_emit_enroll_done(device, job, _("Failed enroll finger!"));
+        return;
+    }
+
+    kiran_biometrics_device_queue_job(device, kiran_biometrics_job_copy(job), TRUE);
+}
+
+//在主循环中发出操作线程产生的状态信号
+static void
+kiran_biometrics_device_dispatch_event(KiranEvent *event,
+                                       gpointer user_data)
+{
+    KiranBiometricsDevice *device = KIRAN_BIOMETRICS_DEVICE(user_data);
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    if (event->type == EVENT_JOB_DONE)
+    {
+        KiranBiometricsJob *job = event->data;
+
+        priv->job = NULL;
+        if (job->requeue)
+            kiran_biometrics_device_requeue_job(device, job);
+        kiran_biometrics_device_schedule(device);
+        kiran_biometrics_device_release_sender(device, job->sender);
+    }
+    else
+    {
+        //状态事件在操作的完成事件之前放入队列, 分发时正在执行的操作就是产生状态的操作
+        priv->status_job = priv->job;
+        if (event->type == SIGNAL_FPRINT_ENROLL_STATUS)
+            g_signal_emit(device,
+                          signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
+                          event->msg, event->id, event->progress,
+                          event->done);
+        else
+            g_signal_emit(device,
+                          signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
+                          event->msg, event->done, event->found, event->id);
+        priv->status_job = NULL;
+    }
+}
+
+static void
+kiran_biometrics_device_post_enroll_status(KiranBiometricsDevice *device,
+                                           const gchar *msg,
+                                           const gchar *id,
+                                           gint progress,
+                                           gboolean done)
+{
+    KiranEvent *event;
+
+    event = kiran_event_new(SIGNAL_FPRINT_ENROLL_STATUS, msg, id);
+    event->progress = progress;
+    event->done = done;
+    kiran_event_queue_push(device->priv->events, event);
+}
+
+static void
+kiran_biometrics_device_post_verify_status(KiranBiometricsDevice *device,
+                                           const gchar *msg,
+                                           gboolean done,
+                                           gboolean found,
+                                           const gchar *id)
+{
+    KiranEvent *event;
+
+    event = kiran_event_new(SIGNAL_FPRINT_VERIFY_STATUS, msg, id);
+    event->done = done;
+    event->found = found;
+    kiran_event_queue_push(device->priv->events, event);
+}
+
+static void
+do_finger_enroll(KiranBiometricsDevice *device,
+                 KiranBiometricsJob *job)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    int ret = FPRINT_RESULT_FAIL;
+    int i;
+    int try_count = 0;
+    int progress = 0;
+    unsigned char *templates[3];
+    unsigned int templateLens[3];
+    unsigned char *regTemplate = NULL;
+    unsigned int length;
+    int index = 0;
+    int enroll_number = 0;
+    KiranFprintGallery *gallery;
+    gboolean over_support = FALSE;
+    gint64 start;
+
+    for (i = 0; i < 3; i++)
+    {
+        templates[i] = NULL;
+    }
+
+    //获取当前保存的指纹模板
+    start = g_get_monotonic_time();
+    gallery = kiran_fprint_store_get_gallery(priv->store);
+    kiran_stats_record(KIRAN_STATS_TEMPLATE_LOAD, start, TRUE);
+
+    if ((guint)gallery->number >= job->settings->max_templates)
+    {
+        //达到最大指纹数目
+        dzlog_error("finger enroll is on limit %u", job->settings->max_templates);
+        over_support = TRUE;
+        goto out;
+    }
+
+    for (i = 0; i < 3;)
+    {
+        char *msg = _("Please place the finger again!");
+        char pass_message[BUFFER_SIZE] = {0};
+
+        if (templates[i])
+        {
+            //重复录入时，归还模板
+            kiran_fprint_device_template_free(priv->device, templates[i]);
+            templates[i] = NULL;
+        }
+
+        if (!kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_ACQUIRING))
+        {
+            ret = FPRINT_RESULT_FAIL;
+            break;
+        }
+
+        if (i == 0)
+        {
+            msg = _("Please place the finger!");
+        }
+
+        switch (ret)
+        {
+        case FPRINT_RESULT_ENROLL_RETRY_TOO_SHORT:
+            msg = _("Your swipe was too short, please try again.");
+            break;
+
+        case FPRINT_RESULT_ENROLL_RETRY_REMOVE_FINGER:
+            msg = _("Scan failed, please remove your finger and then try again.");
+            break;
+
+        case FPRINT_RESULT_ENROLL_RETRY_CENTER_FINGER:
+            msg = _("Didn't catch that, please center your finger on the sensor and try again.");
+            break;
+
+        case FPRINT_RESULT_ENROLL_RETRY:
+            msg = _("Didn't quite catch that. Please try again.");
+            break;
+
+        case FPRINT_RESULT_ENROLL_PASS:
+            enroll_number++;
+            snprintf(pass_message, BUFFER_SIZE, _("Enroll stage passed %d. Please place the finger again!"), enroll_number);
+            msg = pass_message;
+            break;
+
+        default:
+            break;
+        }
+
+        //计算进度， 0, 25, 50, 75, 100这几个期间
+        progress = 25 * i + enroll_number * 8;
+        if (progress > 99)  //最大96, 只有保存了才能成功后才能100
+            progress = 99;
+
+        kiran_biometrics_device_post_enroll_status(device,
+                                                   msg, "", progress, FALSE);
+
+        start = g_get_monotonic_time();
+        ret = kiran_fprint_device_acquire_finger_print(priv->device,
+                                                        &templates[i],
+                                                        &length,
+                                                        job->settings->acquire_timeout);
+        kiran_stats_record(KIRAN_STATS_ACQUIRE, start, ret == FPRINT_RESULT_OK);
+
+        dzlog_debug("kiran_fprint_device_acquire_finger_print ret is %d, len %d\n", ret, length);
+
+        templateLens[i] = length;
+        if (ret == FPRINT_RESULT_OK)
+        {
+            if (i > 0)
+            {
+                if (!kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_MATCHING))
+                {
+                    kiran_fprint_device_template_free(priv->device, templates[i]);
+                    templates[i] = NULL;
+                    ret = FPRINT_RESULT_FAIL;
+                    break;
+                }
+
+                start = g_get_monotonic_time();
+                ret = kiran_fprint_device_template_match(priv->device,
+                                                          templates[0],
+                                                          templateLens[0],
+                                                          templates[i],
+                                                          templateLens[i]);
+                if (ret != FPRINT_RESULT_UNSUPPORT)
+                    kiran_stats_record(KIRAN_STATS_MATCH, start, ret == FPRINT_RESULT_OK);
+
+                dzlog_debug("kiran_fprint_device_template_match ret is %d\n", ret);
+                if (ret == FPRINT_RESULT_UNSUPPORT)  //不支持指纹比对
+                    ret = FPRINT_RESULT_OK;
+
+                if (ret != FPRINT_RESULT_OK)
+                {
+                    kiran_biometrics_device_post_enroll_status(device,
+                                                               _("Please place the same finger!"), "", progress, FALSE);
+                    i = 0;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            else
+            {
+                i++;
+            }
+        }
+        else if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //录入内部完成
+        {
+            i++;
+            break;
+        }
+
+        if (try_count >= job->settings->max_try_count)
+        {
+            ret = FPRINT_RESULT_FAIL;
+            break;
+        }
+
+        try_count++;
+    }
+
+    if ((ret == FPRINT_RESULT_OK || ret == FPRINT_RESULT_ENROLL_COMPLETE) &&
+        !kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_MATCHING))
+        ret = FPRINT_RESULT_FAIL;
+
+    if (ret == FPRINT_RESULT_OK)
+    {
+        if (templates[0] && templates[1] && templates[2])
+        {
+            start = g_get_monotonic_time();
+            ret = kiran_fprint_device_template_merge(priv->device,
+                                                      templates[0],
+                                                      templates[1],
+                                                      templates[2],
+                                                      &regTemplate,
+                                                      &length);
+            if (ret != FPRINT_RESULT_UNSUPPORT)
+                kiran_stats_record(KIRAN_STATS_MATCH, start, ret == FPRINT_RESULT_OK);
+        }
+        dzlog_debug("kiran_fprint_device_template_merge ret is %d, len is %d\n", ret, length);
+
+        //模块不支持合成时, 和内部完成录入一样使用第一枚模板
+        if (ret == FPRINT_RESULT_UNSUPPORT)
+            ret = FPRINT_RESULT_ENROLL_COMPLETE;
+    }
+
+    if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //不支持指纹合成
+    {
+        //直接使用第一枚模板, 不再复制
+        length = templateLens[0];
+        regTemplate = templates[0];
+        templates[0] = NULL;
+        dzlog_debug("fingger enroll complete with date len [%d]", length);
+    }
+
+    if (ret == FPRINT_RESULT_OK)
+    {
+        start = g_get_monotonic_time();
+        ret = kiran_fprint_device_template_match(priv->device,
+                                                  templates[0],
+                                                  templateLens[0],
+                                                  regTemplate,
+                                                  length);
+        if (ret == FPRINT_RESULT_UNSUPPORT)  //不支持两个指纹模板比对
+            ret = FPRINT_RESULT_OK;
+        else
+            kiran_stats_record(KIRAN_STATS_MATCH, start, ret == FPRINT_RESULT_OK);
+    }
+    else if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //不支持两个指纹模板比对
+    {
+        ret = FPRINT_RESULT_OK;
+    }
+
+    if (ret == FPRINT_RESULT_OK)
+    {
+        gchar *id = NULL;
+        int j = 0;
+
+        //检查该指纹是否录入过
+        //用刚合成的模板比对, 内部认证接口会重新采集指纹, 这里不能使用
+        start = g_get_monotonic_time();
+        ret = kiran_fprint_device_template_search(priv->device,
+                                                   regTemplate,
+                                                   length,
+                                                   gallery->templates,
+                                                   gallery->lens,
+                                                   gallery->number,
+                                                   gallery->serial,
+                                                   &j);
+        if (gallery->number > 0)
+            kiran_stats_record(KIRAN_STATS_SEARCH, start, ret == FPRINT_RESULT_OK);
+        if (ret == FPRINT_RESULT_OK)
+            id = g_strdup(gallery->ids[j]);
+
+        dzlog_debug("kiran_fprint_device_template_search ret is %d\n", ret);
+
+        if (ret != FPRINT_RESULT_OK)
+        {
+            //该指纹没有录入过
+            //进行指纹保存
+            if (kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_SAVING))
+            {
+                start = g_get_monotonic_time();
+                ret = kiran_fprint_store_save(priv->store,
+                                              regTemplate,
+                                              length,
+                                              job->owner,
+                                              kiran_fprint_device_get_module_path(priv->device),
+                                              &id);
+                kiran_stats_record(KIRAN_STATS_SAVE, start, ret == 0);
+            }
+            else
+            {
+                ret = FPRINT_RESULT_FAIL;
+            }
+            if (ret == 0)
+            {
+                kiran_biometrics_device_post_enroll_status(device,
+                                                           _("Successed enroll finger!"), id, 100, TRUE);
+            }
+        }
+        else
+        {
+            //指纹已经存在，直接返回该指纹
+            kiran_biometrics_device_post_enroll_status(device,
+                                                       _("Successed enroll finger!"), id, 100, TRUE);
+        }
+
+        g_free(id);
+    }
+
+out:
+    if (ret != FPRINT_RESULT_OK && job->preempted)
+    {
+        //被认证抢占, 不通知客户端结束, 认证完成后重新开始录入
+        job->requeue = TRUE;
+    }
+    else if (ret != FPRINT_RESULT_OK)
+    {
+        char *str = _("Failed enroll finger!");
+
+        if (kiran_biometrics_device_job_is_cancelled(device, job))
+        {
+            str = _("Cancel fprint enroll!");
+        }
+        else if (over_support)
+        {
+            str = _("Finger number reach on limit!");
+        }
+
+        kiran_biometrics_device_post_enroll_status(device,
+                                                   str, "", 0, TRUE);
+    }
+
+    for (index = 0; index < i; index++)
+        kiran_fprint_device_template_free(priv->device, templates[index]);
+
+    kiran_fprint_device_template_free(priv->device, regTemplate);
+
+    kiran_fprint_gallery_unref(gallery);
+
+    //完成采集
+    kiran_fprint_device_close(priv->device);
+}
+
+static void
+do_finger_verify(KiranBiometricsDevice *device,
+                 KiranBiometricsJob *job)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    KiranFprintGallery *gallery;
+    int number = 0;
+    unsigned char *template = NULL;
+    unsigned int templateLen;
+    char *md5 = NULL;
+    int i = 0;
+    int ret = 0;
+    gint64 start;
+
+    start = g_get_monotonic_time();
+    if (job->ids)
+        gallery = kiran_fprint_store_get_gallery_for_ids(priv->store,
+                                                         (const gchar *const *)job->ids);
+    else
+        gallery = kiran_fprint_store_get_gallery(priv->store);
+    kiran_stats_record(KIRAN_STATS_TEMPLATE_LOAD, start, TRUE);
+
+    if (gallery->number == 0)
+    {
+        kiran_biometrics_device_post_verify_status(device,
+                                                   _("Not Found The Id Fprint Template!"), TRUE, FALSE, "");
+
+        kiran_fprint_device_close(priv->device);
+        kiran_fprint_gallery_unref(gallery);
+
+        return;
+    }
+
+    for (i = 0; i < job->settings->max_try_count && !kiran_biometrics_device_job_is_cancelled(device, job); i++)
+    {
+        if (template)
+        {
+            //重复录入时，归还模板
+            kiran_fprint_device_template_free(priv->device, template);
+            template = NULL;
+        }
+
+        if (!kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_ACQUIRING))
+        {
+            ret = FPRINT_RESULT_FAIL;
+            break;
+        }
+
+        if (i == 0)
+        {
+            kiran_biometrics_device_post_verify_status(device,
+                                                       _("Please place the finger!"), FALSE, FALSE, "");
+        }
+
+        //首先调用指纹内部接口进行比对, 只比对部分用户的模板时不使用内部接口
+        number = gallery->number;
+        start = g_get_monotonic_time();
+        ret = kiran_fprint_device_verify_finger_print(priv->device,
+                                                       gallery->templates,
+                                                       gallery->lens,
+                                                       &number,
+                                                       gallery->serial,
+                                                       job->settings->acquire_timeout);
+        if (ret != FPRINT_RESULT_UNSUPPORT)
+            kiran_stats_record(KIRAN_STATS_IDENTIFY, start, ret == FPRINT_RESULT_OK);
+
+        dzlog_debug("kiran_fprint_verify_acquire_finger_print ret is %d\n", ret);
+        if (ret == FPRINT_RESULT_UNSUPPORT)  //指纹内部认证接口不支持， 调用其它接口认证
+        {
+            start = g_get_monotonic_time();
+            ret = kiran_fprint_device_acquire_finger_print(priv->device,
+                                                            &template,
+                                                            &templateLen,
+                                                            job->settings->acquire_timeout);
+            kiran_stats_record(KIRAN_STATS_ACQUIRE, start, ret == FPRINT_RESULT_OK);
+            dzlog_debug("kiran_fprint_device_acquire_finger_print ret is %d, len %d\n", ret, templateLen);
+
+            if (ret == FPRINT_RESULT_OK &&
+                !kiran_biometrics_device_enter_state(device, job, KIRAN_OPERATION_MATCHING))
+            {
+                ret = FPRINT_RESULT_FAIL;
+                break;
+            }
+
+            if (ret == FPRINT_RESULT_OK)
+            {
+                int j = 0;
+
+                start = g_get_monotonic_time();
+                ret = kiran_fprint_device_template_search(priv->device,
+                                                           template,
+                                                           templateLen,
+                                                           gallery->templates,
+                                                           gallery->lens,
+                                                           gallery->number,
+                                                           gallery->serial,
+                                                           &j);
+                kiran_stats_record(KIRAN_STATS_SEARCH, start, ret == FPRINT_RESULT_OK);
+                if (ret == FPRINT_RESULT_OK)
+                    md5 = g_strdup(gallery->ids[j]);
+
+                dzlog_debug("kiran_fprint_device_template_search ret is %d\n", ret);
+            }
+        }
+        else if (ret == FPRINT_RESULT_OK)
+        {
+            if (number >= 0 && number < gallery->number)
+            {
+                md5 = g_strdup(gallery->ids[number]);
+            }
+        }
+
+        if (md5 != NULL)
+        {
+            kiran_biometrics_device_post_verify_status(device,
+                                                       _("Fingerprint match!"), FALSE, TRUE, md5);
+            g_free(md5);
+            md5 = NULL;
+        }
+        else
+        {
+            char *msg = _("Fingerprint not match, place again!");
+
+            switch (ret)
+            {
+            case FPRINT_RESULT_ENROLL_RETRY_TOO_SHORT:
+                msg = _("Your swipe was too short, please try again.");
+                break;
+
+            case FPRINT_RESULT_ENROLL_RETRY_REMOVE_FINGER:
+                msg = _("Scan failed, please remove your finger and then try again.");
+                break;
+
+            case FPRINT_RESULT_ENROLL_RETRY_CENTER_FINGER:
+                msg = _("Didn't catch that, please center your finger on the sensor and try again.");
+                break;
+
+            case FPRINT_RESULT_ENROLL_RETRY:
+                msg = _("Didn't quite catch that. Please try again.");
+                break;
+
+            default:
+                break;
+            }
+
+            kiran_biometrics_device_post_verify_status(device,
+                                                       msg, FALSE, FALSE, "");
+        }
+    }
+
+    if (ret != FPRINT_RESULT_OK)
+    {
+        if (kiran_biometrics_device_job_is_cancelled(device, job))
+        {
+            kiran_biometrics_device_post_verify_status(device,
+                                                       _("Cancel fprint verify!"), TRUE, FALSE, "");
+        }
+    }
+
+    if (i == job->settings->max_try_count)
+    {
+        kiran_biometrics_device_post_verify_status(device,
+                                                   _("Fingerprint over max try count!"), TRUE, FALSE, "");
+    }
+
+    //设备关闭前归还模板
+    kiran_fprint_device_template_free(priv->device, template);
+
+    kiran_fprint_device_close(priv->device);
+
+    kiran_fprint_gallery_unref(gallery);
+}
+
+/*
+ * 设备的工作线程, 依次执行放入队列的操作, 收到 ACTION_NONE 时退出
+ * 每个操作结束后通过事件队列通知主循环
+ */
+static gpointer
+kiran_biometrics_device_worker(gpointer data)
+{
+    KiranBiometricsDevice *device = KIRAN_BIOMETRICS_DEVICE(data);
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    for (;;)
+    {
+        KiranBiometricsJob *job;
+        KiranEvent *event;
+
+        job = g_async_queue_pop(priv->jobs);
+        if (job->action == ACTION_NONE)
+        {
+            kiran_biometrics_job_free(job);
+            break;
+        }
+
+        KIRAN_TRACE2(job__start, priv->object_path, job->action);
+
+        //上一个操作的停止不影响这个操作, 这个操作开始前的取消由 enter_state 检查
+        kiran_fprint_device_reset_stop(priv->device);
+
+        //重新加载的配置从下一次操作开始生效
+        job->settings = kiran_settings_get();
+        if (job->settings->quality_threshold >= 0)
+            kiran_fprint_device_set_parameter(priv->device,
+                                              KIRAN_FPRINT_PARAM_QUALITY_THRESHOLD,
+                                              job->settings->quality_threshold);
+
+        if (job->action == FP_ACTION_ENROLL)
+            do_finger_enroll(device, job);
+        else
+            do_finger_verify(device, job);
+
+        //结果为操作是否被取消
+        KIRAN_TRACE2(job__done,
+                     kiran_biometrics_device_job_is_cancelled(device, job),
+                     priv->object_path);
+
+        kiran_operation_end(&priv->operation);
+
+        event = kiran_event_new(EVENT_JOB_DONE, NULL, NULL);
+        event->data = job;
+        event->destroy = (GDestroyNotify)kiran_biometrics_job_free;
+        kiran_event_queue_push(priv->events, event);
+    }
+
+    return NULL;
+}
+
+static void
+kiran_biometrics_device_set_open_error(int ret,
+                                       GError **error)
+{
+    const char *msg;
+
+    if (ret == FPRINT_RESULT_NO_DEVICE)
+        msg = _("Fingerprint Device Not Found");
+    else
+        msg = _("Open Fingerprint Device Fail!");
+
+    g_set_error(error, FPRINT_ERROR,
+                FPRINT_ERROR_NOT_FOUND_DEVICE, "%s", msg);
+}
+
+//通知等待的操作它们的排队位置, 位置没有变化时不通知
+static void
+kiran_biometrics_device_update_positions(KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    guint position = 1;
+    GList *l;
+
+    for (l = priv->pending.head; l != NULL; l = l->next, position++)
+    {
+        KiranBiometricsJob *job = l->data;
+
+        if (job->position == position)
+            continue;
+
+        job->position = position;
+        g_signal_emit(device,
+                      signals[SIGNAL_QUEUE_POSITION], 0,
+                      job->sender, kiran_biometrics_job_get_name(job), position);
+    }
+}
+
+/*
+ * 按优先级放入等待队列, 同优先级的操作先来先执行,
+ * resume 为 TRUE 时是被抢占后重新排队的操作, 排在同优先级操作的最前面
+ */
+static void
+kiran_biometrics_device_queue_job(KiranBiometricsDevice *device,
+                                  KiranBiometricsJob *job,
+                                  gboolean resume)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    GList *l;
+
+    for (l = priv->pending.head; l != NULL; l = l->next)
+    {
+        KiranBiometricsJob *queued = l->data;
+
+        if (queued->priority < job->priority ||
+            (resume && queued->priority == job->priority))
+            break;
+    }
+
+    if (l)
+        g_queue_insert_before(&priv->pending, l, job);
+    else
+        g_queue_push_tail(&priv->pending, job);
+}
+
+//工作线程空闲时把排在最前面的操作交给它
+static void
+kiran_biometrics_device_schedule(KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    if (priv->job == NULL && !g_queue_is_empty(&priv->pending))
+    {
+        KiranBiometricsJob *job = g_queue_pop_head(&priv->pending);
+
+        priv->job = job;
+        job->generation = kiran_operation_begin(&priv->operation);
+        if (job->position != 0)
+        {
+            job->position = 0;
+            g_signal_emit(device,
+                          signals[SIGNAL_QUEUE_POSITION], 0,
+                          job->sender, kiran_biometrics_job_get_name(job), 0);
+        }
+
+        g_async_queue_push(priv->jobs, job);
+    }
+
+    kiran_biometrics_device_update_positions(device);
+}
+
+/*
+ * 正在执行的操作是否还属于发起者: 没有被取消,
+ * 或者被抢占而取消但发起者没有停止, 操作结束后会重新排队
+ */
+static gboolean
+kiran_biometrics_device_job_is_active(KiranBiometricsDevice *device,
+                                      KiranBiometricsJob *job)
+{
+    if (!kiran_biometrics_device_job_is_cancelled(device, job))
+        return TRUE;
+
+    return job->preempted && !job->stopped;
+}
+
+//sender 在这个设备上有没有执行或等待执行的操作
+static gboolean
+kiran_biometrics_device_has_job(KiranBiometricsDevice *device,
+                                const gchar *sender)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    GList *l;
+
+    if (priv->job &&
+        kiran_biometrics_device_job_is_active(device, priv->job) &&
+        g_strcmp0(priv->job->sender, sender) == 0)
+        return TRUE;
+
+    for (l = priv->pending.head; l != NULL; l = l->next)
+    {
+        KiranBiometricsJob *job = l->data;
+
+        if (g_strcmp0(job->sender, sender) == 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+kiran_biometrics_device_unwatch_sender(gpointer data)
+{
+    g_bus_unwatch_name(GPOINTER_TO_UINT(data));
+}
+
+//sender 在这个设备上没有操作后不再监视它
+static void
+kiran_biometrics_device_release_sender(KiranBiometricsDevice *device,
+                                       const gchar *sender)
+{
+    if (sender && !kiran_biometrics_device_has_job(device, sender))
+        g_hash_table_remove(device->priv->senders, sender);
+}
+
+/*
+ * 发起者从总线上断开, 没有人再接收状态, 也没有人会停止它的操作
+ * 停止正在执行的操作, 丢弃等待的操作
+ */
+static void
+kiran_biometrics_device_sender_vanished(GDBusConnection *connection,
+                                        const gchar *name,
+                                        gpointer user_data)
+{
+    KiranBiometricsDevice *device = KIRAN_BIOMETRICS_DEVICE(user_data);
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    KiranBiometricsJob *job = priv->job;
+    GList *l;
+    GList *next;
+
+    dzlog_info("%s vanished, drop its operations on %s", name, priv->object_path);
+
+    if (job &&
+        kiran_biometrics_device_job_is_active(device, job) &&
+        g_strcmp0(job->sender, name) == 0)
+    {
+        //被抢占的操作已经取消, 只需要不再重新排队
+        if (job->preempted)
+            job->stopped = TRUE;
+        else
+            kiran_biometrics_device_cancel_running(device);
+    }
+
+    for (l = priv->pending.head; l != NULL; l = next)
+    {
+        next = l->next;
+        job = l->data;
+
+        if (g_strcmp0(job->sender, name) == 0)
+        {
+            g_queue_delete_link(&priv->pending, l);
+            kiran_fprint_device_close(priv->device);
+            kiran_biometrics_job_free(job);
+        }
+    }
+    kiran_biometrics_device_update_positions(device);
+
+    kiran_biometrics_device_release_sender(device, name);
+}
+
+//监视发起者, 它断开时停止它在这个设备上的操作
+static void
+kiran_biometrics_device_watch_sender(KiranBiometricsDevice *device,
+                                     const gchar *sender)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    GDBusConnection *connection;
+    guint watch_id;
+
+    connection = g_dbus_interface_skeleton_get_connection(G_DBUS_INTERFACE_SKELETON(priv->skeleton));
+    if (sender == NULL || connection == NULL ||
+        g_hash_table_contains(priv->senders, sender))
+        return;
+
+    watch_id = g_bus_watch_name_on_connection(connection,
+                                              sender,
+                                              G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                              NULL,
+                                              kiran_biometrics_device_sender_vanished,
+                                              device,
+                                              NULL);
+    g_hash_table_insert(priv->senders, g_strdup(sender), GUINT_TO_POINTER(watch_id));
+}
+
+/*
+ * 提交一个操作, 设备忙时排队而不是返回错误,
+ * 高优先级的操作抢占正在执行的低优先级操作, 被抢占的操作结束后重新排队
+ * 操作执行期间保持设备打开, 打开失败时返回错误
+ */
+static gboolean
+kiran_biometrics_device_submit_job(KiranBiometricsDevice *device,
+                                   KiranBiometricsJob *job,
+                                   GError **error)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    int ret;
+
+    //同一个连接同时只能有一个操作
+    if (job->sender && kiran_biometrics_device_has_job(device, job->sender))
+    {
+        g_set_error(error, FPRINT_ERROR,
+                    FPRINT_ERROR_DEVICE_BUSY, "%s", _("Fingerprint Device Busy"));
+        kiran_biometrics_job_free(job);
+        return FALSE;
+    }
+
+    ret = kiran_fprint_device_open(priv->device);
+    dzlog_debug("kiran_fprint_device_open %s ret is %d\n", priv->object_path, ret);
+    if (ret != FPRINT_RESULT_OK)
+    {
+        kiran_biometrics_device_set_open_error(ret, error);
+        kiran_biometrics_job_free(job);
+        return FALSE;
+    }
+
+    if (priv->job &&
+        !kiran_biometrics_device_job_is_cancelled(device, priv->job) &&
+        job->priority > priv->job->priority)
+    {
+        dzlog_info("%s preempt %s on %s",
+                   kiran_biometrics_job_get_name(job),
+                   kiran_biometrics_job_get_name(priv->job),
+                   priv->object_path);
+
+        priv->job->preempted = TRUE;
+        kiran_biometrics_device_cancel_running(device);
+    }
+
+    kiran_biometrics_device_watch_sender(device, job->sender);
+    kiran_biometrics_device_queue_job(device, job, FALSE);
+    kiran_biometrics_device_schedule(device);
+
+    return TRUE;
+}
+
+/*
+ * 停止 sender 发起的操作, 正在执行的操作不等待工作线程, 操作结束后发出取消的状态信号
+ * 还在排队的操作直接移除
+ */
+static gboolean
+kiran_biometrics_device_cancel_job(KiranBiometricsDevice *device,
+                                   FprintAction action,
+                                   const gchar *sender,
+                                   GError **error)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+    KiranBiometricsJob *job = priv->job;
+    GList *l;
+
+    if (job &&
+        kiran_biometrics_device_job_is_active(device, job) &&
+        job->action == action &&
+        g_strcmp0(job->sender, sender) == 0)
+    {
+        //被抢占的操作已经取消, 只需要不再重新排队, 结束时发出取消的状态
+        if (job->preempted)
+            job->stopped = TRUE;
+        else
+            kiran_biometrics_device_cancel_running(device);
+        return TRUE;
+    }
+
+    for (l = priv->pending.head; l != NULL; l = l->next)
+    {
+        job = l->data;
+
+        if (job->action == action && g_strcmp0(job->sender, sender) == 0)
+        {
+            g_queue_delete_link(&priv->pending, l);
+            kiran_fprint_device_close(priv->device);
+            kiran_biometrics_job_free(job);
+            kiran_biometrics_device_update_positions(device);
+            kiran_biometrics_device_release_sender(device, sender);
+            return TRUE;
+        }
+    }
+
+    g_set_error(error, FPRINT_ERROR,
+                FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
+
+    return FALSE;
+}
+
+/*
+ * 正在执行和等待执行的操作数目
+ */
+guint
+kiran_biometrics_device_get_load(KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    return (priv->job ? 1 : 0) + g_queue_get_length(&priv->pending);
+}
+
+/*
+ * 设备当前操作所处的阶段和操作的代数, 不加锁, 可以在任意线程中调用
+ */
+KiranOperationState
+kiran_biometrics_device_get_state(KiranBiometricsDevice *device,
+                                  guint *generation)
+{
+    return kiran_operation_get_state(&device->priv->operation, generation);
+}
+
+/*
+ * 正在发出的状态信号属于从根对象发起的操作时返回发起者, 否则返回NULL
+ * 只能在状态信号的处理函数中调用
+ */
+const gchar *
+kiran_biometrics_device_get_status_sender(KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    if (priv->status_job == NULL || !priv->status_job->via_root)
+        return NULL;
+
+    return priv->status_job->sender;
+}
+
+/*
+ * 开始指纹录入, owner 为发起录入的用户, sender 为发起录入的总线连接
+ * via_root 为 TRUE 表示从根对象发起, 状态信号也在根对象上发出
+ */
+gboolean
+kiran_biometrics_device_start_enroll(KiranBiometricsDevice *device,
+                                     guint32 owner,
+                                     const gchar *sender,
+                                     gboolean via_root,
+                                     GError **error)
+{
+    KiranBiometricsJob *job;
+
+    job = kiran_biometrics_job_new(FP_ACTION_ENROLL, sender);
+    job->owner = owner;
+    job->via_root = via_root;
+
+    return kiran_biometrics_device_submit_job(device, job, error);
+}
+
+gboolean
+kiran_biometrics_device_stop_enroll(KiranBiometricsDevice *device,
+                                    const gchar *sender,
+                                    GError **error)
+{
+    return kiran_biometrics_device_cancel_job(device, FP_ACTION_ENROLL, sender, error);
+}
+
+/*
+ * 开始指纹认证, ids 为参与比对的模板ID, NULL表示所有模板
+ */
+gboolean
+kiran_biometrics_device_start_verify(KiranBiometricsDevice *device,
+                                     const gchar *const *ids,
+                                     const gchar *sender,
+                                     gboolean via_root,
+                                     GError **error)
+{
+    KiranBiometricsJob *job;
+
+    job = kiran_biometrics_job_new(FP_ACTION_VERIFY, sender);
+    job->ids = g_strdupv((gchar **)ids);
+    job->via_root = via_root;
+
+    return kiran_biometrics_device_submit_job(device, job, error);
+}
+
+gboolean
+kiran_biometrics_device_stop_verify(KiranBiometricsDevice *device,
+                                    const gchar *sender,
+                                    GError **error)
+{
+    return kiran_biometrics_device_cancel_job(device, FP_ACTION_VERIFY, sender, error);
+}
+
+//得到调用者的用户ID后开始录入
+static void
+kiran_biometrics_device_enroll_fprint_start_with_uid(GDBusMethodInvocation *invocation,
+                                                     guint32 uid,
+                                                     gpointer user_data)
+{
+    KiranBiometricsDevice *device = KIRAN_BIOMETRICS_DEVICE(user_data);
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_device_start_enroll(device,
+                                              uid,
+                                              g_dbus_method_invocation_get_sender(invocation),
+                                              FALSE,
+                                              &error))
+        kiran_biometrics_return_error(invocation, error);
+    else
+        kiran_dbus_biometrics_fprint_device_complete_enroll_fprint_start(device->priv->skeleton, invocation);
+
+    g_object_unref(device);
+}
+
+static gboolean
+kiran_biometrics_device_enroll_fprint_start(KiranDbusBiometricsFprintDevice *skeleton,
+                                            GDBusMethodInvocation *invocation,
+                                            KiranBiometricsDevice *device)
+{
+    kiran_biometrics_get_caller_uid(invocation,
+                                    kiran_biometrics_device_enroll_fprint_start_with_uid,
+                                    g_object_ref(device));
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_enroll_fprint_stop(KiranDbusBiometricsFprintDevice *skeleton,
+                                           GDBusMethodInvocation *invocation,
+                                           KiranBiometricsDevice *device)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_device_stop_enroll(device,
+                                             g_dbus_method_invocation_get_sender(invocation),
+                                             &error))
+    {
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
+    }
+
+    kiran_dbus_biometrics_fprint_device_complete_enroll_fprint_stop(skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_verify_fprint_start(KiranDbusBiometricsFprintDevice *skeleton,
+                                            GDBusMethodInvocation *invocation,
+                                            KiranBiometricsDevice *device)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_device_start_verify(device,
+                                              NULL,
+                                              g_dbus_method_invocation_get_sender(invocation),
+                                              FALSE,
+                                              &error))
+    {
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
+    }
+
+    kiran_dbus_biometrics_fprint_device_complete_verify_fprint_start(skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_verify_fprint_start_for_ids(KiranDbusBiometricsFprintDevice *skeleton,
+                                                    GDBusMethodInvocation *invocation,
+                                                    const gchar *const *ids,
+                                                    KiranBiometricsDevice *device)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_device_start_verify(device,
+                                              ids,
+                                              g_dbus_method_invocation_get_sender(invocation),
+                                              FALSE,
+                                              &error))
+    {
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
+    }
+
+    kiran_dbus_biometrics_fprint_device_complete_verify_fprint_start_for_ids(skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_verify_fprint_stop(KiranDbusBiometricsFprintDevice *skeleton,
+                                           GDBusMethodInvocation *invocation,
+                                           KiranBiometricsDevice *device)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_device_stop_verify(device,
+                                             g_dbus_method_invocation_get_sender(invocation),
+                                             &error))
+    {
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
+    }
+
+    kiran_dbus_biometrics_fprint_device_complete_verify_fprint_stop(skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_get_module(KiranDbusBiometricsFprintDevice *skeleton,
+                                   GDBusMethodInvocation *invocation,
+                                   KiranBiometricsDevice *device)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    kiran_dbus_biometrics_fprint_device_complete_get_module(skeleton,
+                                                            invocation,
+                                                            kiran_fprint_device_get_module_path(priv->device));
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_device_get_operation_state(KiranDbusBiometricsFprintDevice *skeleton,
+                                            GDBusMethodInvocation *invocation,
+                                            KiranBiometricsDevice *device)
+{
+    KiranOperationState state;
+    guint generation;
+
+    state = kiran_biometrics_device_get_state(device, &generation);
+    kiran_dbus_biometrics_fprint_device_complete_get_operation_state(skeleton,
+                                                                     invocation,
+                                                                     kiran_operation_state_to_string(state),
+                                                                     generation);
+
+    return TRUE;
+}
+
+//状态信号在主循环中发出, 转发到总线
+static void
+kiran_biometrics_device_verify_status_cb(KiranBiometricsDevice *device,
+                                         const gchar *msg,
+                                         gboolean done,
+                                         gboolean found,
+                                         const gchar *id,
+                                         gpointer user_data)
+{
+    kiran_dbus_biometrics_fprint_device_emit_verify_fprint_status(device->priv->skeleton,
+                                                                  msg, done, found, id);
+}
+
+static void
+kiran_biometrics_device_enroll_status_cb(KiranBiometricsDevice *device,
+                                         const gchar *msg,
+                                         const gchar *id,
+                                         gint progress,
+                                         gboolean done,
+                                         gpointer user_data)
+{
+    kiran_dbus_biometrics_fprint_device_emit_enroll_fprint_status(device->priv->skeleton,
+                                                                  msg, id, progress, done);
+}
+
+//排队位置只发给发起操作的连接
+static void
+kiran_biometrics_device_queue_position_cb(KiranBiometricsDevice *device,
+                                          const gchar *sender,
+                                          const gchar *action,
+                                          guint position,
+                                          gpointer user_data)
+{
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON(device->priv->skeleton);
+    GDBusConnection *connection;
+
+    connection = g_dbus_interface_skeleton_get_connection(skeleton);
+    if (connection == NULL || sender == NULL)
+        return;
+
+    g_dbus_connection_emit_signal(connection,
+                                  sender,
+                                  device->priv->object_path,
+                                  g_dbus_interface_skeleton_get_info(skeleton)->name,
+                                  "FprintQueuePosition",
+                                  g_variant_new("(su)", action, position),
+                                  NULL);
+}
+
+/*
+ * 在总线上导出设备对象
+ */
+gboolean
+kiran_biometrics_device_export(KiranBiometricsDevice *device,
+                               GDBusConnection *connection,
+                               GError **error)
+{
+    KiranBiometricsDevicePrivate *priv = device->priv;
+
+    return g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON(priv->skeleton),
+                                            connection,
+                                            priv->object_path,
+                                            error);
+}
+
+const gchar *
+kiran_biometrics_device_get_object_path(KiranBiometricsDevice *device)
+{
+    return device->priv->object_path;
+}
+
+GDBusInterfaceSkeleton *
+kiran_biometrics_device_get_skeleton(KiranBiometricsDevice *device)
+{
+    return G_DBUS_INTERFACE_SKELETON(device->priv->skeleton);
+}
+
+KiranBiometricsDevice *
+kiran_biometrics_device_new(KiranFprintDevice *device,
+                            KiranFprintStore *store,
+                            const gchar *object_path)
+{
+    KiranBiometricsDevice *biometrics_device;
+    KiranBiometricsDevicePrivate *priv;
+
+    biometrics_device = g_object_new(KIRAN_TYPE_BIOMETRICS_DEVICE, NULL);
+    priv = biometrics_device->priv;
+
+    priv->device = g_object_ref(device);
+    priv->store = g_object_ref(store);
+    priv->object_path = g_strdup(object_path);
+
+    priv->skeleton = kiran_dbus_biometrics_fprint_device_skeleton_new();
+    g_signal_connect(priv->skeleton, "handle-enroll-fprint-start",
+                     G_CALLBACK(kiran_biometrics_device_enroll_fprint_start), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-enroll-fprint-stop",
+                     G_CALLBACK(kiran_biometrics_device_enroll_fprint_stop), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-verify-fprint-start",
+                     G_CALLBACK(kiran_biometrics_device_verify_fprint_start), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-verify-fprint-start-for-ids",
+                     G_CALLBACK(kiran_biometrics_device_verify_fprint_start_for_ids), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-verify-fprint-stop",
+                     G_CALLBACK(kiran_biometrics_device_verify_fprint_stop), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-get-module",
+                     G_CALLBACK(kiran_biometrics_device_get_module), biometrics_device);
+    g_signal_connect(priv->skeleton, "handle-get-operation-state",
+                     G_CALLBACK(kiran_biometrics_device_get_operation_state), biometrics_device);
+
+    g_signal_connect(biometrics_device, "verify-fprint-status",
+                     G_CALLBACK(kiran_biometrics_device_verify_status_cb), NULL);
+    g_signal_connect(biometrics_device, "enroll-fprint-status",
+                     G_CALLBACK(kiran_biometrics_device_enroll_status_cb), NULL);
+    g_signal_connect(biometrics_device, "queue-position",
+                     G_CALLBACK(kiran_biometrics_device_queue_position_cb), NULL);
+
+    return biometrics_device;
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_BIOMETRICS_DEVICE_H__
+#define __KIRAN_BIOMETRICS_DEVICE_H__
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "kiran-fprint-device.h"
+#include "kiran-fprint-store.h"
+#include "kiran-operation.h"
+
+#define KIRAN_TYPE_BIOMETRICS_DEVICE (kiran_biometrics_device_get_type())
+#define KIRAN_BIOMETRICS_DEVICE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                                                                 KIRAN_TYPE_BIOMETRICS_DEVICE, KiranBiometricsDevice))
+#define KIRAN_BIOMETRICS_DEVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), \
+                                                                      KIRAN_TYPE_BIOMETRICS_DEVICE, KiranBiometricsDeviceClass))
+#define KIRAN_IS_BIOMETRICS_DEVICE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                                                                    KIRAN_TYPE_BIOMETRICS_DEVICE))
+#define KIRAN_IS_BIOMETRICS_DEVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), \
+                                                                         KIRAN_TYPE_BIOMETRICS_DEVICE))
+#define KIRAN_BIOMETRICS_DEVICE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), \
+                                                                          KIRAN_TYPE_BIOMETRICS_DEVICE, KiranBiometricsDeviceClass))
+
+typedef struct _KiranBiometricsDevice KiranBiometricsDevice;
+typedef struct _KiranBiometricsDeviceClass KiranBiometricsDeviceClass;
+typedef struct _KiranBiometricsDevicePrivate KiranBiometricsDevicePrivate;
+
+/*
+ * 一个指纹设备对应的DBus对象, 每个设备有自己的录入和认证状态
+ */
+struct _KiranBiometricsDevice
+{
+    GObject parent;
+
+    KiranBiometricsDevicePrivate *priv;
+};
+
+struct _KiranBiometricsDeviceClass
+{
+    GObjectClass parent;
+};
+
+GType kiran_biometrics_device_get_type();
+KiranBiometricsDevice *kiran_biometrics_device_new(KiranFprintDevice *device,
+                                                   KiranFprintStore *store,
+                                                   const gchar *object_path);
+const gchar *kiran_biometrics_device_get_object_path(KiranBiometricsDevice *device);
+GDBusInterfaceSkeleton *kiran_biometrics_device_get_skeleton(KiranBiometricsDevice *device);
+gboolean kiran_biometrics_device_export(KiranBiometricsDevice *device,
+                                        GDBusConnection *connection,
+                                        GError **error);
+guint kiran_biometrics_device_get_load(KiranBiometricsDevice *device);
+KiranOperationState kiran_biometrics_device_get_state(KiranBiometricsDevice *device,
+                                                      guint *generation);
+const gchar *kiran_biometrics_device_get_status_sender(KiranBiometricsDevice *device);
+gboolean kiran_biometrics_device_start_enroll(KiranBiometricsDevice *device,
+                                              guint32 owner,
+                                              const gchar *sender,
+                                              gboolean via_root,
+                                              GError **error);
+gboolean kiran_biometrics_device_stop_enroll(KiranBiometricsDevice *device,
+                                             const gchar *sender,
+                                             GError **error);
+gboolean kiran_biometrics_device_start_verify(KiranBiometricsDevice *device,
+                                              const gchar *const *ids,
+                                              const gchar *sender,
+                                              gboolean via_root,
+                                              GError **error);
+gboolean kiran_biometrics_device_stop_verify(KiranBiometricsDevice *device,
+                                             const gchar *sender,
+                                             GError **error);
+
+#endif /* __KIRAN_BIOMETRICS_DEVICE_H__ */
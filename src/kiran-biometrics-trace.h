@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifndef __KIRAN_BIOMETRICS_TRACE_H__
+#define __KIRAN_BIOMETRICS_TRACE_H__
+
+/*
+ * USDT 静态探针, 提供者名为 kiran_biometrics, 可以用 SystemTap 或 bpftrace 跟踪, 例如:
+ *   bpftrace -e 'usdt:/usr/libexec/kiran_biometrics_manager:kiran_biometrics:acquire__done { @[arg1] = count(); }'
+ *
+ * 只依赖 sys/sdt.h 头文件, 探针在没有被跟踪时只是一条 nop 指令,
+ * 编译时没有 sys/sdt.h 则探针为空
+ *
+ * 探针成对出现, xxx__start 在操作开始时, xxx__done 在操作结束时, done 的第一个参数为返回值
+ */
+
+#if defined(HAVE_SYS_SDT_H) && !defined(KIRAN_DISABLE_TRACE)
+#include <sys/sdt.h>
+
+#define KIRAN_TRACE(name) DTRACE_PROBE(kiran_biometrics, name)
+#define KIRAN_TRACE1(name, a1) DTRACE_PROBE1(kiran_biometrics, name, a1)
+#define KIRAN_TRACE2(name, a1, a2) DTRACE_PROBE2(kiran_biometrics, name, a1, a2)
+#define KIRAN_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(kiran_biometrics, name, a1, a2, a3)
+#else
+#define KIRAN_TRACE(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define KIRAN_TRACE1(name, a1) KIRAN_TRACE(name)
+#define KIRAN_TRACE2(name, a1, a2) KIRAN_TRACE(name)
+#define KIRAN_TRACE3(name, a1, a2, a3) KIRAN_TRACE(name)
+#endif
+
+#endif /* __KIRAN_BIOMETRICS_TRACE_H__ */
@@ -17,6 +17,7 @@
 
 #define FPRINT_DIR "/etc/kiran-fprint"
 #define FACE_DIR "/etc/kiran-faces"
+#define BIOMETRICS_CACHE_FILE "/var/cache/kiran-biometrics/cache"
 
 typedef enum
 {
@@ -55,6 +56,29 @@ typedef enum
     FPRINT_RESULT_ENROLL_COMPLETE = 10,
 } FprintResult;
 
+/* 与 kiran-fprint-module.h 中的指纹模块能力描述保持一致 */
+#define KIRAN_FPRINT_CAPABILITIES_VERSION 1
+
+typedef enum
+{
+    KIRAN_FPRINT_CAP_IDENTIFY = 1 << 0,        //支持 kiran_fprint_verify_finger_print
+    KIRAN_FPRINT_CAP_MERGE = 1 << 1,           //支持 kiran_fprint_template_merge
+    KIRAN_FPRINT_CAP_BATCH_MATCH = 1 << 2,     //支持 kiran_fprint_template_match_batch
+    KIRAN_FPRINT_CAP_REENTRANT_MATCH = 1 << 3, //kiran_fprint_template_match 可重入
+} KiranFprintCapFlags;
+
+typedef struct
+{
+    unsigned int version;
+    unsigned int flags;
+    unsigned int template_format;
+    unsigned int max_template_size;
+} KiranFprintCapabilities;
+
+/* kiran_fprint_set_parameter 的参数名, 与 kiran-fprint-module.h 保持一致 */
+#define KIRAN_FPRINT_PARAM_QUALITY_THRESHOLD "quality-threshold"
+#define KIRAN_FPRINT_PARAM_GALLERY_SERIAL "gallery-serial"
+
 typedef enum
 {
     FACE_RESULT_OK = 0,                //成功
@@ -12,8 +12,6 @@
  * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
  */
 
-#include <dbus/dbus-glib-bindings.h>
-#include <dbus/dbus-glib-lowlevel.h>
 #include <gio/gio.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
@@ -28,23 +26,20 @@
 #endif
 
 #include "kiran-biometrics-types.h"
+#include "kiran-biometrics-device.h"
+#include "kiran-biometrics-gen.h"
 #include "kiran-biometrics.h"
+#include "kiran-event-queue.h"
 #include "kiran-fprint-manager.h"
+#include "kiran-fprint-store.h"
+#include "kiran-operation.h"
+#include "kiran-settings.h"
+#include "kiran-stats.h"
 
 #ifdef HAVE_KIRAN_FACE
 #include "kiran-face-manager.h"
 #endif /* HAVE_KIRAN_FACE */
 
-#ifndef MAX_TRY_COUNT
-#define MAX_TRY_COUNT 50 /* 最大尝试次数 */
-#endif
-
-#define DEFAULT_TIME_OUT 600000 /* 一次等待指纹时间，单位毫秒*/
-#define BUFFER_SIZE 1024
-
-#define SUPPORT_FINGER_NUMBER 10000 /* 最大指纹模板数目 */
-
-GQuark fprint_error_quark(void);
 GType fprint_error_get_type(void);
 
 #ifdef HAVE_KIRAN_FACE
@@ -55,11 +50,11 @@ GType face_error_get_type(void);
 #define FPRINT_TYPE_ERROR fprint_error_get_type()
 #define FPRINT_ERROR_DBUS_INTERFACE "com.kylinsec.Kiran.SystemDaemon.Biometrics.Error"
 
-#define FPRINT_ERROR fprint_error_quark()
+//两次枚举指纹设备的最小间隔, 秒, 枚举时需要初始化和释放每个指纹模块
+#define FPRINT_RESCAN_INTERVAL 10
 
 #ifdef HAVE_KIRAN_FACE
 #define FACE_TYPE_ERROR face_error_get_type()
-#define FACE_ERROR_DBUS_INTERFACE "com.kylinsec.Kiran.SystemDaemon.Biometrics.Error"
 
 #define FACE_ERROR face_error_quark()
 #endif /* HAVE_KIRAN_FACE */
@@ -76,61 +71,37 @@ typedef enum
 struct _KiranBiometricsPrivate
 {
     KiranFprintManager *kfpmanager;
-    gboolean fprint_busy;
-    FprintAction fp_action;
-
-    GThread *fprint_enroll_thread;
-    GThread *fprint_verify_thread;
+    KiranFprintStore *store;              /* 已保存的指纹模板 */
+    KiranDbusBiometrics *skeleton;        /* 导出到总线的根对象接口 */
+    GDBusConnection *connection;          /* 设备对象注册到这个连接 */
+    gchar *object_path;                   /* 根对象路径, 设备对象在它下面 */
+    GList *devices;                       /* 每个指纹设备对应的DBus对象 */
+    gint64 rescan_time;                   /* 上一次枚举设备的时间, 0表示还没有枚举过 */
+    guint rescan_id;                      /* 等待在空闲时执行的设备枚举 */
+    GHashTable *clients;                  /* 调用过方法且还连接在总线上的客户端, 唯一名 -> 名字监视 */
+    gint64 last_active;                   /* 最后一次方法调用, 操作结束或客户端断开的时间 */
 
 #ifdef HAVE_KIRAN_FACE
-    KiranFaceManager *kfamanager;
-    FprintAction face_action;
-    gboolean face_busy;
-
-    GThread *face_capture_thread;
+    KiranFaceManager *kfamanager; /* 第一次使用人脸时创建, 空闲 face_idle_timeout 秒后释放 */
+    guint face_idle_timeout;
+    guint face_idle_id;
+    KiranEventQueue *face_events; /* 人脸线程产生的状态事件 */
+    KiranOperation face_operation; /* 人脸采集的状态, 采集线程中会读取 */
+    FprintAction face_action;      /* 正在进行的人脸操作, 只在主循环中访问 */
+    guint face_generation;         /* 正在进行的人脸操作的代数 */
+
+    GAsyncQueue *face_jobs;  /* 等待采集的人脸操作 */
+    GThread *face_worker;    /* 人脸采集线程, 和人脸模块一起创建和释放 */
 #endif /* HAVE_KIRAN_FACE */
 };
 
-static void kiran_biometrics_enroll_fprint_start(KiranBiometrics *kirBiometrics,
-                                                 DBusGMethodInvocation *context);
-static void kiran_biometrics_enroll_fprint_stop(KiranBiometrics *kirBiometrics,
-                                                DBusGMethodInvocation *context);
-static void kiran_biometrics_verify_fprint_start(KiranBiometrics *kirBiometrics,
-                                                 DBusGMethodInvocation *context);
-static void kiran_biometrics_verify_fprint_stop(KiranBiometrics *kirBiometrics,
-                                                DBusGMethodInvocation *context);
-static void kiran_biometrics_delete_enrolled_finger(KiranBiometrics *kirBiometrics,
-                                                    const char *id,
-                                                    DBusGMethodInvocation *context);
-static void kiran_biometrics_enroll_face_start(KiranBiometrics *kirBiometrics,
-                                               DBusGMethodInvocation *context);
-static void kiran_biometrics_enroll_face_stop(KiranBiometrics *kirBiometrics,
-                                              DBusGMethodInvocation *context);
-static void kiran_biometrics_verify_face_start(KiranBiometrics *kirBiometrics,
-                                               const char *id,
-                                               DBusGMethodInvocation *context);
-static void kiran_biometrics_verify_face_stop(KiranBiometrics *kirBiometrics,
-                                              DBusGMethodInvocation *context);
-static void kiran_biometrics_delete_enrolled_face(KiranBiometrics *kirBiometrics,
-                                                  const char *id,
-                                                  DBusGMethodInvocation *context);
-#include "kiran-biometrics-stub.h"
 
 #define KIRAN_BIOMETRICS_GET_PRIVATE(O) \
     (G_TYPE_INSTANCE_GET_PRIVATE((O), KIRAN_TYPE_BIOMETRICS, KiranBiometricsPrivate))
 
-enum kiran_biometrics_signals
-{
-    SIGNAL_FPRINT_VERIFY_STATUS,
-    SIGNAL_FPRINT_ENROLL_STATUS,
-    SIGNAL_FACE_VERIFY_STATUS,
-    SIGNAL_FACE_ENROLL_STATUS,
-    NUM_SIGNAL,
-};
-
-static guint signals[NUM_SIGNAL] = {
-    0,
-};
+#ifdef HAVE_KIRAN_FACE
+static void face_manager_release(KiranBiometrics *kirBiometrics);
+#endif /* HAVE_KIRAN_FACE */
 
 G_DEFINE_TYPE(KiranBiometrics, kiran_biometrics, G_TYPE_OBJECT);
 
@@ -143,9 +114,27 @@ kiran_biometrics_finalize(GObject *object)
     kiranBiometrics = KIRAN_BIOMETRICS(object);
     priv = kiranBiometrics->priv;
 
+    if (priv->rescan_id)
+        g_source_remove(priv->rescan_id);
+    g_hash_table_destroy(priv->clients);
+    g_list_free_full(priv->devices, g_object_unref);
     g_object_unref(priv->kfpmanager);
+    g_object_unref(priv->store);
+    if (priv->connection)
+    {
+        g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON(priv->skeleton));
+        g_object_unref(priv->connection);
+    }
+    g_signal_handlers_disconnect_by_data(priv->skeleton, kiranBiometrics);
+    g_object_unref(priv->skeleton);
+    g_free(priv->object_path);
 #ifdef HAVE_KIRAN_FACE
-    g_object_unref(priv->kfamanager);
+    kiran_operation_cancel(&priv->face_operation, priv->face_generation);
+    if (priv->face_idle_id)
+        g_source_remove(priv->face_idle_id);
+    face_manager_release(kiranBiometrics);
+    g_async_queue_unref(priv->face_jobs);
+    kiran_event_queue_free(priv->face_events);
 #endif /* HAVE_KIRAN_FACE */
 
     G_OBJECT_CLASS(kiran_biometrics_parent_class)->finalize(object);
@@ -155,59 +144,184 @@ static void
 kiran_biometrics_class_init(KiranBiometricsClass *klass)
 {
     GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
-    GParamSpec *pspec;
 
     gobject_class->finalize = kiran_biometrics_finalize;
 
-    dbus_g_object_type_install_info(KIRAN_TYPE_BIOMETRICS,
-                                    &dbus_glib_SystemDaemon_object_info);
-
     g_type_class_add_private(klass, sizeof(KiranBiometricsPrivate));
-#ifdef HAVE_KIRAN_FACE
-    dbus_g_error_domain_register(FPRINT_ERROR, FPRINT_ERROR_DBUS_INTERFACE, FPRINT_TYPE_ERROR);
-    dbus_g_error_domain_register(FACE_ERROR, FACE_ERROR_DBUS_INTERFACE, FACE_TYPE_ERROR);
-#endif /* HAVE_KIRAN_FACE */
+}
+
+static void
+kiran_biometrics_unwatch_client(gpointer data)
+{
+    g_bus_unwatch_name(GPOINTER_TO_UINT(data));
+}
+
+static void
+kiran_biometrics_client_vanished(GDBusConnection *connection,
+                                 const gchar *name,
+                                 gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    dzlog_debug("client %s vanished", name);
+
+    priv->last_active = g_get_monotonic_time();
+    g_hash_table_remove(priv->clients, name);
+}
+
+/*
+ * 记录一次活动, sender 不为空时开始跟踪这个客户端, 直到它从总线上断开
+ * 空闲退出从最后一次活动开始计时
+ */
+static void
+kiran_biometrics_touch(KiranBiometrics *kirBiometrics,
+                       const gchar *sender)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    guint watch_id;
+
+    priv->last_active = g_get_monotonic_time();
+
+    if (sender == NULL || priv->connection == NULL ||
+        g_hash_table_contains(priv->clients, sender))
+        return;
+
+    watch_id = g_bus_watch_name_on_connection(priv->connection,
+                                              sender,
+                                              G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                              NULL,
+                                              kiran_biometrics_client_vanished,
+                                              kirBiometrics,
+                                              NULL);
+    g_hash_table_insert(priv->clients, g_strdup(sender), GUINT_TO_POINTER(watch_id));
+}
+
+//根对象和设备对象上的每个方法调用都经过这里, 只用来记录活动, 总是允许调用
+static gboolean
+kiran_biometrics_authorize_method(GDBusInterfaceSkeleton *interface,
+                                  GDBusMethodInvocation *invocation,
+                                  KiranBiometrics *kirBiometrics)
+{
+    kiran_biometrics_touch(kirBiometrics,
+                           g_dbus_method_invocation_get_sender(invocation));
 
-    signals[SIGNAL_FPRINT_VERIFY_STATUS] =
-        g_signal_new("verify-fprint-status",
-                     G_TYPE_FROM_CLASS(gobject_class),
-                     G_SIGNAL_RUN_LAST,
-                     0,
-                     NULL, NULL, NULL,
-                     G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN, G_TYPE_STRING);
-
-    signals[SIGNAL_FPRINT_ENROLL_STATUS] =
-        g_signal_new("enroll-fprint-status",
-                     G_TYPE_FROM_CLASS(gobject_class),
-                     G_SIGNAL_RUN_LAST,
-                     0,
-                     NULL, NULL, NULL,
-                     G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_BOOLEAN);
-
-    signals[SIGNAL_FACE_VERIFY_STATUS] =
-        g_signal_new("verify-face-status",
-                     G_TYPE_FROM_CLASS(gobject_class),
-                     G_SIGNAL_RUN_LAST,
-                     0,
-                     NULL, NULL, NULL,
-                     G_TYPE_NONE, 3, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN);
-
-    signals[SIGNAL_FACE_ENROLL_STATUS] =
-        g_signal_new("enroll-face-status",
-                     G_TYPE_FROM_CLASS(gobject_class),
-                     G_SIGNAL_RUN_LAST,
-                     0,
-                     NULL, NULL, NULL,
-                     G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_BOOLEAN);
+    return TRUE;
 }
 
 #ifdef HAVE_KIRAN_FACE
+enum
+{
+    FACE_EVENT_ENROLL_STATUS,
+    FACE_EVENT_VERIFY_STATUS,
+    FACE_EVENT_CAPTURE_DONE,
+};
+
+//通知人脸采集线程退出
+#define FACE_JOB_QUIT GINT_TO_POINTER(-1)
+
+static gpointer do_face_capture(gpointer data);
+static void face_enroll_status_cb(KiranBiometrics *kirBiometrics,
+                                  gint quality,
+                                  gchar *id,
+                                  gint progress,
+                                  gpointer user_data);
+static void face_verify_status_cb(KiranBiometrics *kirBiometrics,
+                                  gboolean match,
+                                  gpointer user_data);
+
+/*
+ * 获取人脸模块, 第一次使用时创建
+ * 人脸模块会加载分类器, 启动检测线程和建立ZMQ连接, 只使用指纹的机器上不需要这些
+ */
+static KiranFaceManager *
+face_manager_acquire(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    if (priv->face_idle_id)
+    {
+        g_source_remove(priv->face_idle_id);
+        priv->face_idle_id = 0;
+    }
+
+    if (priv->kfamanager == NULL)
+    {
+        dzlog_debug("create face manager");
+
+        priv->kfamanager = kiran_face_manager_new();
+        g_signal_connect_swapped(priv->kfamanager,
+                                 "enroll-face-status",
+                                 G_CALLBACK(face_enroll_status_cb),
+                                 kirBiometrics);
+
+        g_signal_connect_swapped(priv->kfamanager,
+                                 "verify-face-status",
+                                 G_CALLBACK(face_verify_status_cb),
+                                 kirBiometrics);
+
+        priv->face_worker = g_thread_new("face-worker", do_face_capture, kirBiometrics);
+    }
+
+    return priv->kfamanager;
+}
+
+//释放人脸模块和采集线程, 只在没有人脸操作时调用
 static void
-face_enroll_status_cb(KiranBiometrics *kirBiometrics,
-                      gint quality,
-                      gchar *id,
-                      gint progress,
-                      gpointer user_data)
+face_manager_release(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    if (priv->kfamanager == NULL)
+        return;
+
+    dzlog_debug("release face manager");
+
+    g_async_queue_push(priv->face_jobs, FACE_JOB_QUIT);
+    g_thread_join(priv->face_worker);
+    priv->face_worker = NULL;
+
+    g_signal_handlers_disconnect_by_data(priv->kfamanager, kirBiometrics);
+    g_object_unref(priv->kfamanager);
+    priv->kfamanager = NULL;
+}
+
+static gboolean
+face_manager_idle_release(gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    priv->face_idle_id = 0;
+    if (kiran_operation_get_state(&priv->face_operation, NULL) == KIRAN_OPERATION_IDLE)
+        face_manager_release(kirBiometrics);
+
+    return G_SOURCE_REMOVE;
+}
+
+//人脸操作结束后开始计时, 空闲 face_idle_timeout 秒后释放人脸模块, 0表示立即释放
+static void
+face_manager_schedule_release(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    if (priv->kfamanager == NULL || priv->face_idle_id != 0 ||
+        kiran_operation_get_state(&priv->face_operation, NULL) != KIRAN_OPERATION_IDLE)
+        return;
+
+    if (priv->face_idle_timeout == 0)
+        face_manager_release(kirBiometrics);
+    else
+        priv->face_idle_id = g_timeout_add_seconds(priv->face_idle_timeout,
+                                                   face_manager_idle_release,
+                                                   kirBiometrics);
+}
+
+static void
+face_enroll_status(KiranBiometrics *kirBiometrics,
+                   gint quality,
+                   const gchar *id,
+                   gint progress)
 {
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
 
@@ -216,21 +330,12 @@ face_enroll_status_cb(KiranBiometrics *kirBiometrics,
 
     if (progress == 100 && id)  //采集完成
     {
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FACE_ENROLL_STATUS], 0,
-                      _("Successed enroll face!"), id, progress,
-                      TRUE);
-
-        //关闭采集
-        priv->face_action = ACTION_NONE;
+        kiran_dbus_biometrics_emit_enroll_face_status(priv->skeleton,
+                                                      _("Successed enroll face!"), id, progress,
+                                                      TRUE);
 
-        if (priv->face_capture_thread)
-        {
-            g_thread_join(priv->face_capture_thread);
-            priv->face_capture_thread = NULL;
-        }
-
-        priv->face_busy = FALSE;
+        //关闭采集, 采集线程结束后回到空闲状态
+        kiran_operation_cancel(&priv->face_operation, priv->face_generation);
     }
     else
     {
@@ -245,17 +350,15 @@ face_enroll_status_cb(KiranBiometrics *kirBiometrics,
             msg = _("Please get closer to the camera!");
         }
 
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FACE_ENROLL_STATUS], 0,
-                      msg, "", progress,
-                      FALSE);
+        kiran_dbus_biometrics_emit_enroll_face_status(priv->skeleton,
+                                                      msg, "", progress,
+                                                      FALSE);
     }
 }
 
 static void
-face_verify_status_cb(KiranBiometrics *kirBiometrics,
-                      gboolean match,
-                      gpointer user_data)
+face_verify_status(KiranBiometrics *kirBiometrics,
+                   gboolean match)
 {
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
 
@@ -263,1013 +366,1070 @@ face_verify_status_cb(KiranBiometrics *kirBiometrics,
 
     if (match)  //人脸验证匹配
     {
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FACE_VERIFY_STATUS], 0,
-                      _("Face match!"), TRUE, TRUE);
+        kiran_dbus_biometrics_emit_verify_face_status(priv->skeleton,
+                                                      _("Face match!"), TRUE, TRUE);
 
-        //关闭采集
-        priv->face_action = ACTION_NONE;
+        //关闭采集, 采集线程结束后回到空闲状态
+        kiran_operation_cancel(&priv->face_operation, priv->face_generation);
+    }
+    else
+    {
+        kiran_dbus_biometrics_emit_verify_face_status(priv->skeleton,
+                                                      _("Face not match! Please look the camera!"), FALSE, FALSE);
+    }
+}
 
-        if (priv->face_capture_thread)
-        {
-            g_thread_join(priv->face_capture_thread);
-            priv->face_capture_thread = NULL;
-        }
+static void
+face_dispatch_event(KiranEvent *event,
+                    gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+
+    kiran_biometrics_touch(kirBiometrics, NULL);
 
-        priv->face_busy = FALSE;
+    if (event->type == FACE_EVENT_ENROLL_STATUS)
+    {
+        face_enroll_status(kirBiometrics, event->quality, event->id, event->progress);
+    }
+    else if (event->type == FACE_EVENT_VERIFY_STATUS)
+    {
+        face_verify_status(kirBiometrics, event->found);
     }
     else
     {
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FACE_VERIFY_STATUS], 0,
-                      _("Face not match! Please look the camera!"), FALSE, FALSE);
+        face_manager_schedule_release(kirBiometrics);
     }
 }
-#endif /* HAVE_KIRAN_FACE */
 
+//人脸信号在人脸处理线程中发出, 放入队列后在主循环中处理
 static void
-kiran_biometrics_init(KiranBiometrics *self)
+face_enroll_status_cb(KiranBiometrics *kirBiometrics,
+                      gint quality,
+                      gchar *id,
+                      gint progress,
+                      gpointer user_data)
 {
-    KiranBiometricsPrivate *priv;
+    KiranEvent *event;
 
-    priv = self->priv = KIRAN_BIOMETRICS_GET_PRIVATE(self);
-    priv->fprint_busy = FALSE;
-    priv->kfpmanager = kiran_fprint_manager_new();
-    priv->fp_action = ACTION_NONE;
-    priv->fprint_enroll_thread = NULL;
-    priv->fprint_verify_thread = NULL;
+    event = kiran_event_new(FACE_EVENT_ENROLL_STATUS, NULL, id);
+    event->quality = quality;
+    event->progress = progress;
+    kiran_event_queue_push(kirBiometrics->priv->face_events, event);
+}
 
-#ifdef HAVE_KIRAN_FACE
-    priv->face_busy = FALSE;
-    priv->kfamanager = kiran_face_manager_new();
-    priv->face_action = ACTION_NONE;
-    priv->face_capture_thread = NULL;
-    g_signal_connect_swapped(priv->kfamanager,
-                             "enroll-face-status",
-                             G_CALLBACK(face_enroll_status_cb),
-                             self);
-
-    g_signal_connect_swapped(priv->kfamanager,
-                             "verify-face-status",
-                             G_CALLBACK(face_verify_status_cb),
-                             self);
-#endif /* HAVE_KIRAN_FACE */
+static void
+face_verify_status_cb(KiranBiometrics *kirBiometrics,
+                      gboolean match,
+                      gpointer user_data)
+{
+    KiranEvent *event;
+
+    event = kiran_event_new(FACE_EVENT_VERIFY_STATUS, NULL, NULL);
+    event->found = match;
+    kiran_event_queue_push(kirBiometrics->priv->face_events, event);
 }
-static int
-kiran_biometrics_remove_fprint(const gchar *md5)
+#endif /* HAVE_KIRAN_FACE */
+
+//在根对象上只向发起操作的连接发出信号, 不同会话之间互不干扰
+static void
+kiran_biometrics_emit_to_sender(KiranBiometrics *kirBiometrics,
+                                const gchar *sender,
+                                const gchar *signal_name,
+                                GVariant *parameters)
 {
-    gchar *path;
-    int ret;
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON(priv->skeleton);
 
-    path = g_strdup_printf("%s/%s.bat", FPRINT_DIR, md5);
-    if (!g_file_test(path, G_FILE_TEST_EXISTS))
+    if (priv->connection == NULL || sender == NULL)
     {
-        g_free(path);
-        return -1;
+        g_variant_unref(g_variant_ref_sink(parameters));
+        return;
     }
 
-    ret = g_remove(path);
-    g_free(path);
+    g_dbus_connection_emit_signal(priv->connection,
+                                  sender,
+                                  priv->object_path,
+                                  g_dbus_interface_skeleton_get_info(skeleton)->name,
+                                  signal_name,
+                                  parameters,
+                                  NULL);
+}
+
+//只转发根对象上发起的操作
+static void
+fprint_device_verify_status_cb(KiranBiometricsDevice *device,
+                               const gchar *msg,
+                               gboolean done,
+                               gboolean found,
+                               const gchar *id,
+                               KiranBiometrics *kirBiometrics)
+{
+    const gchar *sender = kiran_biometrics_device_get_status_sender(device);
 
-    return ret;
+    kiran_biometrics_touch(kirBiometrics, NULL);
+
+    if (sender == NULL)
+        return;
+
+    kiran_biometrics_emit_to_sender(kirBiometrics, sender, "VerifyFprintStatus",
+                                    g_variant_new("(sbbs)", msg, done, found, id ? id : ""));
 }
 
-static int
-kiran_biometrics_get_save_fprint(unsigned char **template,
-                                 unsigned int *length,
-                                 char *path)
+static void
+fprint_device_enroll_status_cb(KiranBiometricsDevice *device,
+                               const gchar *msg,
+                               const gchar *id,
+                               gint progress,
+                               gboolean done,
+                               KiranBiometrics *kirBiometrics)
 {
-    GError *error = NULL;
-    gint ret = 0;
-    gsize read_size;
-    gboolean result;
+    const gchar *sender = kiran_biometrics_device_get_status_sender(device);
 
-    result = g_file_get_contents(path,
-                                 (gchar **)template,
-                                 (gsize *)length,
-                                 &error);
+    kiran_biometrics_touch(kirBiometrics, NULL);
 
-    if (!result)
-    {
-        dzlog_debug("get file %s failed: %s", path, error->message);
-        g_error_free(error);
-        ret = -1;
-    }
+    if (sender == NULL)
+        return;
 
-    return ret;
+    kiran_biometrics_emit_to_sender(kirBiometrics, sender, "EnrollFprintStatus",
+                                    g_variant_new("(ssib)", msg, id ? id : "", progress, done));
 }
 
-static int
-kiran_biometrics_get_save_fprints(unsigned char **saveTemplates,
-                                  unsigned int *saveTemplateLens,
-                                  int *save_number)
+//设备上的排队位置也在根对象上发给发起操作的连接
+static void
+fprint_device_queue_position_cb(KiranBiometricsDevice *device,
+                                const gchar *sender,
+                                const gchar *action,
+                                guint position,
+                                KiranBiometrics *kirBiometrics)
 {
-    GError *error = NULL;
-    GDir *dir = NULL;
-    gint ret = 0;
-    const char *name;
+    kiran_biometrics_emit_to_sender(kirBiometrics, sender, "FprintQueuePosition",
+                                    g_variant_new("(su)", action, position));
+}
 
-    *save_number = 0;
-    dir = g_dir_open(FPRINT_DIR,
-                     0,
-                     &error);
+/*
+ * 重新枚举指纹设备, 为新发现的设备创建DBus对象
+ */
+void
+kiran_biometrics_update_devices(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    GList *found;
+    GList *l;
 
-    if (dir == NULL)
-    {
-        dzlog_debug("open dir %s failed: %s", FPRINT_DIR, error->message);
-        g_error_free(error);
-        return -1;
-    }
+    priv->rescan_time = g_get_monotonic_time();
+    found = kiran_fprint_manager_rescan(priv->kfpmanager);
 
-    while ((name = g_dir_read_name(dir)))
+    for (l = found; l != NULL; l = l->next)
     {
-        if (*save_number == SUPPORT_FINGER_NUMBER)
+        KiranBiometricsDevice *device;
+        gchar *path;
+
+        path = g_strdup_printf("%s/Devices/%u",
+                               priv->object_path ? priv->object_path : "",
+                               g_list_length(priv->devices));
+        device = kiran_biometrics_device_new(l->data, priv->store, path);
+
+        g_signal_connect(device,
+                         "verify-fprint-status",
+                         G_CALLBACK(fprint_device_verify_status_cb),
+                         kirBiometrics);
+        g_signal_connect(device,
+                         "enroll-fprint-status",
+                         G_CALLBACK(fprint_device_enroll_status_cb),
+                         kirBiometrics);
+        g_signal_connect(device,
+                         "queue-position",
+                         G_CALLBACK(fprint_device_queue_position_cb),
+                         kirBiometrics);
+        g_signal_connect(kiran_biometrics_device_get_skeleton(device),
+                         "g-authorize-method",
+                         G_CALLBACK(kiran_biometrics_authorize_method),
+                         kirBiometrics);
+
+        if (priv->connection)
         {
-            dzlog_debug("read save fprint reach %d:", SUPPORT_FINGER_NUMBER);
-            break;
+            g_autoptr(GError) error = NULL;
+
+            if (!kiran_biometrics_device_export(device, priv->connection, &error))
+                dzlog_error("export fprint device %s failed: %s", path, error->message);
         }
 
-        if (g_str_has_suffix(name, ".bat"))
-        {
-            unsigned char *saveTemplate = NULL;
-            unsigned int saveTemplateLen = 0;
-            int ret = 0;
-            gchar *path;
+        priv->devices = g_list_append(priv->devices, device);
+        dzlog_info("export fprint device %s", path);
+        g_free(path);
+    }
 
-            path = g_strdup_printf("%s/%s", FPRINT_DIR, name);
-            ret = kiran_biometrics_get_save_fprint(&saveTemplate, &saveTemplateLen, path);
+    g_list_free(found);
+}
 
-            if (ret == 0)
-            {
-                saveTemplates[*save_number] = saveTemplate;
-                saveTemplateLens[*save_number] = saveTemplateLen;
-                *save_number = *save_number + 1;
-            }
+//读取上次退出时保存的状态, 只枚举上次发现设备的模块
+static void
+kiran_biometrics_load_cache(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    GKeyFile *keyfile;
+    gchar **modules;
 
-            g_free(path);
-        }
+    keyfile = g_key_file_new();
+    if (g_key_file_load_from_file(keyfile, BIOMETRICS_CACHE_FILE, G_KEY_FILE_NONE, NULL))
+    {
+        modules = g_key_file_get_string_list(keyfile, "Fprint", "Modules", NULL, NULL);
+        kiran_fprint_manager_set_preferred_modules(priv->kfpmanager,
+                                                   (const gchar *const *)modules);
+        g_strfreev(modules);
     }
 
-    g_dir_close(dir);
-
-    if (*save_number == 0)
-        return -1;
-
-    return ret;
+    g_key_file_free(keyfile);
 }
 
-static int
-kiran_biometrics_save_fprint(unsigned char *template,
-                             unsigned int length,
-                             gchar **md5)
-{
-    GFile *file;
-    GFileIOStream *stream;
-    GOutputStream *output_stream;
-    GError *error = NULL;
-    gint ret = 0;
+/*
+ * 保存启动时需要恢复的状态, 守护进程空闲退出后被总线激活时使用
+ * 指纹模板已经以索引文件的形式保存在 FPRINT_DIR 中, 这里只保存发现设备的模块
+ */
+void
+kiran_biometrics_save_cache(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    g_autoptr(GError) error = NULL;
+    GKeyFile *keyfile;
+    gchar **modules;
+    gchar *data;
     gchar *dir;
-    gchar *path;
+    gsize length;
 
-    *md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5,
-                                         template,
-                                         length);
+    modules = kiran_fprint_manager_get_device_modules(priv->kfpmanager);
+    keyfile = g_key_file_new();
+    g_key_file_set_string_list(keyfile, "Fprint", "Modules",
+                               (const gchar *const *)modules, g_strv_length(modules));
+    data = g_key_file_to_data(keyfile, &length, NULL);
 
-    dir = g_strdup_printf(FPRINT_DIR);
-    if (!g_file_test(dir, G_FILE_TEST_IS_DIR))
-    {
-        g_mkdir(dir, S_IRWXU);
-    }
+    dir = g_path_get_dirname(BIOMETRICS_CACHE_FILE);
+    g_mkdir_with_parents(dir, 0755);
+    if (!g_file_set_contents(BIOMETRICS_CACHE_FILE, data, length, &error))
+        dzlog_warn("save cache failed: %s", error->message);
 
-    path = g_strdup_printf("%s/%s.bat", dir, *md5);
+    g_free(dir);
+    g_free(data);
+    g_key_file_free(keyfile);
+    g_strfreev(modules);
+}
+
+/*
+ * 没有正在进行或排队的指纹和人脸操作
+ * 不考虑还连接着的客户端, 见 kiran_biometrics_has_clients
+ */
+gboolean
+kiran_biometrics_is_idle(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    GList *l;
 
-    file = g_file_new_for_path(path);
-    stream = g_file_create_readwrite(file,
-                                     G_FILE_CREATE_PRIVATE,
-                                     NULL,
-                                     &error);
-    if (error)
+    for (l = priv->devices; l != NULL; l = l->next)
     {
-        ret = -1;
-        g_warning("create fingerprint file io stream fail: %s", error->message);
-        g_error_free(error);
+        if (kiran_biometrics_device_get_load(l->data) != 0)
+            return FALSE;
     }
-    else
-    {
-        output_stream = g_io_stream_get_output_stream(G_IO_STREAM(stream));
-        error = NULL;
-        g_output_stream_write(output_stream,
-                              template,
-                              length,
-                              NULL,
-                              &error);
-        if (error)
-        {
-            ret = -1;
-            g_warning("write fingerprint file fail: %s", error->message);
-            g_error_free(error);
-        }
 
-        g_object_unref(stream);
-    }
+#ifdef HAVE_KIRAN_FACE
+    if (kiran_operation_get_state(&priv->face_operation, NULL) != KIRAN_OPERATION_IDLE)
+        return FALSE;
+#endif /* HAVE_KIRAN_FACE */
 
-    g_free(dir);
-    g_free(path);
-    g_object_unref(file);
+    return TRUE;
+}
 
-    return ret;
+//是否还有调用过方法且没有断开的客户端
+gboolean
+kiran_biometrics_has_clients(KiranBiometrics *kirBiometrics)
+{
+    return g_hash_table_size(kirBiometrics->priv->clients) > 0;
 }
 
-static gpointer
-do_finger_enroll(gpointer data)
+//最后一次活动的时间, 单调时钟
+gint64
+kiran_biometrics_get_last_active(KiranBiometrics *kirBiometrics)
+{
+    return kirBiometrics->priv->last_active;
+}
+
+/*
+ * 在总线上注册根对象, 指纹设备对象注册在 path/Devices/N
+ */
+gboolean
+kiran_biometrics_register(KiranBiometrics *kirBiometrics,
+                          GDBusConnection *connection,
+                          const gchar *path,
+                          GError **error)
 {
-    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(data);
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
-    int ret = FPRINT_RESULT_FAIL;
-    int i;
-    int try_count = 0;
-    int progress = 0;
-    unsigned char *templates[3];
-    unsigned int templateLens[3];
-    unsigned char *regTemplate = NULL;
-    unsigned int length;
-    int index = 0;
-    int enroll_number = 0;
-    unsigned char *saveTemplates[SUPPORT_FINGER_NUMBER];
-    unsigned int saveTemplateLens[SUPPORT_FINGER_NUMBER];
-    int save_number = 0;
-    gboolean over_support = FALSE;
-
-    memset(saveTemplates, 0x00, sizeof(unsigned char *) * SUPPORT_FINGER_NUMBER);
-
-    //获取当前保存的指纹模板
-    kiran_biometrics_get_save_fprints(saveTemplates, saveTemplateLens, &save_number);
-
-    if (save_number == SUPPORT_FINGER_NUMBER)
-    {
-        //达到最大指纹数目
-        dzlog_error("finger enroll is on limit %d", SUPPORT_FINGER_NUMBER);
-        over_support = TRUE;
-        goto out;
-    }
 
-    for (i = 0; i < 3; i++)
-    {
-        templates[i] = NULL;
-    }
+    if (!g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON(priv->skeleton),
+                                          connection,
+                                          path,
+                                          error))
+        return FALSE;
 
-    for (i = 0; i < 3 && (priv->fp_action == FP_ACTION_ENROLL);)
-    {
-        char *msg = _("Please place the finger again!");
-        char pass_message[BUFFER_SIZE] = {0};
+    priv->connection = g_object_ref(connection);
+    priv->object_path = g_strdup(path);
 
-        if (templates[i])
-        {
-            //重复录入时，释放内存
-            g_free(templates[i]);
-            templates[i] = NULL;
-        }
+    kiran_biometrics_load_cache(kirBiometrics);
+    kiran_biometrics_update_devices(kirBiometrics);
 
-        if (i == 0)
-        {
-            msg = _("Please place the finger!");
-        }
+    //在获取总线名字之前加载模板, 被总线激活后的第一次认证不用等待加载
+    if (priv->devices)
+        kiran_fprint_gallery_unref(kiran_fprint_store_get_gallery(priv->store));
 
-        switch (ret)
-        {
-        case FPRINT_RESULT_ENROLL_RETRY_TOO_SHORT:
-            msg = _("Your swipe was too short, please try again.");
-            break;
-
-        case FPRINT_RESULT_ENROLL_RETRY_REMOVE_FINGER:
-            msg = _("Scan failed, please remove your finger and then try again.");
-            break;
-
-        case FPRINT_RESULT_ENROLL_RETRY_CENTER_FINGER:
-            msg = _("Didn't catch that, please center your finger on the sensor and try again.");
-            break;
-
-        case FPRINT_RESULT_ENROLL_RETRY:
-            msg = _("Didn't quite catch that. Please try again.");
-            break;
-
-        case FPRINT_RESULT_ENROLL_PASS:
-            enroll_number++;
-            snprintf(pass_message, BUFFER_SIZE, _("Enroll stage passed %d. Please place the finger again!"), enroll_number);
-            msg = pass_message;
-            break;
-
-        default:
-            break;
-        }
+    return TRUE;
+}
 
-        //计算进度， 0, 25, 50, 75, 100这几个期间
-        progress = 25 * i + enroll_number * 8;
-        if (progress > 99)  //最大96, 只有保存了才能成功后才能100
-            progress = 99;
+static void
+kiran_biometrics_init(KiranBiometrics *self)
+{
+    KiranBiometricsPrivate *priv;
 
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
-                      msg, "", progress,
-                      FALSE);
+    priv = self->priv = KIRAN_BIOMETRICS_GET_PRIVATE(self);
+    priv->kfpmanager = kiran_fprint_manager_new();
+    priv->store = kiran_fprint_store_new(FPRINT_DIR);
+    priv->skeleton = kiran_dbus_biometrics_skeleton_new();
+    priv->connection = NULL;
+    priv->object_path = NULL;
+    priv->rescan_time = 0;
+    priv->rescan_id = 0;
+    priv->clients = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, kiran_biometrics_unwatch_client);
+    priv->last_active = g_get_monotonic_time();
+    priv->devices = NULL;
 
-        ret = kiran_fprint_manager_acquire_finger_print(priv->kfpmanager,
-                                                        &templates[i],
-                                                        &length,
-                                                        DEFAULT_TIME_OUT);
+#ifdef HAVE_KIRAN_FACE
+    //人脸模块在第一次人脸操作时创建
+    priv->kfamanager = NULL;
+    priv->face_idle_timeout = 0;
+    priv->face_idle_id = 0;
+    priv->face_events = kiran_event_queue_new(NULL, face_dispatch_event, self);
+    kiran_operation_init(&priv->face_operation);
+    priv->face_action = ACTION_NONE;
+    priv->face_generation = 0;
+    priv->face_jobs = g_async_queue_new();
+    priv->face_worker = NULL;
+#endif /* HAVE_KIRAN_FACE */
 
-        dzlog_debug("kiran_fprint_manager_acquire_finger_print ret is %d, len %d\n", ret, length);
+    kiran_biometrics_apply_settings(self);
+}
 
-        templateLens[i] = length;
-        if (ret == FPRINT_RESULT_OK)
-        {
-            if (i > 0)
-            {
-                ret = kiran_fprint_manager_template_match(priv->kfpmanager,
-                                                          templates[0],
-                                                          templateLens[0],
-                                                          templates[i],
-                                                          templateLens[i]);
-
-                dzlog_debug("kiran_fprint_manager_template_match ret is %d\n", ret);
-                if (ret == FPRINT_RESULT_UNSUPPORT)  //不支持指纹比对
-                    ret = FPRINT_RESULT_OK;
-
-                if (ret != FPRINT_RESULT_OK)
-                {
-                    g_signal_emit(kirBiometrics,
-                                  signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
-                                  _("Please place the same finger!"), "", progress,
-                                  FALSE);
-                    i = 0;
-                }
-                else
-                {
-                    i++;
-                }
-            }
-            else
-            {
-                i++;
-            }
-        }
-        else if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //录入内部完成
-        {
-            i++;
-            break;
-        }
+static int
+kiran_biometrics_remove_fprint(KiranBiometrics *kirBiometrics,
+                               const gchar *md5)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
 
-        if (try_count >= MAX_TRY_COUNT)
-        {
-            ret = FPRINT_RESULT_FAIL;
-            break;
-        }
+    return kiran_fprint_store_remove(priv->store, md5);
+}
 
-        try_count++;
-    }
+/*
+ * 应用需要主动设置的配置, 配置重新加载后调用
+ * 其它配置在每次操作开始时读取
+ */
+void
+kiran_biometrics_apply_settings(KiranBiometrics *kirBiometrics)
+{
+    KiranSettings *settings;
 
-    if (ret == FPRINT_RESULT_OK)
-    {
-        if (templates[0] && templates[1] && templates[2])
-            ret = kiran_fprint_manager_template_merge(priv->kfpmanager,
-                                                      templates[0],
-                                                      templates[1],
-                                                      templates[2],
-                                                      &regTemplate,
-                                                      &length);
-        dzlog_debug("kiran_fprint_manager_template_merge ret is %d, len is %d\n", ret, length);
-    }
-    else if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //不支持指纹合成
+    settings = kiran_settings_get();
+    kiran_fprint_manager_set_idle_timeout(kirBiometrics->priv->kfpmanager,
+                                          settings->device_idle_timeout);
+    kiran_biometrics_set_face_idle_timeout(kirBiometrics, settings->face_idle_timeout);
+    kiran_settings_unref(settings);
+}
+
+/*
+ * 设置人脸模块空闲多少秒后释放, 0表示人脸操作结束后立即释放
+ */
+void
+kiran_biometrics_set_face_idle_timeout(KiranBiometrics *kirBiometrics,
+                                       guint idle_timeout)
+{
+#ifdef HAVE_KIRAN_FACE
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    priv->face_idle_timeout = idle_timeout;
+
+    //已经在计时的按新的超时时间重新计时
+    if (priv->face_idle_id)
     {
-        length = templateLens[0];
-        regTemplate = (unsigned char *)malloc(length);
-        if (regTemplate != NULL)
-            memcpy(regTemplate, templates[0], length);
-        dzlog_debug("fingger enroll complete with date len [%d]", length);
+        g_source_remove(priv->face_idle_id);
+        priv->face_idle_id = 0;
+        face_manager_schedule_release(kirBiometrics);
     }
+#endif /* HAVE_KIRAN_FACE */
+}
+
+typedef struct
+{
+    GDBusMethodInvocation *invocation;
+    KiranBiometricsCallerUidFunc callback;
+    gpointer user_data;
+} KiranBiometricsCallerUidData;
+
+static void
+kiran_biometrics_get_caller_uid_cb(GObject *source,
+                                   GAsyncResult *res,
+                                   gpointer user_data)
+{
+    KiranBiometricsCallerUidData *data = user_data;
+    g_autoptr(GError) error = NULL;
+    GVariant *reply;
+    guint32 uid = G_MAXUINT32;
 
-    if (ret == FPRINT_RESULT_OK)
+    reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+    if (reply == NULL)
     {
-        ret = kiran_fprint_manager_template_match(priv->kfpmanager,
-                                                  templates[0],
-                                                  templateLens[0],
-                                                  regTemplate,
-                                                  length);
+        dzlog_debug("get unix user of %s failed: %s",
+                    g_dbus_method_invocation_get_sender(data->invocation),
+                    error->message);
     }
-    else if (ret == FPRINT_RESULT_ENROLL_COMPLETE)  //不支持两个指纹模板比对
+    else
     {
-        ret = FPRINT_RESULT_OK;
+        g_variant_get(reply, "(u)", &uid);
+        g_variant_unref(reply);
     }
 
-    if (ret == FPRINT_RESULT_OK)
-    {
-        gchar *id = NULL;
-        int number = 0;
-
-        //检查该指纹是否录入过
-        //首先调用指纹内部接口进行比对
-        number = save_number;
-        ret = kiran_fprint_manager_verify_finger_print(priv->kfpmanager,
-                                                       saveTemplates,
-                                                       saveTemplateLens,
-                                                       &number,
-                                                       DEFAULT_TIME_OUT);
-        dzlog_debug("kiran_fprint_verify_acquire_finger_print ret is %d\n", ret);
-        if (ret == FPRINT_RESULT_UNSUPPORT)  //指纹内部认证接口不支持， 调用其它接口认证
-        {
-            int j = 0;
-
-            for (j = 0; j < save_number; j++)
-            {
-                ret = kiran_fprint_manager_template_match(priv->kfpmanager,
-                                                          regTemplate,
-                                                          length,
-                                                          saveTemplates[j],
-                                                          saveTemplateLens[j]);
-
-                if (ret == FPRINT_RESULT_OK)
-                {
-                    id = g_compute_checksum_for_string(G_CHECKSUM_MD5,
-                                                       saveTemplates[j],
-                                                       saveTemplateLens[j]);
-                    break;
-                }
-            }
-            dzlog_debug("kiran_fprint_manager_template_match ret is %d\n", ret);
-        }
-        else if (ret == FPRINT_RESULT_OK)
-        {
-            if (number >= 0 && number < save_number)
-            {
-                id = g_compute_checksum_for_string(G_CHECKSUM_MD5,
-                                                   saveTemplates[number],
-                                                   saveTemplateLens[number]);
-            }
-        }
-
-        if (ret != FPRINT_RESULT_OK)
-        {
-            //该指纹没有录入过
-            //进行指纹保存
-            ret = kiran_biometrics_save_fprint(regTemplate, length, &id);
-            if (ret == 0)
-            {
-                g_signal_emit(kirBiometrics,
-                              signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
-                              _("Successed enroll finger!"), id, 100,
-                              TRUE);
-            }
-        }
-        else
-        {
-            //指纹已经存在，直接返回该指纹
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
-                          _("Successed enroll finger!"), id, 100,
-                          TRUE);
-        }
+    data->callback(data->invocation, uid, data->user_data);
+    g_slice_free(KiranBiometricsCallerUidData, data);
+}
 
-        g_free(id);
-    }
+/*
+ * 获取DBus调用者的用户ID, 结果通过 callback 返回, 失败时为 G_MAXUINT32
+ * 点对点连接直接使用对端的凭据, 总线连接向总线异步查询, 不阻塞主循环
+ * callback 负责完成 invocation
+ */
+void
+kiran_biometrics_get_caller_uid(GDBusMethodInvocation *invocation,
+                                KiranBiometricsCallerUidFunc callback,
+                                gpointer user_data)
+{
+    GDBusConnection *connection = g_dbus_method_invocation_get_connection(invocation);
+    KiranBiometricsCallerUidData *data;
 
-out:
-    if (ret != FPRINT_RESULT_OK)
+    if (g_dbus_connection_get_unique_name(connection) == NULL)
     {
-        char *str = _("Failed enroll finger!");
+        GCredentials *credentials = g_dbus_connection_get_peer_credentials(connection);
+        guint32 uid = G_MAXUINT32;
 
-        if (priv->fp_action != FP_ACTION_ENROLL)
-        {
-            str = _("Cancel fprint enroll!");
-        }
-        else if (over_support)
-        {
-            str = _("Finger number reach on limit!");
-        }
+        if (credentials)
+            uid = g_credentials_get_unix_user(credentials, NULL);
 
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FPRINT_ENROLL_STATUS], 0,
-                      str, "", 0,
-                      TRUE);
+        callback(invocation, uid, user_data);
+        return;
     }
 
-    for (index = 0; index < i; index++)
-        g_free(templates[index]);
-
-    g_free(regTemplate);
-
-    for (i = 0; i++; i < save_number)
-        g_free(saveTemplates[i]);
-
-    //完成采集
-    kiran_fprint_manager_close(priv->kfpmanager);
-    priv->fprint_busy = FALSE;
-    priv->fp_action = ACTION_NONE;
-
-    g_thread_exit(0);
+    data = g_slice_new(KiranBiometricsCallerUidData);
+    data->invocation = invocation;
+    data->callback = callback;
+    data->user_data = user_data;
+
+    g_dbus_connection_call(connection,
+                           "org.freedesktop.DBus",
+                           "/org/freedesktop/DBus",
+                           "org.freedesktop.DBus",
+                           "GetConnectionUnixUser",
+                           g_variant_new("(s)", g_dbus_method_invocation_get_sender(invocation)),
+                           G_VARIANT_TYPE("(u)"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           NULL,
+                           kiran_biometrics_get_caller_uid_cb,
+                           data);
 }
 
-static void
-kiran_biometrics_enroll_fprint_start(KiranBiometrics *kirBiometrics,
-                                     DBusGMethodInvocation *context)
+/*
+ * 返回DBus错误, 错误名和原来dbus-glib导出的保持一致, 客户端依赖这些名字
+ */
+void
+kiran_biometrics_return_error(GDBusMethodInvocation *invocation,
+                              const GError *error)
 {
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
-    g_autoptr(GError) error = NULL;
-    int ret;
+    GEnumClass *enum_class = NULL;
+    GEnumValue *value = NULL;
 
-    if (priv->fprint_busy)
-    {
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_DEVICE_BUSY, "%s", _("Fingerprint Device Busy"));
-        dbus_g_method_return_error(context, error);
-        return;
-    }
+    if (error->domain == FPRINT_ERROR)
+        enum_class = g_type_class_ref(FPRINT_TYPE_ERROR);
+#ifdef HAVE_KIRAN_FACE
+    else if (error->domain == FACE_ERROR)
+        enum_class = g_type_class_ref(FACE_TYPE_ERROR);
+#endif /* HAVE_KIRAN_FACE */
 
-    ret = kiran_fprint_manager_open(priv->kfpmanager);
-    dzlog_debug("kiran_fprint_manager_open ret is %d\n", ret);
-    if (ret == FPRINT_RESULT_OK)
+    if (enum_class)
+        value = g_enum_get_value(enum_class, error->code);
+
+    if (value)
     {
-        priv->fprint_busy = TRUE;
-        priv->fp_action = FP_ACTION_ENROLL;
+        gchar *name;
 
-        priv->fprint_enroll_thread = g_thread_new(NULL,
-                                                  do_finger_enroll,
-                                                  kirBiometrics);
+        name = g_strdup_printf("%s.%s", FPRINT_ERROR_DBUS_INTERFACE, value->value_nick);
+        g_dbus_method_invocation_return_dbus_error(invocation, name, error->message);
+        g_free(name);
     }
     else
     {
-        const char *msg;
+        g_dbus_method_invocation_return_gerror(invocation, error);
+    }
 
-        if (ret == FPRINT_RESULT_NO_DEVICE)
-            msg = _("Fingerprint Device Not Found");
-        else
-            msg = _("Open Fingerprint Device Fail!");
+    if (enum_class)
+        g_type_class_unref(enum_class);
+}
 
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_NOT_FOUND_DEVICE, "%s", msg);
-        dbus_g_method_return_error(context, error);
-        return;
-    }
+//距离上一次枚举设备是否已经超过最小间隔
+static gboolean
+kiran_biometrics_rescan_due(KiranBiometrics *kirBiometrics)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
 
-    dbus_g_method_return(context);
+    return priv->rescan_time == 0 ||
+           g_get_monotonic_time() - priv->rescan_time >= FPRINT_RESCAN_INTERVAL * G_USEC_PER_SEC;
 }
 
+static gboolean
+kiran_biometrics_rescan_idle(gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+
+    kirBiometrics->priv->rescan_id = 0;
+    kiran_biometrics_update_devices(kirBiometrics);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * 在主循环空闲时重新枚举设备, 新设备的对象在下一次查询时返回
+ * 距离上一次枚举不到 FPRINT_RESCAN_INTERVAL 秒时不枚举
+ */
 static void
-kiran_biometrics_enroll_fprint_stop(KiranBiometrics *kirBiometrics,
-                                    DBusGMethodInvocation *context)
+kiran_biometrics_schedule_rescan(KiranBiometrics *kirBiometrics)
 {
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
-    g_autoptr(GError) error = NULL;
 
-    if (priv->fp_action != FP_ACTION_ENROLL)
-    {
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
-        dbus_g_method_return_error(context, error);
+    if (priv->rescan_id || !kiran_biometrics_rescan_due(kirBiometrics))
         return;
-    }
-
-    priv->fp_action = ACTION_NONE;
 
-    if (priv->fprint_enroll_thread)
-    {
-        kiran_fprint_manager_acquire_finger_print_stop(priv->kfpmanager);
-        g_thread_join(priv->fprint_enroll_thread);
-        priv->fprint_enroll_thread = NULL;
-    }
-
-    dbus_g_method_return(context);
+    priv->rescan_id = g_idle_add(kiran_biometrics_rescan_idle, kirBiometrics);
 }
 
-static gpointer
-do_finger_verify(gpointer data)
+/*
+ * 确保至少发现了一个指纹设备, 守护进程启动后插入的设备在这里被发现
+ * 没有设备时最多每 FPRINT_RESCAN_INTERVAL 秒枚举一次
+ */
+static GList *
+kiran_biometrics_ensure_devices(KiranBiometrics *kirBiometrics)
 {
-    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(data);
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
-    unsigned char *saveTemplates[SUPPORT_FINGER_NUMBER];
-    unsigned int saveTemplateLens[SUPPORT_FINGER_NUMBER];
-    int save_number = 0;
-    int number = 0;
-    unsigned char *template = NULL;
-    unsigned int templateLen;
-    char *md5 = NULL;
-    int i = 0;
-    int ret = 0;
-
-    memset(saveTemplates, 0x00, sizeof(unsigned char *) * SUPPORT_FINGER_NUMBER);
-
-    ret = kiran_biometrics_get_save_fprints(saveTemplates, saveTemplateLens, &save_number);
-    if (ret != FPRINT_RESULT_OK)
-    {
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                      _("Not Found The Id Fprint Template!"), TRUE, FALSE, "");
 
-        kiran_fprint_manager_close(priv->kfpmanager);
-        priv->fprint_busy = FALSE;
-        priv->fp_action = ACTION_NONE;
+    if (priv->devices == NULL && kiran_biometrics_rescan_due(kirBiometrics))
+        kiran_biometrics_update_devices(kirBiometrics);
 
-        return NULL;
-    }
+    return priv->devices;
+}
 
-    for (i = 0; i < MAX_TRY_COUNT && (priv->fp_action == FP_ACTION_VERIFY); i++)
-    {
-        if (template)
-        {
-            //重复录入时，释放内存
-            g_free(template);
-            template = NULL;
-        }
+static gint
+compare_device_load(gconstpointer a,
+                    gconstpointer b)
+{
+    guint load_a = kiran_biometrics_device_get_load((KiranBiometricsDevice *)a);
+    guint load_b = kiran_biometrics_device_get_load((KiranBiometricsDevice *)b);
 
-        if (i == 0)
-        {
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                          _("Please place the finger!"), FALSE, FALSE, "");
-        }
+    return load_a < load_b ? -1 : (load_a > load_b ? 1 : 0);
+}
 
-        //首先调用指纹内部接口进行比对
-        number = save_number;
-        ret = kiran_fprint_manager_verify_finger_print(priv->kfpmanager,
-                                                       saveTemplates,
-                                                       saveTemplateLens,
-                                                       &number,
-                                                       DEFAULT_TIME_OUT);
+/*
+ * 根对象上的指纹操作转发到负载最小的设备, 兼容只使用根对象的客户端
+ * 所有设备都忙时在负载最小的设备上排队
+ */
+static gboolean
+kiran_biometrics_fprint_start(KiranBiometrics *kirBiometrics,
+                              FprintAction action,
+                              guint32 owner,
+                              const gchar *const *ids,
+                              const gchar *sender,
+                              GError **error)
+{
+    gboolean busy = FALSE;
+    GList *devices;
+    GList *l;
 
-        dzlog_debug("kiran_fprint_verify_acquire_finger_print ret is %d\n", ret);
-        if (ret == FPRINT_RESULT_UNSUPPORT)  //指纹内部认证接口不支持， 调用其它接口认证
-        {
-            ret = kiran_fprint_manager_acquire_finger_print(priv->kfpmanager,
-                                                            &template,
-                                                            &templateLen,
-                                                            DEFAULT_TIME_OUT);
-            dzlog_debug("kiran_fprint_manager_acquire_finger_print ret is %d, len %d\n", ret, templateLen);
+    //g_list_sort 是稳定排序, 负载相同时保持设备的发现顺序
+    devices = g_list_copy(kiran_biometrics_ensure_devices(kirBiometrics));
+    devices = g_list_sort(devices, compare_device_load);
 
-            if (ret == FPRINT_RESULT_OK)
-            {
-                int j = 0;
-
-                for (j = 0; j < save_number; j++)
-                {
-                    ret = kiran_fprint_manager_template_match(priv->kfpmanager,
-                                                              template,
-                                                              templateLen,
-                                                              saveTemplates[j],
-                                                              saveTemplateLens[j]);
-
-                    if (ret == FPRINT_RESULT_OK)
-                    {
-                        md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5,
-                                                            saveTemplates[j],
-                                                            saveTemplateLens[j]);
-                        break;
-                    }
-                }
-
-                dzlog_debug("kiran_fprint_manager_template_match ret is %d\n", ret);
-            }
-        }
-        else if (ret == FPRINT_RESULT_OK)
-        {
-            if (number >= 0 && number < save_number)
-            {
-                md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5,
-                                                    saveTemplates[number],
-                                                    saveTemplateLens[number]);
-            }
-        }
+    for (l = devices; l != NULL; l = l->next)
+    {
+        KiranBiometricsDevice *device = l->data;
+        g_autoptr(GError) device_error = NULL;
+        gboolean started;
 
-        if (md5 != NULL)
-        {
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                          _("Fingerprint match!"), FALSE, TRUE, md5);
-            g_free(md5);
-        }
+        if (action == FP_ACTION_ENROLL)
+            started = kiran_biometrics_device_start_enroll(device, owner, sender, TRUE, &device_error);
         else
-        {
-            char *msg = _("Fingerprint not match, place again!");
+            started = kiran_biometrics_device_start_verify(device, ids, sender, TRUE, &device_error);
 
-            switch (ret)
-            {
-            case FPRINT_RESULT_ENROLL_RETRY_TOO_SHORT:
-                msg = _("Your swipe was too short, please try again.");
-                break;
+        if (started)
+        {
+            g_list_free(devices);
+            return TRUE;
+        }
 
-            case FPRINT_RESULT_ENROLL_RETRY_REMOVE_FINGER:
-                msg = _("Scan failed, please remove your finger and then try again.");
-                break;
+        if (g_error_matches(device_error, FPRINT_ERROR, FPRINT_ERROR_DEVICE_BUSY))
+            busy = TRUE;
+    }
 
-            case FPRINT_RESULT_ENROLL_RETRY_CENTER_FINGER:
-                msg = _("Didn't catch that, please center your finger on the sensor and try again.");
-                break;
+    g_list_free(devices);
 
-            case FPRINT_RESULT_ENROLL_RETRY:
-                msg = _("Didn't quite catch that. Please try again.");
-                break;
+    if (busy)
+        g_set_error(error, FPRINT_ERROR,
+                    FPRINT_ERROR_DEVICE_BUSY, "%s", _("Fingerprint Device Busy"));
+    else
+        g_set_error(error, FPRINT_ERROR,
+                    FPRINT_ERROR_NOT_FOUND_DEVICE, "%s", _("Fingerprint Device Not Found"));
 
-            default:
-                break;
-            }
+    return FALSE;
+}
 
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                          msg, FALSE, FALSE, "");
-        }
-    }
+/*
+ * 停止 sender 从根对象发起的操作, 操作可能在任意一个设备上执行或排队
+ */
+static gboolean
+kiran_biometrics_fprint_stop(KiranBiometrics *kirBiometrics,
+                             FprintAction action,
+                             const gchar *sender,
+                             GError **error)
+{
+    GList *l;
 
-    if (ret != FPRINT_RESULT_OK)
+    for (l = kirBiometrics->priv->devices; l != NULL; l = l->next)
     {
-        if (priv->fp_action != FP_ACTION_VERIFY)
-        {
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                          _("Cancel fprint verify!"), TRUE, FALSE, "");
-        }
-    }
+        gboolean stopped;
 
-    if (i == MAX_TRY_COUNT)
-    {
-        g_signal_emit(kirBiometrics,
-                      signals[SIGNAL_FPRINT_VERIFY_STATUS], 0,
-                      _("Fingerprint over max try count!"), TRUE, FALSE, "");
+        if (action == FP_ACTION_ENROLL)
+            stopped = kiran_biometrics_device_stop_enroll(l->data, sender, NULL);
+        else
+            stopped = kiran_biometrics_device_stop_verify(l->data, sender, NULL);
+
+        if (stopped)
+            return TRUE;
     }
 
-    kiran_fprint_manager_close(priv->kfpmanager);
-    priv->fprint_busy = FALSE;
-    priv->fp_action = ACTION_NONE;
+    g_set_error(error, FPRINT_ERROR,
+                FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
 
-    for (i = 0; i++; i < save_number)
-        g_free(saveTemplates[i]);
+    return FALSE;
+}
 
-    g_free(template);
+//得到调用者的用户ID后开始录入
+static void
+kiran_biometrics_enroll_fprint_start_with_uid(GDBusMethodInvocation *invocation,
+                                              guint32 uid,
+                                              gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_fprint_start(kirBiometrics,
+                                       FP_ACTION_ENROLL,
+                                       uid,
+                                       NULL,
+                                       g_dbus_method_invocation_get_sender(invocation),
+                                       &error))
+        kiran_biometrics_return_error(invocation, error);
+    else
+        kiran_dbus_biometrics_complete_enroll_fprint_start(kirBiometrics->priv->skeleton, invocation);
 
-    g_thread_exit(0);
+    g_object_unref(kirBiometrics);
 }
 
-static void
-kiran_biometrics_verify_fprint_start(KiranBiometrics *kirBiometrics,
-                                     DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_enroll_fprint_start(KiranDbusBiometrics *skeleton,
+                                     GDBusMethodInvocation *invocation,
+                                     KiranBiometrics *kirBiometrics)
+{
+    kiran_biometrics_get_caller_uid(invocation,
+                                    kiran_biometrics_enroll_fprint_start_with_uid,
+                                    g_object_ref(kirBiometrics));
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_enroll_fprint_stop(KiranDbusBiometrics *skeleton,
+                                    GDBusMethodInvocation *invocation,
+                                    KiranBiometrics *kirBiometrics)
 {
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
-    int ret;
 
-    if (priv->fprint_busy)
+    if (!kiran_biometrics_fprint_stop(kirBiometrics,
+                                      FP_ACTION_ENROLL,
+                                      g_dbus_method_invocation_get_sender(invocation),
+                                      &error))
     {
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_DEVICE_BUSY, "%s", _("Fingerprint Device Busy"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    ret = kiran_fprint_manager_open(priv->kfpmanager);
-    dzlog_debug("kiran_fprint_manager_open ret is %d\n", ret);
-    if (ret == FPRINT_RESULT_OK)
-    {
-        priv->fprint_busy = TRUE;
-        priv->fp_action = FP_ACTION_VERIFY;
+    kiran_dbus_biometrics_complete_enroll_fprint_stop(skeleton, invocation);
 
-        priv->fprint_verify_thread = g_thread_new(NULL,
-                                                  do_finger_verify,
-                                                  kirBiometrics);
-    }
-    else
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_verify_fprint_start(KiranDbusBiometrics *skeleton,
+                                     GDBusMethodInvocation *invocation,
+                                     KiranBiometrics *kirBiometrics)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!kiran_biometrics_fprint_start(kirBiometrics,
+                                       FP_ACTION_VERIFY,
+                                       G_MAXUINT32,
+                                       NULL,
+                                       g_dbus_method_invocation_get_sender(invocation),
+                                       &error))
     {
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_NOT_FOUND_DEVICE, "%s", _("Fingerprint Device Not Found"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_verify_fprint_start(skeleton, invocation);
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_verify_fprint_stop(KiranBiometrics *kirBiometrics,
-                                    DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_verify_fprint_start_for_ids(KiranDbusBiometrics *skeleton,
+                                             GDBusMethodInvocation *invocation,
+                                             const gchar *const *ids,
+                                             KiranBiometrics *kirBiometrics)
 {
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
 
-    if (priv->fp_action != FP_ACTION_VERIFY)
+    if (!kiran_biometrics_fprint_start(kirBiometrics,
+                                       FP_ACTION_VERIFY,
+                                       G_MAXUINT32,
+                                       ids,
+                                       g_dbus_method_invocation_get_sender(invocation),
+                                       &error))
     {
-        g_set_error(&error, FPRINT_ERROR,
-                    FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    priv->fp_action = ACTION_NONE;
+    kiran_dbus_biometrics_complete_verify_fprint_start_for_ids(skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_verify_fprint_stop(KiranDbusBiometrics *skeleton,
+                                    GDBusMethodInvocation *invocation,
+                                    KiranBiometrics *kirBiometrics)
+{
+    g_autoptr(GError) error = NULL;
 
-    if (priv->fprint_verify_thread)
+    if (!kiran_biometrics_fprint_stop(kirBiometrics,
+                                      FP_ACTION_VERIFY,
+                                      g_dbus_method_invocation_get_sender(invocation),
+                                      &error))
     {
-        kiran_fprint_manager_acquire_finger_print_stop(priv->kfpmanager);
-        g_thread_join(priv->fprint_verify_thread);
-        priv->fprint_verify_thread = NULL;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_verify_fprint_stop(skeleton, invocation);
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_delete_enrolled_finger(KiranBiometrics *kirBiometrics,
-                                        const char *id,
-                                        DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_get_fprint_devices(KiranDbusBiometrics *skeleton,
+                                    GDBusMethodInvocation *invocation,
+                                    KiranBiometrics *kirBiometrics)
+{
+    GPtrArray *paths;
+    GList *l;
+
+    //返回已发现的设备, 不在方法处理中初始化指纹模块
+    kiran_biometrics_schedule_rescan(kirBiometrics);
+
+    paths = g_ptr_array_new();
+    for (l = kirBiometrics->priv->devices; l != NULL; l = l->next)
+        g_ptr_array_add(paths, (gpointer)kiran_biometrics_device_get_object_path(l->data));
+    g_ptr_array_add(paths, NULL);
+
+    kiran_dbus_biometrics_complete_get_fprint_devices(skeleton,
+                                                      invocation,
+                                                      (const gchar *const *)paths->pdata);
+    g_ptr_array_free(paths, TRUE);
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_delete_enrolled_finger(KiranDbusBiometrics *skeleton,
+                                        GDBusMethodInvocation *invocation,
+                                        const gchar *id,
+                                        KiranBiometrics *kirBiometrics)
 {
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
     int ret;
 
-    ret = kiran_biometrics_remove_fprint(id);
+    ret = kiran_biometrics_remove_fprint(kirBiometrics, id);
     if (ret != FPRINT_RESULT_OK)
     {
         g_set_error(&error, FPRINT_ERROR,
                     FPRINT_ERROR_INTERNAL, "%s", _("Internal Error"));
-        dbus_g_method_return_error(context, error);
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_delete_enrolled_finger(skeleton, invocation);
+
+    return TRUE;
 }
 
 #ifdef HAVE_KIRAN_FACE
+/*
+ * 人脸采集线程, 每次开始录入或认证时放入操作的代数,
+ * 采集到操作被取消或出错为止, 关闭摄像头后回到空闲状态
+ */
 static gpointer
 do_face_capture(gpointer data)
 {
     KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(data);
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
+    KiranSettings *settings;
+    gpointer job;
+    guint interval;
     int ret;
 
-    ret = FACE_RESULT_OK;
-    while ((priv->face_action == FACE_ACTION_ENROLL || priv->face_action == FACE_ACTION_VERIFY) && ret == FACE_RESULT_OK)
+    while ((job = g_async_queue_pop(priv->face_jobs)) != FACE_JOB_QUIT)
     {
-        ret = kiran_face_manager_capture_face(priv->kfamanager);
-        usleep(100000);
+        guint generation = GPOINTER_TO_UINT(job);
+
+        settings = kiran_settings_get();
+        interval = settings->capture_interval;
+        kiran_settings_unref(settings);
+
+        ret = FACE_RESULT_OK;
+        while (ret == FACE_RESULT_OK &&
+               kiran_operation_enter(&priv->face_operation, generation, KIRAN_OPERATION_ACQUIRING))
+        {
+            ret = kiran_face_manager_capture_face(priv->kfamanager);
+            usleep(interval * 1000);
+        }
+
+        kiran_face_manager_stop(priv->kfamanager);
+        dzlog_debug("stop face caputer\n");
+
+        kiran_operation_end(&priv->face_operation);
+        kiran_event_queue_push(priv->face_events,
+                               kiran_event_new(FACE_EVENT_CAPTURE_DONE, NULL, NULL));
     }
 
-    kiran_face_manager_stop(priv->kfamanager);
-    dzlog_debug("stop face caputer\n");
-    priv->face_busy = FALSE;
-    priv->face_action = ACTION_NONE;
+    return NULL;
+}
+
+//取消正在进行的 action 操作, 已经结束或被取消时返回 FALSE
+static gboolean
+face_operation_stop(KiranBiometrics *kirBiometrics,
+                    FprintAction action)
+{
+    KiranBiometricsPrivate *priv = kirBiometrics->priv;
+
+    if (priv->face_action != action ||
+        kiran_operation_get_state(&priv->face_operation, NULL) == KIRAN_OPERATION_IDLE)
+        return FALSE;
 
-    g_thread_exit(0);
+    return kiran_operation_cancel(&priv->face_operation, priv->face_generation);
+}
+#else
+//没有人脸支持时, 人脸相关的调用直接返回不支持
+static void
+kiran_biometrics_return_no_face(GDBusMethodInvocation *invocation)
+{
+    g_dbus_method_invocation_return_error(invocation,
+                                          G_DBUS_ERROR,
+                                          G_DBUS_ERROR_NOT_SUPPORTED,
+                                          "%s", _("Face Device Not Found"));
 }
 #endif /* HAVE_KIRAN_FACE */
 
-static void
-kiran_biometrics_enroll_face_start(KiranBiometrics *kirBiometrics,
-                                   DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_enroll_face_start(KiranDbusBiometrics *skeleton,
+                                   GDBusMethodInvocation *invocation,
+                                   KiranBiometrics *kirBiometrics)
 {
 #ifdef HAVE_KIRAN_FACE
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
+    guint generation;
     int ret;
 
-    if (priv->face_busy)
+    generation = kiran_operation_begin(&priv->face_operation);
+    if (generation == 0)
     {
         g_set_error(&error, FACE_ERROR,
                     FACE_ERROR_DEVICE_BUSY, "%s", _("Face Device Busy"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    ret = kiran_face_manager_start(priv->kfamanager);
+    ret = kiran_face_manager_start(face_manager_acquire(kirBiometrics));
     if (ret == FACE_RESULT_OK)
     {
         ret = kiran_face_manager_do_enroll(priv->kfamanager);
         if (ret == FACE_RESULT_OK)
         {
-            priv->face_busy = TRUE;
             priv->face_action = FACE_ACTION_ENROLL;
-
-            priv->face_capture_thread = g_thread_new(NULL,
-                                                     do_face_capture,
-                                                     kirBiometrics);
+            priv->face_generation = generation;
+            g_async_queue_push(priv->face_jobs, GUINT_TO_POINTER(generation));
+        }
+        else
+        {
+            kiran_face_manager_stop(priv->kfamanager);
+            kiran_operation_end(&priv->face_operation);
         }
 
-        dbus_g_method_return(context, kiran_face_manager_get_addr(priv->kfamanager));
-        return;
+        kiran_dbus_biometrics_complete_enroll_face_start(skeleton,
+                                                         invocation,
+                                                         kiran_face_manager_get_addr(priv->kfamanager));
+        //返回地址后再释放, 超时为0时会立即释放人脸模块
+        if (ret != FACE_RESULT_OK)
+            face_manager_schedule_release(kirBiometrics);
+        return TRUE;
     }
 
+    kiran_operation_end(&priv->face_operation);
+    face_manager_schedule_release(kirBiometrics);
     g_set_error(&error, FACE_ERROR,
                 FACE_ERROR_NOT_FOUND_DEVICE, "%s", _("Face Device Not Found"));
-    dbus_g_method_return_error(context, error);
+    kiran_biometrics_return_error(invocation, error);
+#else
+    kiran_biometrics_return_no_face(invocation);
 #endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_enroll_face_stop(KiranBiometrics *kirBiometrics,
-                                  DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_enroll_face_stop(KiranDbusBiometrics *skeleton,
+                                  GDBusMethodInvocation *invocation,
+                                  KiranBiometrics *kirBiometrics)
 {
 #ifdef HAVE_KIRAN_FACE
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
 
-    if (priv->face_action != FACE_ACTION_ENROLL)
+    //不等待采集线程, 采集线程结束后回到空闲状态
+    if (!face_operation_stop(kirBiometrics, FACE_ACTION_ENROLL))
     {
         g_set_error(&error, FPRINT_ERROR,
                     FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    priv->face_action = ACTION_NONE;
-
-    if (priv->face_capture_thread)
-    {
-        g_thread_join(priv->face_capture_thread);
-        priv->face_capture_thread = NULL;
-    }
-
-    priv->face_busy = FALSE;
-
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_enroll_face_stop(skeleton, invocation);
+#else
+    kiran_biometrics_return_no_face(invocation);
 #endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_verify_face_start(KiranBiometrics *kirBiometrics,
-                                   const char *id,
-                                   DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_verify_face_start(KiranDbusBiometrics *skeleton,
+                                   GDBusMethodInvocation *invocation,
+                                   const gchar *id,
+                                   KiranBiometrics *kirBiometrics)
 {
 #ifdef HAVE_KIRAN_FACE
     KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
+    guint generation;
     int ret;
 
-    if (priv->face_busy)
+    generation = kiran_operation_begin(&priv->face_operation);
+    if (generation == 0)
     {
         g_set_error(&error, FACE_ERROR,
                     FACE_ERROR_DEVICE_BUSY, "%s", _("Face Device Busy"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    ret = kiran_face_manager_start(priv->kfamanager);
+    ret = kiran_face_manager_start(face_manager_acquire(kirBiometrics));
     if (ret == FACE_RESULT_OK)
     {
         ret = kiran_face_manager_do_verify(priv->kfamanager, id);
         if (ret == FACE_RESULT_OK)
         {
-            g_signal_emit(kirBiometrics,
-                          signals[SIGNAL_FACE_VERIFY_STATUS], 0,
-                          _("Looking for you face, Please look the camera!"), FALSE, FALSE);
+            kiran_dbus_biometrics_emit_verify_face_status(priv->skeleton,
+                                                          _("Looking for you face, Please look the camera!"), FALSE, FALSE);
 
-            priv->face_busy = TRUE;
             priv->face_action = FACE_ACTION_VERIFY;
-
-            priv->face_capture_thread = g_thread_new(NULL,
-                                                     do_face_capture,
-                                                     kirBiometrics);
+            priv->face_generation = generation;
+            g_async_queue_push(priv->face_jobs, GUINT_TO_POINTER(generation));
+        }
+        else
+        {
+            kiran_face_manager_stop(priv->kfamanager);
+            kiran_operation_end(&priv->face_operation);
+            face_manager_schedule_release(kirBiometrics);
         }
 
-        dbus_g_method_return(context, kiran_face_manager_get_addr(priv->kfamanager));
-        return;
+        kiran_dbus_biometrics_complete_verify_face_start(skeleton, invocation);
+        return TRUE;
     }
 
+    kiran_operation_end(&priv->face_operation);
+    face_manager_schedule_release(kirBiometrics);
     g_set_error(&error, FACE_ERROR,
                 FACE_ERROR_NOT_FOUND_DEVICE, "%s", _("Face Device Not Found"));
-    dbus_g_method_return_error(context, error);
+    kiran_biometrics_return_error(invocation, error);
+#else
+    kiran_biometrics_return_no_face(invocation);
 #endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_verify_face_stop(KiranBiometrics *kirBiometrics,
-                                  DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_verify_face_stop(KiranDbusBiometrics *skeleton,
+                                  GDBusMethodInvocation *invocation,
+                                  KiranBiometrics *kirBiometrics)
 {
 #ifdef HAVE_KIRAN_FACE
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
     g_autoptr(GError) error = NULL;
 
-    if (priv->face_action != FACE_ACTION_VERIFY)
+    //不等待采集线程, 采集线程结束后回到空闲状态
+    if (!face_operation_stop(kirBiometrics, FACE_ACTION_VERIFY))
     {
         g_set_error(&error, FPRINT_ERROR,
                     FPRINT_ERROR_NO_ACTION_IN_PROGRESS, "%s", _("No Action In Progress"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    priv->face_action = ACTION_NONE;
-
-    if (priv->face_capture_thread)
-    {
-        g_thread_join(priv->face_capture_thread);
-        priv->face_capture_thread = NULL;
-    }
-
-    priv->face_busy = FALSE;
-
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_verify_face_stop(skeleton, invocation);
+#else
+    kiran_biometrics_return_no_face(invocation);
 #endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
 }
 
-static void
-kiran_biometrics_delete_enrolled_face(KiranBiometrics *kirBiometrics,
-                                      const char *id,
-                                      DBusGMethodInvocation *context)
+static gboolean
+kiran_biometrics_delete_enrolled_face(KiranDbusBiometrics *skeleton,
+                                      GDBusMethodInvocation *invocation,
+                                      const gchar *id,
+                                      KiranBiometrics *kirBiometrics)
 {
 #ifdef HAVE_KIRAN_FACE
-    KiranBiometricsPrivate *priv = kirBiometrics->priv;
-
     g_autoptr(GError) error = NULL;
     int ret;
 
@@ -1278,12 +1438,49 @@ kiran_biometrics_delete_enrolled_face(KiranBiometrics *kirBiometrics,
     {
         g_set_error(&error, FACE_ERROR,
                     FACE_ERROR_INTERNAL, "%s", _("Internal Error"));
-        dbus_g_method_return_error(context, error);
-        return;
+        kiran_biometrics_return_error(invocation, error);
+        return TRUE;
     }
 
-    dbus_g_method_return(context);
+    kiran_dbus_biometrics_complete_delete_enrolled_face(skeleton, invocation);
+#else
+    kiran_biometrics_return_no_face(invocation);
 #endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_get_statistics(KiranDbusBiometrics *skeleton,
+                                GDBusMethodInvocation *invocation,
+                                KiranBiometrics *kirBiometrics)
+{
+    kiran_dbus_biometrics_complete_get_statistics(skeleton,
+                                                  invocation,
+                                                  kiran_stats_get());
+
+    return TRUE;
+}
+
+static gboolean
+kiran_biometrics_get_face_operation_state(KiranDbusBiometrics *skeleton,
+                                          GDBusMethodInvocation *invocation,
+                                          KiranBiometrics *kirBiometrics)
+{
+#ifdef HAVE_KIRAN_FACE
+    KiranOperationState state;
+    guint generation;
+
+    state = kiran_operation_get_state(&kirBiometrics->priv->face_operation, &generation);
+    kiran_dbus_biometrics_complete_get_face_operation_state(skeleton,
+                                                            invocation,
+                                                            kiran_operation_state_to_string(state),
+                                                            generation);
+#else
+    kiran_biometrics_return_no_face(invocation);
+#endif /* HAVE_KIRAN_FACE */
+
+    return TRUE;
 }
 
 GQuark fprint_error_quark(void)
@@ -1353,5 +1550,42 @@ GType face_error_get_type(void)
 KiranBiometrics *
 kiran_biometrics_new()
 {
-    return g_object_new(KIRAN_TYPE_BIOMETRICS, NULL);
+    KiranBiometrics *kirBiometrics;
+    KiranDbusBiometrics *skeleton;
+
+    kirBiometrics = g_object_new(KIRAN_TYPE_BIOMETRICS, NULL);
+    skeleton = kirBiometrics->priv->skeleton;
+
+    g_signal_connect(skeleton, "handle-enroll-fprint-start",
+                     G_CALLBACK(kiran_biometrics_enroll_fprint_start), kirBiometrics);
+    g_signal_connect(skeleton, "handle-enroll-fprint-stop",
+                     G_CALLBACK(kiran_biometrics_enroll_fprint_stop), kirBiometrics);
+    g_signal_connect(skeleton, "handle-verify-fprint-start",
+                     G_CALLBACK(kiran_biometrics_verify_fprint_start), kirBiometrics);
+    g_signal_connect(skeleton, "handle-verify-fprint-start-for-ids",
+                     G_CALLBACK(kiran_biometrics_verify_fprint_start_for_ids), kirBiometrics);
+    g_signal_connect(skeleton, "handle-verify-fprint-stop",
+                     G_CALLBACK(kiran_biometrics_verify_fprint_stop), kirBiometrics);
+    g_signal_connect(skeleton, "handle-get-fprint-devices",
+                     G_CALLBACK(kiran_biometrics_get_fprint_devices), kirBiometrics);
+    g_signal_connect(skeleton, "handle-delete-enrolled-finger",
+                     G_CALLBACK(kiran_biometrics_delete_enrolled_finger), kirBiometrics);
+    g_signal_connect(skeleton, "handle-enroll-face-start",
+                     G_CALLBACK(kiran_biometrics_enroll_face_start), kirBiometrics);
+    g_signal_connect(skeleton, "handle-enroll-face-stop",
+                     G_CALLBACK(kiran_biometrics_enroll_face_stop), kirBiometrics);
+    g_signal_connect(skeleton, "handle-verify-face-start",
+                     G_CALLBACK(kiran_biometrics_verify_face_start), kirBiometrics);
+    g_signal_connect(skeleton, "handle-verify-face-stop",
+                     G_CALLBACK(kiran_biometrics_verify_face_stop), kirBiometrics);
+    g_signal_connect(skeleton, "handle-delete-enrolled-face",
+                     G_CALLBACK(kiran_biometrics_delete_enrolled_face), kirBiometrics);
+    g_signal_connect(skeleton, "handle-get-face-operation-state",
+                     G_CALLBACK(kiran_biometrics_get_face_operation_state), kirBiometrics);
+    g_signal_connect(skeleton, "handle-get-statistics",
+                     G_CALLBACK(kiran_biometrics_get_statistics), kirBiometrics);
+    g_signal_connect(skeleton, "g-authorize-method",
+                     G_CALLBACK(kiran_biometrics_authorize_method), kirBiometrics);
+
+    return kirBiometrics;
 }
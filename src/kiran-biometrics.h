@@ -15,7 +15,7 @@
 #ifndef __KIRAN_BIOMETRICS_H__
 #define __KIRAN_BIOMETRICS_H__
 
-#include <dbus/dbus-glib.h>
+#include <gio/gio.h>
 #include <glib.h>
 
 #define KIRAN_TYPE_BIOMETRICS (kiran_biometrics_get_type())
@@ -34,6 +34,11 @@ typedef struct _KiranBiometrics KiranBiometrics;
 typedef struct _KiranBiometricsClass KiranBiometricsClass;
 typedef struct _KiranBiometricsPrivate KiranBiometricsPrivate;
 
+//kiran_biometrics_get_caller_uid 的结果, 失败时 uid 为 G_MAXUINT32, 回调中要完成 invocation
+typedef void (*KiranBiometricsCallerUidFunc)(GDBusMethodInvocation *invocation,
+                                             guint32 uid,
+                                             gpointer user_data);
+
 struct _KiranBiometrics
 {
     GObject parent;
@@ -49,5 +54,25 @@ struct _KiranBiometricsClass
 GType kiran_biometrics_get_type();
 
 KiranBiometrics *kiran_biometrics_new();
+gboolean kiran_biometrics_register(KiranBiometrics *kirBiometrics,
+                                   GDBusConnection *connection,
+                                   const gchar *path,
+                                   GError **error);
+void kiran_biometrics_update_devices(KiranBiometrics *kirBiometrics);
+gboolean kiran_biometrics_is_idle(KiranBiometrics *kirBiometrics);
+gboolean kiran_biometrics_has_clients(KiranBiometrics *kirBiometrics);
+gint64 kiran_biometrics_get_last_active(KiranBiometrics *kirBiometrics);
+void kiran_biometrics_save_cache(KiranBiometrics *kirBiometrics);
+void kiran_biometrics_apply_settings(KiranBiometrics *kirBiometrics);
+void kiran_biometrics_set_face_idle_timeout(KiranBiometrics *kirBiometrics,
+                                            guint idle_timeout);
+void kiran_biometrics_get_caller_uid(GDBusMethodInvocation *invocation,
+                                     KiranBiometricsCallerUidFunc callback,
+                                     gpointer user_data);
+void kiran_biometrics_return_error(GDBusMethodInvocation *invocation,
+                                   const GError *error);
+
+GQuark fprint_error_quark(void);
+#define FPRINT_ERROR fprint_error_quark()
 
 #endif /* __KIRAN_BIOMETRICS_H__ */
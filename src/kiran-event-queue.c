@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#include "kiran-event-queue.h"
+
+/*
+ * 队列本身是一个 GSource:
+ * 生产者用CAS把事件压入 head 指向的单链表(后进先出), 然后唤醒主循环,
+ * 主循环一次取走整个链表, 反转后按先进先出的顺序分发
+ */
+struct _KiranEventQueue
+{
+    GSource source;
+
+    KiranEvent *head; /* 只通过原子操作访问 */
+    KiranEventFunc func;
+    gpointer user_data;
+};
+
+static gboolean
+kiran_event_queue_prepare(GSource *source,
+                          gint *timeout)
+{
+    KiranEventQueue *queue = (KiranEventQueue *)source;
+
+    *timeout = -1;
+
+    return g_atomic_pointer_get(&queue->head) != NULL;
+}
+
+static gboolean
+kiran_event_queue_check(GSource *source)
+{
+    KiranEventQueue *queue = (KiranEventQueue *)source;
+
+    return g_atomic_pointer_get(&queue->head) != NULL;
+}
+
+//取走队列中所有的事件, 按放入的顺序返回
+static KiranEvent *
+kiran_event_queue_steal(KiranEventQueue *queue)
+{
+    KiranEvent *list;
+    KiranEvent *fifo = NULL;
+
+    do
+    {
+        list = g_atomic_pointer_get(&queue->head);
+    } while (!g_atomic_pointer_compare_and_exchange(&queue->head, list, NULL));
+
+    while (list)
+    {
+        KiranEvent *next = list->next;
+
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+
+    return fifo;
+}
+
+static gboolean
+kiran_event_queue_dispatch(GSource *source,
+                           GSourceFunc callback,
+                           gpointer user_data)
+{
+    KiranEventQueue *queue = (KiranEventQueue *)source;
+    KiranEvent *event;
+
+    event = kiran_event_queue_steal(queue);
+    while (event)
+    {
+        KiranEvent *next = event->next;
+
+        queue->func(event, queue->user_data);
+        kiran_event_free(event);
+        event = next;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+kiran_event_queue_finalize(GSource *source)
+{
+    KiranEventQueue *queue = (KiranEventQueue *)source;
+    KiranEvent *event;
+
+    //没有分发的事件直接丢弃
+    event = kiran_event_queue_steal(queue);
+    while (event)
+    {
+        KiranEvent *next = event->next;
+
+        kiran_event_free(event);
+        event = next;
+    }
+}
+
+static GSourceFuncs kiran_event_queue_funcs = {
+    kiran_event_queue_prepare,
+    kiran_event_queue_check,
+    kiran_event_queue_dispatch,
+    kiran_event_queue_finalize,
+};
+
+KiranEvent *
+kiran_event_new(guint type,
+                const gchar *msg,
+                const gchar *id)
+{
+    KiranEvent *event;
+
+    event = g_slice_new0(KiranEvent);
+    event->type = type;
+    event->msg = g_strdup(msg);
+    event->id = g_strdup(id);
+
+    return event;
+}
+
+void
+kiran_event_free(KiranEvent *event)
+{
+    g_free(event->msg);
+    g_free(event->id);
+    if (event->destroy)
+        event->destroy(event->data);
+    g_slice_free(KiranEvent, event);
+}
+
+/*
+ * 创建事件队列, func 在 context 所在的线程中调用
+ */
+KiranEventQueue *
+kiran_event_queue_new(GMainContext *context,
+                      KiranEventFunc func,
+                      gpointer user_data)
+{
+    GSource *source;
+    KiranEventQueue *queue;
+
+    source = g_source_new(&kiran_event_queue_funcs, sizeof(KiranEventQueue));
+    g_source_set_name(source, "KiranEventQueue");
+
+    queue = (KiranEventQueue *)source;
+    queue->head = NULL;
+    queue->func = func;
+    queue->user_data = user_data;
+
+    g_source_attach(source, context);
+
+    return queue;
+}
+
+/*
+ * 销毁队列, 调用前所有生产者线程必须已经结束
+ */
+void
+kiran_event_queue_free(KiranEventQueue *queue)
+{
+    GSource *source = (GSource *)queue;
+
+    g_source_destroy(source);
+    g_source_unref(source);
+}
+
+/*
+ * 放入一个事件, 可以在任意线程中调用, 队列接管事件
+ */
+void
+kiran_event_queue_push(KiranEventQueue *queue,
+                       KiranEvent *event)
+{
+    KiranEvent *head;
+
+    do
+    {
+        head = g_atomic_pointer_get(&queue->head);
+        event->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&queue->head, head, event));
+
+    g_main_context_wakeup(g_source_get_context((GSource *)queue));
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifndef __KIRAN_EVENT_QUEUE_H__
+#define __KIRAN_EVENT_QUEUE_H__
+
+#include <glib.h>
+
+/*
+ * 操作线程产生的状态事件队列
+ *
+ * 操作线程用 kiran_event_queue_push 放入事件, 不加锁,
+ * 事件在队列所属的 GMainContext 中按放入的顺序逐个交给回调处理,
+ * 信号和总线消息因此都只在主循环中发出
+ */
+
+typedef struct _KiranEvent KiranEvent;
+typedef struct _KiranEventQueue KiranEventQueue;
+
+struct _KiranEvent
+{
+    KiranEvent *next;
+
+    guint type;     /* 事件类型, 由使用者定义 */
+    gchar *msg;     /* 提示信息 */
+    gchar *id;      /* 模板ID */
+    gint progress;  /* 录入进度 */
+    gint quality;   /* 人脸质量 */
+    gboolean done;  /* 操作是否结束 */
+    gboolean found; /* 是否匹配 */
+
+    gpointer data;          /* 使用者自定义数据 */
+    GDestroyNotify destroy; /* 释放事件时用来释放 data */
+};
+
+typedef void (*KiranEventFunc)(KiranEvent *event,
+                               gpointer user_data);
+
+KiranEvent *kiran_event_new(guint type,
+                            const gchar *msg,
+                            const gchar *id);
+void kiran_event_free(KiranEvent *event);
+
+KiranEventQueue *kiran_event_queue_new(GMainContext *context,
+                                       KiranEventFunc func,
+                                       gpointer user_data);
+void kiran_event_queue_free(KiranEventQueue *queue);
+void kiran_event_queue_push(KiranEventQueue *queue,
+                            KiranEvent *event);
+
+#endif /* __KIRAN_EVENT_QUEUE_H__ */
@@ -21,16 +21,13 @@
 #include "config.h"
 #include "kiran-biometrics-types.h"
 #include "kiran-face-manager.h"
+#include "kiran-biometrics-trace.h"
 #include "kiran-face-msg.h"
+#include "kiran-settings.h"
+#include "kiran-stats.h"
 
 #define FACE_CAS_FILE "/usr/share/OpenCV/haarcascades/haarcascade_frontalface_default.xml"
 #define EYE_CAS_FILE "/usr/share/OpenCV/haarcascades/haarcascade_eye_tree_eyeglasses.xml"
-#define DEFAULT_ZMQ_ADDR "/tmp/KiranFaceService.ipc"
-#define ENROLL_FACE_NUM 10
-
-#define FACE_ZMQ_ADDR "ipc:///tmp/KiranFaceCompareService.ipc"
-
-#define FACE_SIZE 160
 
 enum
 {
@@ -60,6 +57,8 @@ struct _KiranFaceManagerPrivate
     gboolean do_enroll;
     gboolean do_verify;
     gint enroll_face_count;
+    gint enroll_face_num; /* 开始操作时从配置中读取 */
+    gint face_size;
 
     GThread *face_thread;
     GList *enroll_images;
@@ -92,16 +91,34 @@ kiran_face_manager_finalize(GObject *object)
 {
     KiranFaceManager *manager;
     KiranFaceManagerPrivate *priv;
+    int linger = 0;
 
     manager = KIRAN_FACE_MANAGER(object);
     priv = manager->priv;
 
+    //通知检测线程和人脸处理线程退出, 人脸模块空闲释放时不能留下线程
+    g_mutex_lock(&priv->mutex);
+    priv->detect = FALSE;
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->mutex);
+    g_thread_join(priv->detect_thread);
+
+    g_mutex_lock(&priv->face_mutex);
+    g_cond_broadcast(&priv->face_cond);
+    g_mutex_unlock(&priv->face_mutex);
+    g_thread_join(priv->face_thread);
+
     if (priv->camera)
+    {
+        gcv_video_capture_release(GCV_VIDEO_CAPTURE(priv->camera));
         g_object_unref(priv->camera);
+    }
 
     priv->camera = NULL;
-    g_object_unref(priv->face_cas);
-    g_object_unref(priv->eye_cas);
+    g_clear_object(&priv->face_cas);
+    g_clear_object(&priv->eye_cas);
+    g_list_free_full(priv->enroll_images, g_object_unref);
+    g_free(priv->id);
 
     g_mutex_clear(&priv->mutex);
     g_cond_clear(&priv->cond);
@@ -110,6 +127,9 @@ kiran_face_manager_finalize(GObject *object)
     g_cond_clear(&priv->face_cond);
 
     g_free(priv->addr);
+    //不等待未发出的消息, 否则比对服务不在时 zmq_ctx_term 会一直阻塞
+    zmq_setsockopt(priv->service, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_setsockopt(priv->client, ZMQ_LINGER, &linger, sizeof(linger));
     zmq_close(priv->service);
     zmq_close(priv->client);
     zmq_ctx_term(priv->ctx);
@@ -277,14 +297,23 @@ do_face_detect(gpointer data)
     KiranFaceManagerPrivate *priv = manager->priv;
     GList *faces;
     GList *eyes;
+    gint64 start;
 
+    g_mutex_lock(&priv->mutex);
     while (priv->detect)
     {
-        g_mutex_lock(&priv->mutex);
         g_cond_wait(&priv->cond, &priv->mutex);
 
+        //释放时唤醒线程退出, 或者没有图像的虚假唤醒
+        if (priv->detect_image == NULL)
+            continue;
+
+        KIRAN_TRACE(detect__start);
+        start = g_get_monotonic_time();
         faces = gcv_cascade_classifier_detect(priv->face_cas, priv->detect_image);
         eyes = gcv_cascade_classifier_detect(priv->eye_cas, priv->detect_image);
+        kiran_stats_record(KIRAN_STATS_FACE_DETECT, start, faces != NULL);
+        KIRAN_TRACE2(detect__done, g_list_length(faces), g_list_length(eyes));
 
         send_faces_axis(manager, faces);
 
@@ -304,13 +333,13 @@ do_face_detect(gpointer data)
         }
 
         g_object_unref(priv->detect_image);
+        priv->detect_image = NULL;
         g_list_free_full(faces, g_object_unref);
         g_list_free_full(eyes, g_object_unref);
-
-        g_mutex_unlock(&priv->mutex);
     }
+    g_mutex_unlock(&priv->mutex);
 
-    g_thread_exit(0);
+    return NULL;
 }
 
 static int
@@ -441,6 +470,8 @@ face_compare(KiranFaceManager *manager,
     memcpy(compare->content, data1, len1);
     memcpy(compare->content + len1, data2, len2);
 
+    KIRAN_TRACE1(compare__start, total_len);
+
     ret = zmq_send(priv->client, (unsigned char *)compare, total_len, ZMQ_DONTWAIT);
     g_message("send to face compare service[%x, %d, %d, %d, %d] %d\n", channel, compare->type, width1, height1, len1, ret);
 
@@ -457,6 +488,8 @@ face_compare(KiranFaceManager *manager,
     else
         ret = FACE_RESULT_FAIL;
 
+    KIRAN_TRACE1(compare__done, ret);
+
     g_bytes_unref(bytes1);
     g_bytes_unref(bytes2);
     g_free(compare);
@@ -500,7 +533,12 @@ face_verify(KiranFaceManager *manager)
                                    GCV_IMAGE_READ_FLAG_UNCHANGED,
                                    NULL);
             if (image)
+            {
+                gint64 start = g_get_monotonic_time();
+
                 ret = face_compare(manager, priv->face, image);
+                kiran_stats_record(KIRAN_STATS_FACE_COMPARE, start, ret == FACE_RESULT_OK);
+            }
 
             g_object_unref(image);
         }
@@ -520,11 +558,12 @@ face_verify(KiranFaceManager *manager)
 }
 
 static int
-face_quality(GCVImage *face)
+face_quality(GCVImage *face,
+             int face_size)
 {
     int width;
-    int big_size = FACE_SIZE + 100;
-    int small_size = FACE_SIZE - 10;
+    int big_size = face_size + 100;
+    int small_size = face_size - 10;
 
     width = gcv_matrix_get_n_columns(GCV_MATRIX(face));
 
@@ -544,14 +583,17 @@ do_face_handle(gpointer data)
     KiranFaceManagerPrivate *priv = manager->priv;
     int ret = 0;
 
+    g_mutex_lock(&priv->face_mutex);
     while (priv->detect)
     {
-        g_mutex_lock(&priv->face_mutex);
         g_cond_wait(&priv->face_cond, &priv->face_mutex);
 
+        if (priv->face == NULL)
+            continue;
+
         if (priv->do_enroll)
         {
-            ret = face_quality(priv->face);
+            ret = face_quality(priv->face, priv->face_size);
             if (ret == FACE_BIG)
             {
                 g_signal_emit(manager,
@@ -565,7 +607,7 @@ do_face_handle(gpointer data)
                               -1, "", priv->enroll_face_count * 10);
             }
 
-            if (priv->enroll_face_count < ENROLL_FACE_NUM && ret == FACE_OK)
+            if (priv->enroll_face_count < priv->enroll_face_num && ret == FACE_OK)
             {
                 //采集人脸
                 priv->enroll_images = g_list_append(priv->enroll_images, g_object_ref(priv->face));
@@ -575,7 +617,7 @@ do_face_handle(gpointer data)
                 priv->enroll_face_count++;
             }
 
-            if (priv->enroll_face_count == ENROLL_FACE_NUM)
+            if (priv->enroll_face_count == priv->enroll_face_num)
             {
                 gchar *id = NULL;
                 //完成采集
@@ -624,21 +666,24 @@ do_face_handle(gpointer data)
         }
 
         g_object_unref(priv->face);
-        g_mutex_unlock(&priv->face_mutex);
+        priv->face = NULL;
     }
+    g_mutex_unlock(&priv->face_mutex);
 
-    g_thread_exit(0);
+    return NULL;
 }
 
 static void
 kiran_face_manager_init(KiranFaceManager *self)
 {
     KiranFaceManagerPrivate *priv;
+    KiranSettings *settings;
     GError *error;
     int ret = 0;
     int timeout = 30000;
 
     priv = self->priv = KIRAN_FACE_MANAGER_GET_PRIVATE(self);
+    settings = kiran_settings_get();
     priv->camera = NULL;
     error = NULL;
     priv->face_cas = gcv_cascade_classifier_new(FACE_CAS_FILE, &error);
@@ -659,6 +704,8 @@ kiran_face_manager_init(KiranFaceManager *self)
     priv->do_enroll = FALSE;
     priv->do_verify = FALSE;
     priv->enroll_face_count = 0;
+    priv->enroll_face_num = settings->enroll_face_num;
+    priv->face_size = settings->face_size;
 
     g_mutex_init(&priv->mutex);
     g_cond_init(&priv->cond);
@@ -675,7 +722,8 @@ kiran_face_manager_init(KiranFaceManager *self)
                                      do_face_handle,
                                      self);
 
-    priv->addr = g_strdup_printf("ipc://%s", DEFAULT_ZMQ_ADDR);
+    //ZMQ地址在创建时确定, 修改后在人脸模块下一次创建时生效
+    priv->addr = g_strdup_printf("ipc://%s", settings->face_service_path);
     priv->ctx = zmq_ctx_new();
     priv->service = zmq_socket(priv->ctx, ZMQ_PUB);
     ret = zmq_bind(priv->service, priv->addr);
@@ -684,28 +732,36 @@ kiran_face_manager_init(KiranFaceManager *self)
         dzlog_debug("zmq bind  %s failed!\n", priv->addr);
     }
 
-    chmod(DEFAULT_ZMQ_ADDR, 0666);  //修改权限使得普通用户可以读
+    chmod(settings->face_service_path, 0666);  //修改权限使得普通用户可以读
 
     priv->client = zmq_socket(priv->ctx, ZMQ_REQ);
-    ret = zmq_connect(priv->client, FACE_ZMQ_ADDR);
+    ret = zmq_connect(priv->client, settings->compare_service);
     if (ret != 0)
     {
-        dzlog_debug("zmq coennt %s failed!\n", FACE_ZMQ_ADDR);
-        g_message("zmq connect  %s failed!\n", FACE_ZMQ_ADDR);
+        dzlog_debug("zmq coennt %s failed!\n", settings->compare_service);
+        g_message("zmq connect  %s failed!\n", settings->compare_service);
     }
     zmq_setsockopt(priv->client, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
 
     priv->id = NULL;
+    kiran_settings_unref(settings);
 }
 
 int kiran_face_manager_start(KiranFaceManager *kfamanager)
 {
     KiranFaceManagerPrivate *priv = kfamanager->priv;
+    KiranSettings *settings;
     GError *error = NULL;
 
     if (priv->camera)
         return FACE_RESULT_FAIL;
 
+    //重新加载的配置从下一次操作开始生效
+    settings = kiran_settings_get();
+    priv->enroll_face_num = settings->enroll_face_num;
+    priv->face_size = settings->face_size;
+    kiran_settings_unref(settings);
+
     priv->camera = gcv_camera_new(&error);
 
     if (error)
@@ -849,7 +905,9 @@ int kiran_face_manager_capture_face(KiranFaceManager *kfamanager)
     if (!priv->camera)
         return FACE_RESULT_FAIL;
 
+    KIRAN_TRACE(capture__start);
     image = gcv_video_capture_read(GCV_VIDEO_CAPTURE(priv->camera));
+    KIRAN_TRACE1(capture__done, image != NULL);
     if (image)
     {
         GCVImage *area_img = face_area_image(image);
@@ -925,7 +983,7 @@ int kiran_face_manager_stop(KiranFaceManager *kfamanager)
 
     gcv_video_capture_release(GCV_VIDEO_CAPTURE(priv->camera));
 
-    g_object_ref(priv->camera);
+    g_object_unref(priv->camera);
     priv->camera = NULL;
 
     return FACE_RESULT_OK;
@@ -0,0 +1,711 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#include <stdlib.h>
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-biometrics-trace.h"
+#include "kiran-biometrics-types.h"
+#include "kiran-fprint-device.h"
+
+#define FPRINT_IDLE_TIMEOUT 60 /* 设备空闲多少秒后关闭 */
+
+struct _KiranFprintDevicePrivate
+{
+    KiranFprintModule *module;
+    int index; /* 设备在模块中的序号 */
+    gpointer hDevice;
+    KiranFprintMatcher *matcher;
+    unsigned int flags; /* 设备打开时从模块能力中获取 */
+
+    GMutex mutex;
+    int users;          /* 正在使用设备的操作数 */
+    guint idle_timeout; /* 设备空闲多少秒后关闭 */
+    guint idle_id;      /* 空闲关闭定时器 */
+    gboolean cancelled; /* 当前操作已被停止, 由 priv->mutex 保护 */
+    gboolean calling;   /* 正在执行可以被停止的模块调用, 由 priv->mutex 保护 */
+};
+
+#define KIRAN_FPRINT_DEVICE_GET_PRIVATE(O) \
+    (G_TYPE_INSTANCE_GET_PRIVATE((O), KIRAN_TYPE_FPRINT_DEVICE, KiranFprintDevicePrivate))
+
+G_DEFINE_TYPE(KiranFprintDevice, kiran_fprint_device, G_TYPE_OBJECT);
+
+static void kiran_fprint_device_close_device(KiranFprintDevice *device);
+
+static void
+kiran_fprint_device_finalize(GObject *object)
+{
+    KiranFprintDevice *device;
+    KiranFprintDevicePrivate *priv;
+
+    device = KIRAN_FPRINT_DEVICE(object);
+    priv = device->priv;
+
+    if (priv->idle_id)
+        g_source_remove(priv->idle_id);
+    kiran_fprint_device_close_device(device);
+    g_mutex_clear(&priv->mutex);
+
+    g_object_unref(priv->module);
+    g_object_unref(priv->matcher);
+
+    G_OBJECT_CLASS(kiran_fprint_device_parent_class)->finalize(object);
+}
+
+static void
+kiran_fprint_device_class_init(KiranFprintDeviceClass *class)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+    object_class->finalize = kiran_fprint_device_finalize;
+
+    g_type_class_add_private(class, sizeof(KiranFprintDevicePrivate));
+}
+
+static void
+kiran_fprint_device_init(KiranFprintDevice *self)
+{
+    KiranFprintDevicePrivate *priv;
+
+    priv = self->priv = KIRAN_FPRINT_DEVICE_GET_PRIVATE(self);
+    priv->module = NULL;
+    priv->index = 0;
+    priv->hDevice = NULL;
+    priv->matcher = NULL;
+    priv->flags = 0;
+    g_mutex_init(&priv->mutex);
+    priv->users = 0;
+    priv->idle_timeout = FPRINT_IDLE_TIMEOUT;
+    priv->idle_id = 0;
+    priv->cancelled = FALSE;
+    priv->calling = FALSE;
+}
+
+/* 关闭设备并释放模块资源, 调用时需持有 priv->mutex */
+static void
+kiran_fprint_device_close_device(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+
+    if (priv->hDevice == NULL)
+        return;
+
+    module->fprint_close_device(priv->hDevice);
+    priv->hDevice = NULL;
+    kiran_fprint_module_init_unref(module);
+    g_type_module_unuse(G_TYPE_MODULE(module));
+
+    dzlog_debug("fprint device %s:%d closed", module->path, priv->index);
+}
+
+/* 打开设备, 调用时需持有 priv->mutex */
+static int
+kiran_fprint_device_open_device(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    int ret;
+
+    if (!g_type_module_use(G_TYPE_MODULE(module)))
+        return FPRINT_RESULT_FAIL;
+
+    if (kiran_fprint_module_init_ref(module) != FPRINT_RESULT_OK)
+    {
+        g_type_module_unuse(G_TYPE_MODULE(module));
+        return FPRINT_RESULT_FAIL;
+    }
+
+    //设备被拔出后序号可能已经不存在
+    if (module->fprint_get_dev_count() <= priv->index)
+        ret = FPRINT_RESULT_NO_DEVICE;
+    else if ((priv->hDevice = module->fprint_open_device(priv->index)) == NULL)
+        ret = FPRINT_RESULT_OPEN_DEVICE_FAIL;
+    else
+        ret = FPRINT_RESULT_OK;
+
+    if (ret != FPRINT_RESULT_OK)
+    {
+        kiran_fprint_module_init_unref(module);
+        g_type_module_unuse(G_TYPE_MODULE(module));
+        return ret;
+    }
+
+    priv->flags = module->caps.flags;
+    dzlog_debug("fprint device %s:%d opened", module->path, priv->index);
+
+    return FPRINT_RESULT_OK;
+}
+
+static gboolean
+kiran_fprint_device_idle_close(gpointer user_data)
+{
+    KiranFprintDevice *device = KIRAN_FPRINT_DEVICE(user_data);
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    g_mutex_lock(&priv->mutex);
+
+    priv->idle_id = 0;
+    if (priv->users == 0)
+        kiran_fprint_device_close_device(device);
+
+    g_mutex_unlock(&priv->mutex);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * 开始使用设备, 设备已经打开时直接返回
+ * 每次调用都需要对应一次 kiran_fprint_device_close
+ */
+int kiran_fprint_device_open(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    int ret = FPRINT_RESULT_OK;
+
+    g_mutex_lock(&priv->mutex);
+
+    if (priv->idle_id)
+    {
+        g_source_remove(priv->idle_id);
+        priv->idle_id = 0;
+    }
+
+    if (priv->hDevice == NULL)
+        ret = kiran_fprint_device_open_device(device);
+
+    if (ret == FPRINT_RESULT_OK)
+        priv->users++;
+
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+
+/*
+ * 结束使用设备, 设备在空闲 idle_timeout 秒后才真正关闭,
+ * 连续的认证不需要重新初始化指纹SDK
+ */
+int kiran_fprint_device_close(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    g_mutex_lock(&priv->mutex);
+
+    if (priv->users > 0)
+        priv->users--;
+
+    if (priv->users == 0 && priv->idle_id == 0)
+    {
+        if (priv->idle_timeout == 0)
+            kiran_fprint_device_close_device(device);
+        else
+            priv->idle_id = g_timeout_add_seconds(priv->idle_timeout,
+                                                  kiran_fprint_device_idle_close,
+                                                  device);
+    }
+
+    g_mutex_unlock(&priv->mutex);
+
+    return FPRINT_RESULT_OK;
+}
+
+/*
+ * 设置设备空闲多长时间后关闭, 单位为秒, 0表示使用完立即关闭
+ */
+void kiran_fprint_device_set_idle_timeout(KiranFprintDevice *device,
+                                          guint idle_timeout)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    g_mutex_lock(&priv->mutex);
+    priv->idle_timeout = idle_timeout;
+    g_mutex_unlock(&priv->mutex);
+}
+
+/*
+ * 设备被拔出后, 关闭旧的句柄并重新打开
+ */
+static int
+kiran_fprint_device_reopen(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    int ret;
+
+    g_mutex_lock(&priv->mutex);
+
+    dzlog_info("fprint device %s:%d lost, reopen it", priv->module->path, priv->index);
+    kiran_fprint_device_close_device(device);
+    ret = kiran_fprint_device_open_device(device);
+
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+
+/*
+ * 开始一次可以被停止的采集或认证调用, 返回本次调用使用的设备句柄
+ * 操作已被停止或设备没有打开时返回 NULL, 重新打开设备后重试前也要调用
+ */
+static gpointer
+kiran_fprint_device_begin_call(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    gpointer hDevice = NULL;
+
+    g_mutex_lock(&priv->mutex);
+    if (!priv->cancelled && priv->hDevice)
+    {
+        priv->calling = TRUE;
+        hDevice = priv->hDevice;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    return hDevice;
+}
+
+static void
+kiran_fprint_device_end_call(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    g_mutex_lock(&priv->mutex);
+    priv->calling = FALSE;
+    g_mutex_unlock(&priv->mutex);
+}
+
+KiranFprintModule *
+kiran_fprint_device_get_module(KiranFprintDevice *device)
+{
+    return device->priv->module;
+}
+
+int kiran_fprint_device_get_index(KiranFprintDevice *device)
+{
+    return device->priv->index;
+}
+
+const gchar *
+kiran_fprint_device_get_module_path(KiranFprintDevice *device)
+{
+    return device->priv->module->path;
+}
+
+/*
+ * 设备是否具有某种能力, flags 为 KiranFprintCapFlags 的组合
+ */
+gboolean
+kiran_fprint_device_has_capabilities(KiranFprintDevice *device,
+                                     unsigned int flags)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    return priv->hDevice && (priv->flags & flags) == flags;
+}
+
+/*
+ * 归还采集或合并得到的指纹模板
+ * 模板缓冲区都由 malloc 分配, 设备在此期间被重新打开或已关闭时直接释放也是安全的
+ */
+void kiran_fprint_device_template_free(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+
+    if (fpTemplate == NULL)
+        return;
+
+    if (module->fprint_template_free && priv->hDevice)
+        module->fprint_template_free(priv->hDevice, fpTemplate);
+    else
+        free(fpTemplate);
+}
+
+/*
+ * 设置设备的运行参数, 指纹模块不支持时返回 FPRINT_RESULT_UNSUPPORT
+ */
+int kiran_fprint_device_set_parameter(KiranFprintDevice *device,
+                                      const char *name,
+                                      int value)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    int ret;
+
+    if (priv->hDevice == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    if (module->fprint_set_parameter == NULL)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    ret = module->fprint_set_parameter(priv->hDevice, name, value);
+    if (ret != FPRINT_RESULT_OK && ret != FPRINT_RESULT_UNSUPPORT)
+        dzlog_warn("set fprint parameter %s to %d failed: %d", name, value, ret);
+
+    return ret;
+}
+
+int kiran_fprint_device_acquire_finger_print(KiranFprintDevice *device,
+                                             unsigned char **fpTemplate,
+                                             unsigned int *cbTemplate,
+                                             unsigned int timeout)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    gpointer hDevice;
+    int ret;
+
+    if ((hDevice = kiran_fprint_device_begin_call(device)) == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    KIRAN_TRACE1(acquire__start, priv->index);
+
+    ret = module->fprint_acquire_finger_print(hDevice,
+                                              fpTemplate,
+                                              cbTemplate,
+                                              timeout);
+    kiran_fprint_device_end_call(device);
+
+    //重新打开的设备是新的句柄, 重新打开期间收到的停止要在重试前检查
+    if (ret == FPRINT_RESULT_NO_DEVICE &&
+        kiran_fprint_device_reopen(device) == FPRINT_RESULT_OK &&
+        (hDevice = kiran_fprint_device_begin_call(device)) != NULL)
+    {
+        ret = module->fprint_acquire_finger_print(hDevice,
+                                                  fpTemplate,
+                                                  cbTemplate,
+                                                  timeout);
+        kiran_fprint_device_end_call(device);
+    }
+
+    if (ret == FPRINT_RESULT_OK &&
+        module->caps.max_template_size > 0 &&
+        *cbTemplate > module->caps.max_template_size)
+    {
+        g_warning("fingerprint template too large: %u", *cbTemplate);
+        kiran_fprint_device_template_free(device, *fpTemplate);
+        *fpTemplate = NULL;
+        *cbTemplate = 0;
+        ret = FPRINT_RESULT_FAIL;
+    }
+
+    KIRAN_TRACE2(acquire__done, ret, ret == FPRINT_RESULT_OK ? *cbTemplate : 0);
+
+    return ret;
+}
+
+/*
+ * 停止当前操作, 可以在其它线程中调用
+ * 只在模块调用进行中时通知模块, 之后开始的调用直接返回失败, 直到 kiran_fprint_device_reset_stop
+ */
+void kiran_fprint_device_acquire_finger_print_stop(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+
+    g_mutex_lock(&priv->mutex);
+    priv->cancelled = TRUE;
+    if (priv->calling && module->fprint_acquire_finger_print_stop && priv->hDevice)
+        module->fprint_acquire_finger_print_stop(priv->hDevice);
+    g_mutex_unlock(&priv->mutex);
+}
+
+//清除之前操作的停止状态, 在工作线程开始一个新操作时调用
+void kiran_fprint_device_reset_stop(KiranFprintDevice *device)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+
+    g_mutex_lock(&priv->mutex);
+    priv->cancelled = FALSE;
+    g_mutex_unlock(&priv->mutex);
+}
+
+/*
+ * 告诉指纹模块接下来比对的模板库序号, 模块可以据此保留算法缓冲区中已加载的模板
+ * 模块不支持时忽略
+ */
+static void
+kiran_fprint_device_set_gallery_serial(KiranFprintDevice *device,
+                                       gpointer hDevice,
+                                       int serial)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+
+    if (module->fprint_set_parameter)
+        module->fprint_set_parameter(hDevice,
+                                     KIRAN_FPRINT_PARAM_GALLERY_SERIAL,
+                                     serial);
+}
+
+/*
+ * 采集指纹并在模板库中查找, serial 为模板库快照序号
+ * 只包含部分模板的快照(serial 为0)不使用模块内部接口, 避免替换模块中缓存的整个模板库
+ */
+int kiran_fprint_device_verify_finger_print(KiranFprintDevice *device,
+                                            unsigned char **fpTemplate,
+                                            unsigned int *cbTemplate,
+                                            unsigned int *number,
+                                            int serial,
+                                            unsigned int timeout)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    gpointer hDevice;
+    int ret;
+
+    if (priv->hDevice == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    if (!(priv->flags & KIRAN_FPRINT_CAP_IDENTIFY) || serial == 0)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    if ((hDevice = kiran_fprint_device_begin_call(device)) == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    KIRAN_TRACE2(identify__start, priv->index, *number);
+
+    kiran_fprint_device_set_gallery_serial(device, hDevice, serial);
+
+    ret = module->fprint_verify_finger_print(hDevice,
+                                             fpTemplate,
+                                             cbTemplate,
+                                             number,
+                                             timeout);
+    kiran_fprint_device_end_call(device);
+
+    if (ret == FPRINT_RESULT_NO_DEVICE &&
+        kiran_fprint_device_reopen(device) == FPRINT_RESULT_OK &&
+        (hDevice = kiran_fprint_device_begin_call(device)) != NULL)
+    {
+        kiran_fprint_device_set_gallery_serial(device, hDevice, serial);
+        ret = module->fprint_verify_finger_print(hDevice,
+                                                 fpTemplate,
+                                                 cbTemplate,
+                                                 number,
+                                                 timeout);
+        kiran_fprint_device_end_call(device);
+    }
+
+    //没有能力描述的旧模块, 第一次返回不支持后不再调用
+    if (ret == FPRINT_RESULT_UNSUPPORT && module->fprint_get_capabilities == NULL)
+        priv->flags &= ~KIRAN_FPRINT_CAP_IDENTIFY;
+
+    KIRAN_TRACE2(identify__done, ret, *number);
+
+    return ret;
+}
+
+int kiran_fprint_device_template_merge(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate1,
+                                       unsigned char *fpTemplate2,
+                                       unsigned char *fpTemplate3,
+                                       unsigned char **regTemplate,
+                                       unsigned int *cbRegTemplate)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    int ret;
+
+    if (priv->hDevice == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    if (!(priv->flags & KIRAN_FPRINT_CAP_MERGE))
+        return FPRINT_RESULT_UNSUPPORT;
+
+    KIRAN_TRACE1(merge__start, priv->index);
+
+    ret = module->fprint_template_merge(priv->hDevice,
+                                        fpTemplate1,
+                                        fpTemplate2,
+                                        fpTemplate3,
+                                        regTemplate,
+                                        cbRegTemplate);
+
+    KIRAN_TRACE1(merge__done, ret);
+
+    return ret;
+}
+
+int kiran_fprint_device_template_match(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate1,
+                                       unsigned int cbfpTemplate1,
+                                       unsigned char *fpTemplate2,
+                                       unsigned int cbfpTemplate2)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    int ret;
+
+    if (priv->hDevice == NULL)
+        return FPRINT_RESULT_FAIL;
+
+    if (module->fprint_template_match == NULL)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    KIRAN_TRACE1(match__start, priv->index);
+
+    ret = module->fprint_template_match(priv->hDevice,
+                                        fpTemplate1,
+                                        cbfpTemplate1,
+                                        fpTemplate2,
+                                        cbfpTemplate2);
+
+    KIRAN_TRACE1(match__done, ret);
+
+    return ret;
+}
+
+static int
+kiran_fprint_device_match_func(gpointer user_data,
+                               unsigned char *fpTemplate1,
+                               unsigned int cbfpTemplate1,
+                               unsigned char *fpTemplate2,
+                               unsigned int cbfpTemplate2)
+{
+    KiranFprintDevicePrivate *priv = user_data;
+
+    return priv->module->fprint_template_match(priv->hDevice,
+                                               fpTemplate1,
+                                               cbfpTemplate1,
+                                               fpTemplate2,
+                                               cbfpTemplate2);
+}
+
+static int
+kiran_fprint_device_do_template_search(KiranFprintDevice *device,
+                                       unsigned char *probe,
+                                       unsigned int cbProbe,
+                                       unsigned char **fpTemplates,
+                                       unsigned int *cbTemplates,
+                                       int number,
+                                       int serial,
+                                       int *index)
+{
+    KiranFprintDevicePrivate *priv = device->priv;
+    KiranFprintModule *module = priv->module;
+    int i;
+
+    if (priv->hDevice == NULL || number <= 0)
+        return FPRINT_RESULT_FAIL;
+
+    //部分模板优先逐个比对, 模块没有比对接口时才使用批量比对
+    if ((priv->flags & KIRAN_FPRINT_CAP_BATCH_MATCH) &&
+        (serial != 0 || module->fprint_template_match == NULL))
+    {
+        int ret;
+
+        kiran_fprint_device_set_gallery_serial(device, priv->hDevice, serial);
+        ret = module->fprint_template_match_batch(priv->hDevice,
+                                                  probe,
+                                                  cbProbe,
+                                                  fpTemplates,
+                                                  cbTemplates,
+                                                  number,
+                                                  index,
+                                                  NULL);
+        if (ret != FPRINT_RESULT_UNSUPPORT)
+        {
+            if (ret == FPRINT_RESULT_OK && (*index < 0 || *index >= number))
+                ret = FPRINT_RESULT_FAIL;
+
+            return ret;
+        }
+    }
+
+    if (module->fprint_template_match == NULL)
+        return FPRINT_RESULT_UNSUPPORT;
+
+    if (priv->flags & KIRAN_FPRINT_CAP_REENTRANT_MATCH)
+        return kiran_fprint_matcher_search(priv->matcher,
+                                           kiran_fprint_device_match_func,
+                                           priv,
+                                           probe,
+                                           cbProbe,
+                                           fpTemplates,
+                                           cbTemplates,
+                                           number,
+                                           index);
+
+    for (i = 0; i < number; i++)
+    {
+        if (kiran_fprint_device_match_func(priv,
+                                           probe,
+                                           cbProbe,
+                                           fpTemplates[i],
+                                           cbTemplates[i]) == FPRINT_RESULT_OK)
+        {
+            *index = i;
+            return FPRINT_RESULT_OK;
+        }
+    }
+
+    return FPRINT_RESULT_FAIL;
+}
+
+/*
+ * 在 fpTemplates 中查找和 probe 匹配的模板, 找到时通过 index 返回下标
+ * serial 为模板库快照序号, 只包含部分模板时为0
+ * 整个模板库优先使用模块的批量比对接口, 其次在模块声明比对接口可重入时在多个线程中并行比对
+ */
+int kiran_fprint_device_template_search(KiranFprintDevice *device,
+                                        unsigned char *probe,
+                                        unsigned int cbProbe,
+                                        unsigned char **fpTemplates,
+                                        unsigned int *cbTemplates,
+                                        int number,
+                                        int serial,
+                                        int *index)
+{
+    int ret;
+
+    KIRAN_TRACE2(search__start, device->priv->index, number);
+
+    ret = kiran_fprint_device_do_template_search(device,
+                                                 probe,
+                                                 cbProbe,
+                                                 fpTemplates,
+                                                 cbTemplates,
+                                                 number,
+                                                 serial,
+                                                 index);
+
+    KIRAN_TRACE2(search__done, ret, ret == FPRINT_RESULT_OK ? *index : -1);
+
+    return ret;
+}
+
+KiranFprintDevice *
+kiran_fprint_device_new(KiranFprintModule *module,
+                        int index,
+                        KiranFprintMatcher *matcher)
+{
+    KiranFprintDevice *device;
+    KiranFprintDevicePrivate *priv;
+
+    device = g_object_new(KIRAN_TYPE_FPRINT_DEVICE, NULL);
+    priv = device->priv;
+
+    priv->module = g_object_ref(module);
+    priv->index = index;
+    priv->matcher = g_object_ref(matcher);
+
+    return device;
+}
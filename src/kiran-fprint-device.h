@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_FPRINT_DEVICE_H__
+#define __KIRAN_FPRINT_DEVICE_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+#include "kiran-fprint-matcher.h"
+#include "kiran-fprint-module.h"
+
+#define KIRAN_TYPE_FPRINT_DEVICE (kiran_fprint_device_get_type())
+#define KIRAN_FPRINT_DEVICE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                                                             KIRAN_TYPE_FPRINT_DEVICE, KiranFprintDevice))
+#define KIRAN_FPRINT_DEVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), \
+                                                                  KIRAN_TYPE_FPRINT_DEVICE, KiranFprintDeviceClass))
+#define KIRAN_IS_FPRINT_DEVICE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                                                                KIRAN_TYPE_FPRINT_DEVICE))
+#define KIRAN_IS_FPRINT_DEVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), \
+                                                                     KIRAN_TYPE_FPRINT_DEVICE))
+#define KIRAN_FPRINT_DEVICE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), \
+                                                                      KIRAN_TYPE_FPRINT_DEVICE, KiranFprintDeviceClass))
+
+typedef struct _KiranFprintDevice KiranFprintDevice;
+typedef struct _KiranFprintDeviceClass KiranFprintDeviceClass;
+typedef struct _KiranFprintDevicePrivate KiranFprintDevicePrivate;
+
+/*
+ * 一个指纹模块中的一个指纹设备, 设备的打开, 关闭和所有操作都通过它进行
+ * 不同设备的操作可以在不同线程中同时进行
+ */
+struct _KiranFprintDevice
+{
+    GObject parent;
+
+    KiranFprintDevicePrivate *priv;
+};
+
+struct _KiranFprintDeviceClass
+{
+    GObjectClass parent;
+};
+
+GType kiran_fprint_device_get_type();
+KiranFprintDevice *kiran_fprint_device_new(KiranFprintModule *module,
+                                           int index,
+                                           KiranFprintMatcher *matcher);
+int kiran_fprint_device_open(KiranFprintDevice *device);
+int kiran_fprint_device_close(KiranFprintDevice *device);
+void kiran_fprint_device_set_idle_timeout(KiranFprintDevice *device,
+                                          guint idle_timeout);
+KiranFprintModule *kiran_fprint_device_get_module(KiranFprintDevice *device);
+int kiran_fprint_device_get_index(KiranFprintDevice *device);
+const gchar *kiran_fprint_device_get_module_path(KiranFprintDevice *device);
+gboolean kiran_fprint_device_has_capabilities(KiranFprintDevice *device,
+                                              unsigned int flags);
+int kiran_fprint_device_acquire_finger_print(KiranFprintDevice *device,
+                                             unsigned char **fpTemplate,
+                                             unsigned int *cbTemplate,
+                                             unsigned int timeout);
+void kiran_fprint_device_template_free(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate);
+int kiran_fprint_device_set_parameter(KiranFprintDevice *device,
+                                      const char *name,
+                                      int value);
+void kiran_fprint_device_acquire_finger_print_stop(KiranFprintDevice *device);
+void kiran_fprint_device_reset_stop(KiranFprintDevice *device);
+int kiran_fprint_device_verify_finger_print(KiranFprintDevice *device,
+                                            unsigned char **fpTemplate,
+                                            unsigned int *cbTemplate,
+                                            unsigned int *number,
+                                            int serial,
+                                            unsigned int timeout);
+int kiran_fprint_device_template_merge(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate1,
+                                       unsigned char *fpTemplate2,
+                                       unsigned char *fpTemplate3,
+                                       unsigned char **regTemplate,
+                                       unsigned int *cbRegTemplate);
+int kiran_fprint_device_template_match(KiranFprintDevice *device,
+                                       unsigned char *fpTemplate1,
+                                       unsigned int cbfpTemplate1,
+                                       unsigned char *fpTemplate2,
+                                       unsigned int cbfpTemplate2);
+int kiran_fprint_device_template_search(KiranFprintDevice *device,
+                                        unsigned char *probe,
+                                        unsigned int cbProbe,
+                                        unsigned char **fpTemplates,
+                                        unsigned int *cbTemplates,
+                                        int number,
+                                        int serial,
+                                        int *index);
+
+#endif /* __KIRAN_FPRINT_DEVICE_H__ */
@@ -15,11 +15,22 @@
 #include "kiran-fprint-manager.h"
 #include "config.h"
 #include "kiran-biometrics-types.h"
+#include "kiran-fprint-matcher.h"
 #include "kiran-fprint-module.h"
 
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
 struct _KiranFprintManagerPrivate
 {
-    KiranFprintModule *current_module; /* 当前正在使用的模块 */
+    KiranFprintMatcher *matcher; /* 模板1:N并行比对, 所有设备共用 */
+    GList *devices;              /* 已发现的指纹设备 */
+    gboolean idle_timeout_set;
+    guint idle_timeout; /* 设备空闲多少秒后关闭 */
+    gchar **preferred;  /* 下一次枚举优先枚举的模块路径 */
 
     GList *modules;
 };
@@ -39,6 +50,8 @@ kiran_fprint_manager_finalize(GObject *object)
     manager = KIRAN_FPRINT_MANAGER(object);
     priv = manager->priv;
 
+    g_list_free_full(priv->devices, g_object_unref);
+
     for (l = priv->modules; l != NULL; l = next)
     {
         next = l->next;
@@ -46,6 +59,8 @@ kiran_fprint_manager_finalize(GObject *object)
     }
 
     g_list_free(priv->modules);
+    g_strfreev(priv->preferred);
+    g_object_unref(priv->matcher);
 
     G_OBJECT_CLASS(kiran_fprint_manager_parent_class)->finalize(object);
 }
@@ -118,202 +133,198 @@ kiran_fprint_manager_init(KiranFprintManager *self)
 
     priv = self->priv = KIRAN_FPRINT_MANAGER_GET_PRIVATE(self);
     priv->modules = NULL;
-    priv->current_module = NULL;
+    priv->devices = NULL;
+    priv->matcher = kiran_fprint_matcher_new(0);
+    priv->idle_timeout_set = FALSE;
+    priv->idle_timeout = 0;
+    priv->preferred = NULL;
 
     kiran_fprint_manager_load_module_dir(self, FPRINT_MODULEDIR);
 }
 
-static int
-kiran_fprint_manager_open_with_module(KiranFprintManager *kfp_manager,
-                                      KiranFprintModule *module)
+static gboolean
+kiran_fprint_manager_has_device(KiranFprintManager *kfp_manager,
+                                KiranFprintModule *module,
+                                int index)
 {
-    int ret;
-    int i;
-
-    module->fprint_init();
-
-    ret = module->fprint_get_dev_count();
-
-    if (ret <= 0)
-    {
-        //没有插入设备
-        module->fprint_finalize();
-        return FPRINT_RESULT_NO_DEVICE;
-    }
+    KiranFprintManagerPrivate *priv = kfp_manager->priv;
+    GList *l;
 
-    for (i = 0; i < ret; i++)
+    for (l = priv->devices; l != NULL; l = l->next)
     {
-        //默认打开一个设备
-        module->hDevice = module->fprint_open_device(i);
+        KiranFprintDevice *device = l->data;
 
-        if (module->hDevice)
-            return FPRINT_RESULT_OK;
+        if (kiran_fprint_device_get_module(device) == module &&
+            kiran_fprint_device_get_index(device) == index)
+            return TRUE;
     }
 
-    return FPRINT_RESULT_FAIL;
+    return FALSE;
 }
 
-int kiran_fprint_manager_open(KiranFprintManager *kfp_manager)
+//枚举一个模块中的指纹设备, 新发现的设备加入 found
+static GList *
+kiran_fprint_manager_scan_module(KiranFprintManager *kfp_manager,
+                                 KiranFprintModule *module,
+                                 GList *found)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
-    GList *l, *next;
-    int ret = FPRINT_RESULT_FAIL;
+    int count;
+    int i;
 
-    module = priv->current_module;
-    if (module)
+    if (!g_type_module_use(G_TYPE_MODULE(module)))
+        return found;
+
+    if (kiran_fprint_module_init_ref(module) != FPRINT_RESULT_OK)
     {
-        ret = kiran_fprint_manager_open_with_module(kfp_manager, module);
-        if (ret == 0)
-            return 0;
+        g_type_module_unuse(G_TYPE_MODULE(module));
+        return found;
     }
 
-    for (l = priv->modules; l != NULL; l = next)
+    count = module->fprint_get_dev_count();
+    for (i = 0; i < count; i++)
     {
-        module = l->data;
-        if (g_type_module_use(G_TYPE_MODULE(module)))
-        {
-            ret = kiran_fprint_manager_open_with_module(kfp_manager, module);
-            if (ret == 0)
-            {
-                if (priv->current_module)
-                    g_type_module_unuse(G_TYPE_MODULE(priv->current_module));
-                priv->current_module = module;
-                return 0;
-            }
-            else
-            {
-                g_type_module_unuse(G_TYPE_MODULE(module));
-            }
-        }
-        next = l->next;
+        KiranFprintDevice *device;
+
+        if (kiran_fprint_manager_has_device(kfp_manager, module, i))
+            continue;
+
+        device = kiran_fprint_device_new(module, i, priv->matcher);
+        if (priv->idle_timeout_set)
+            kiran_fprint_device_set_idle_timeout(device, priv->idle_timeout);
+
+        priv->devices = g_list_append(priv->devices, device);
+        found = g_list_append(found, device);
+
+        dzlog_info("found fprint device %s:%d", module->path, i);
     }
 
-    return ret;
+    kiran_fprint_module_init_unref(module);
+    g_type_module_unuse(G_TYPE_MODULE(module));
+
+    return found;
 }
 
-int kiran_fprint_manager_close(KiranFprintManager *kfp_manager)
+static GList *
+kiran_fprint_manager_scan_preferred(KiranFprintManager *kfp_manager)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
-    int ret = FPRINT_RESULT_FAIL;
+    GList *found = NULL;
+    GList *l;
+    int i;
 
-    module = priv->current_module;
-    if (module)
+    for (i = 0; priv->preferred[i] != NULL; i++)
     {
-        if (module->fprint_close_device && module->hDevice)
+        for (l = priv->modules; l != NULL; l = l->next)
         {
-            ret = module->fprint_close_device(module->hDevice);
-            module->fprint_finalize();
+            KiranFprintModule *module = l->data;
+
+            if (g_strcmp0(module->path, priv->preferred[i]) == 0)
+            {
+                found = kiran_fprint_manager_scan_module(kfp_manager, module, found);
+                break;
+            }
         }
     }
 
-    return ret;
+    g_strfreev(priv->preferred);
+    priv->preferred = NULL;
+
+    return found;
 }
 
-int kiran_fprint_manager_acquire_finger_print(KiranFprintManager *kfp_manager,
-                                              unsigned char **fpTemplate,
-                                              unsigned int *cbTemplate,
-                                              unsigned int timeout)
+/*
+ * 枚举所有模块中的指纹设备, 返回新发现的设备列表, 列表需要调用者用 g_list_free 释放
+ * 已发现的设备被拔出后不会删除, 再次使用时返回 FPRINT_RESULT_NO_DEVICE
+ * 只能在主线程中调用
+ */
+GList *
+kiran_fprint_manager_rescan(KiranFprintManager *kfp_manager)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
+    GList *found = NULL;
+    GList *l;
 
-    module = priv->current_module;
-    if (module)
+    //优先的模块中找到了设备就不再初始化其它模块, 没有找到时枚举所有模块
+    if (priv->preferred)
     {
-        if (module->fprint_acquire_finger_print && module->hDevice)
-            return module->fprint_acquire_finger_print(module->hDevice,
-                                                       fpTemplate,
-                                                       cbTemplate,
-                                                       timeout);
+        found = kiran_fprint_manager_scan_preferred(kfp_manager);
+        if (found)
+            return found;
     }
 
-    return FPRINT_RESULT_FAIL;
+    for (l = priv->modules; l != NULL; l = l->next)
+        found = kiran_fprint_manager_scan_module(kfp_manager, l->data, found);
+
+    return found;
 }
 
-void kiran_fprint_manager_acquire_finger_print_stop(KiranFprintManager *kfp_manager)
+/*
+ * 返回已发现的指纹设备, 列表属于 manager, 调用者不能修改或释放
+ */
+GList *
+kiran_fprint_manager_get_devices(KiranFprintManager *kfp_manager)
 {
-    KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
-
-    module = priv->current_module;
-    if (module)
-    {
-        if (module->fprint_acquire_finger_print_stop && module->hDevice)
-            module->fprint_acquire_finger_print_stop(module->hDevice);
-    }
+    return kfp_manager->priv->devices;
 }
 
-int kiran_fprint_manager_verify_finger_print(KiranFprintManager *kfp_manager,
-                                             unsigned char **fpTemplate,
-                                             unsigned int *cbTemplate,
-                                             unsigned int *number,
-                                             unsigned int timeout)
+/*
+ * 设置所有设备空闲多长时间后关闭, 单位为秒, 0表示使用完立即关闭
+ */
+void kiran_fprint_manager_set_idle_timeout(KiranFprintManager *kfp_manager,
+                                           guint idle_timeout)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
+    GList *l;
 
-    module = priv->current_module;
-    if (module)
-    {
-        if (module->fprint_verify_finger_print && module->hDevice)
-            return module->fprint_verify_finger_print(module->hDevice,
-                                                      fpTemplate,
-                                                      cbTemplate,
-                                                      number,
-                                                      timeout);
-    }
+    priv->idle_timeout_set = TRUE;
+    priv->idle_timeout = idle_timeout;
 
-    return FPRINT_RESULT_FAIL;
+    for (l = priv->devices; l != NULL; l = l->next)
+        kiran_fprint_device_set_idle_timeout(l->data, idle_timeout);
 }
 
-int kiran_fprint_manager_template_merge(KiranFprintManager *kfp_manager,
-                                        unsigned char *fpTemplate1,
-                                        unsigned char *fpTemplate2,
-                                        unsigned char *fpTemplate3,
-                                        unsigned char **regTemplate,
-                                        unsigned int *cbRegTemplate)
+/*
+ * 设置下一次枚举优先枚举的模块, 只对下一次枚举有效
+ * 守护进程启动时传入上次发现设备的模块, 跳过初始化没有设备的模块
+ */
+void kiran_fprint_manager_set_preferred_modules(KiranFprintManager *kfp_manager,
+                                                const gchar *const *paths)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
-
-    module = priv->current_module;
-    if (module)
-    {
-        if (module->fprint_template_merge && module->hDevice)
-            return module->fprint_template_merge(module->hDevice,
-                                                 fpTemplate1,
-                                                 fpTemplate2,
-                                                 fpTemplate3,
-                                                 regTemplate,
-                                                 cbRegTemplate);
-    }
 
-    return FPRINT_RESULT_FAIL;
+    g_strfreev(priv->preferred);
+    priv->preferred = (paths && paths[0]) ? g_strdupv((gchar **)paths) : NULL;
 }
 
-int kiran_fprint_manager_template_match(KiranFprintManager *kfp_manager,
-                                        unsigned char *fpTemplate1,
-                                        unsigned int cbfpTemplate1,
-                                        unsigned char *fpTemplate2,
-                                        unsigned int cbfpTemplate2)
+/*
+ * 返回已发现设备所在模块的路径, 需要调用者用 g_strfreev 释放
+ */
+gchar **
+kiran_fprint_manager_get_device_modules(KiranFprintManager *kfp_manager)
 {
     KiranFprintManagerPrivate *priv = kfp_manager->priv;
-    KiranFprintModule *module;
+    GPtrArray *paths;
+    GList *l;
 
-    module = priv->current_module;
-    if (module)
+    paths = g_ptr_array_new();
+    for (l = priv->devices; l != NULL; l = l->next)
     {
-        if (module->fprint_template_match && module->hDevice)
-            return module->fprint_template_match(module->hDevice,
-                                                 fpTemplate1,
-                                                 cbfpTemplate1,
-                                                 fpTemplate2,
-                                                 cbfpTemplate2);
+        const gchar *path = kiran_fprint_device_get_module_path(l->data);
+        guint i;
+
+        for (i = 0; i < paths->len; i++)
+        {
+            if (g_strcmp0(g_ptr_array_index(paths, i), path) == 0)
+                break;
+        }
+
+        if (i == paths->len)
+            g_ptr_array_add(paths, g_strdup(path));
     }
+    g_ptr_array_add(paths, NULL);
 
-    return FPRINT_RESULT_FAIL;
+    return (gchar **)g_ptr_array_free(paths, FALSE);
 }
 
 KiranFprintManager *
@@ -18,6 +18,8 @@
 #include <glib-object.h>
 #include <glib.h>
 
+#include "kiran-fprint-device.h"
+
 #define KIRAN_TYPE_FPRINT_MANAGER (kiran_fprint_manager_get_type())
 #define KIRAN_FPRINT_MANAGER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
                                                               KIRAN_TYPE_FPRINT_MANAGER, KiranFprintManager))
@@ -48,28 +50,12 @@ struct _KiranFprintManagerClass
 
 GType kiran_fprint_manager_get_type();
 KiranFprintManager *kiran_fprint_manager_new();
-int kiran_fprint_manager_open(KiranFprintManager *kfp_manager);
-int kiran_fprint_manager_close(KiranFprintManager *kfp_manager);
-int kiran_fprint_manager_acquire_finger_print(KiranFprintManager *kfp_manager,
-                                              unsigned char **fpTemplate,
-                                              unsigned int *cbTemplate,
-                                              unsigned int timeout);
-void kiran_fprint_manager_acquire_finger_print_stop(KiranFprintManager *kfp_manager);
-int kiran_fprint_manager_verify_finger_print(KiranFprintManager *kfp_manager,
-                                             unsigned char **fpTemplate,
-                                             unsigned int *cbTemplate,
-                                             unsigned int *number,
-                                             unsigned int timeout);
-int kiran_fprint_manager_template_merge(KiranFprintManager *kfp_manager,
-                                        unsigned char *fpTemplate1,
-                                        unsigned char *fpTemplate2,
-                                        unsigned char *fpTemplate3,
-                                        unsigned char **regTemplate,
-                                        unsigned int *cbRegTemplate);
-int kiran_fprint_manager_template_match(KiranFprintManager *kfp_manager,
-                                        unsigned char *fpTemplate1,
-                                        unsigned int cbfpTemplate1,
-                                        unsigned char *fpTemplate2,
-                                        unsigned int cbfpTemplate2);
+GList *kiran_fprint_manager_rescan(KiranFprintManager *kfp_manager);
+GList *kiran_fprint_manager_get_devices(KiranFprintManager *kfp_manager);
+void kiran_fprint_manager_set_idle_timeout(KiranFprintManager *kfp_manager,
+                                           guint idle_timeout);
+void kiran_fprint_manager_set_preferred_modules(KiranFprintManager *kfp_manager,
+                                                const gchar *const *paths);
+gchar **kiran_fprint_manager_get_device_modules(KiranFprintManager *kfp_manager);
 
 #endif /* __KIRAN_FPRINT_MANAGER_H__ */
@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-biometrics-types.h"
+#include "kiran-fprint-matcher.h"
+
+/* 每个线程至少比对的模板数, 模板太少时拆分的开销比比对本身还大 */
+#define MATCHER_MIN_CHUNK 32
+
+typedef struct
+{
+    KiranFprintMatchFunc func;
+    gpointer user_data;
+
+    unsigned char *probe;
+    unsigned int cbProbe;
+    unsigned char **fpTemplates;
+    unsigned int *cbTemplates;
+
+    gint found; /* 第一个匹配的模板下标, -1表示还没有找到 */
+
+    GMutex mutex;
+    GCond cond;
+    int pending; /* 还未完成的线程池任务数 */
+} KiranFprintMatchJob;
+
+typedef struct
+{
+    KiranFprintMatchJob *job;
+    int start;
+    int end;
+} KiranFprintMatchTask;
+
+struct _KiranFprintMatcherPrivate
+{
+    int threads;
+    GThreadPool *pool;
+};
+
+#define KIRAN_FPRINT_MATCHER_GET_PRIVATE(O) \
+    (G_TYPE_INSTANCE_GET_PRIVATE((O), KIRAN_TYPE_FPRINT_MATCHER, KiranFprintMatcherPrivate))
+
+G_DEFINE_TYPE(KiranFprintMatcher, kiran_fprint_matcher, G_TYPE_OBJECT);
+
+static void
+kiran_fprint_matcher_finalize(GObject *object)
+{
+    KiranFprintMatcher *matcher;
+    KiranFprintMatcherPrivate *priv;
+
+    matcher = KIRAN_FPRINT_MATCHER(object);
+    priv = matcher->priv;
+
+    if (priv->pool)
+        g_thread_pool_free(priv->pool, TRUE, TRUE);
+
+    G_OBJECT_CLASS(kiran_fprint_matcher_parent_class)->finalize(object);
+}
+
+static void
+kiran_fprint_matcher_class_init(KiranFprintMatcherClass *class)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+    object_class->finalize = kiran_fprint_matcher_finalize;
+
+    g_type_class_add_private(class, sizeof(KiranFprintMatcherPrivate));
+}
+
+static void
+kiran_fprint_matcher_init(KiranFprintMatcher *self)
+{
+    KiranFprintMatcherPrivate *priv;
+
+    priv = self->priv = KIRAN_FPRINT_MATCHER_GET_PRIVATE(self);
+    priv->threads = 1;
+    priv->pool = NULL;
+}
+
+/* 比对 [start, end) 范围内的模板, 其它线程已经找到时立即退出 */
+static void
+kiran_fprint_matcher_run(KiranFprintMatchJob *job,
+                         int start,
+                         int end)
+{
+    int i;
+
+    for (i = start; i < end; i++)
+    {
+        if (g_atomic_int_get(&job->found) >= 0)
+            break;
+
+        if (job->func(job->user_data,
+                      job->probe,
+                      job->cbProbe,
+                      job->fpTemplates[i],
+                      job->cbTemplates[i]) == FPRINT_RESULT_OK)
+        {
+            g_atomic_int_compare_and_exchange(&job->found, -1, i);
+            break;
+        }
+    }
+}
+
+static void
+kiran_fprint_matcher_task_done(KiranFprintMatchJob *job)
+{
+    g_mutex_lock(&job->mutex);
+    job->pending--;
+    if (job->pending == 0)
+        g_cond_signal(&job->cond);
+    g_mutex_unlock(&job->mutex);
+}
+
+static void
+kiran_fprint_matcher_worker(gpointer data,
+                            gpointer user_data)
+{
+    KiranFprintMatchTask *task = data;
+
+    kiran_fprint_matcher_run(task->job, task->start, task->end);
+    kiran_fprint_matcher_task_done(task->job);
+}
+
+int kiran_fprint_matcher_get_threads(KiranFprintMatcher *matcher)
+{
+    return matcher->priv->threads;
+}
+
+/*
+ * 在 fpTemplates 中查找和 probe 匹配的模板, 找到时通过 index 返回下标
+ * 模板被拆分到多个线程中比对, 任意线程匹配后其它线程停止比对,
+ * 因此有多个模板匹配时返回的不一定是下标最小的那个
+ */
+int kiran_fprint_matcher_search(KiranFprintMatcher *matcher,
+                                KiranFprintMatchFunc func,
+                                gpointer user_data,
+                                unsigned char *probe,
+                                unsigned int cbProbe,
+                                unsigned char **fpTemplates,
+                                unsigned int *cbTemplates,
+                                int number,
+                                int *index)
+{
+    KiranFprintMatcherPrivate *priv = matcher->priv;
+    KiranFprintMatchTask *tasks;
+    KiranFprintMatchJob job;
+    int threads;
+    int chunk;
+    int i;
+
+    if (number <= 0)
+        return FPRINT_RESULT_FAIL;
+
+    job.func = func;
+    job.user_data = user_data;
+    job.probe = probe;
+    job.cbProbe = cbProbe;
+    job.fpTemplates = fpTemplates;
+    job.cbTemplates = cbTemplates;
+    job.found = -1;
+    job.pending = 0;
+
+    threads = MIN(priv->threads, number / MATCHER_MIN_CHUNK);
+    if (threads <= 1 || priv->pool == NULL)
+    {
+        kiran_fprint_matcher_run(&job, 0, number);
+    }
+    else
+    {
+        g_mutex_init(&job.mutex);
+        g_cond_init(&job.cond);
+
+        chunk = (number + threads - 1) / threads;
+        tasks = g_new0(KiranFprintMatchTask, threads);
+        for (i = 0; i < threads; i++)
+        {
+            tasks[i].job = &job;
+            tasks[i].start = i * chunk;
+            tasks[i].end = MIN(number, (i + 1) * chunk);
+        }
+
+        //第一段在当前线程中比对, 其余的交给线程池
+        job.pending = threads - 1;
+        for (i = 1; i < threads; i++)
+        {
+            GError *error = NULL;
+
+            if (!g_thread_pool_push(priv->pool, &tasks[i], &error))
+            {
+                dzlog_error("push match task failed: %s", error->message);
+                g_error_free(error);
+                kiran_fprint_matcher_worker(&tasks[i], NULL);
+            }
+        }
+
+        kiran_fprint_matcher_run(&job, tasks[0].start, tasks[0].end);
+
+        g_mutex_lock(&job.mutex);
+        while (job.pending > 0)
+            g_cond_wait(&job.cond, &job.mutex);
+        g_mutex_unlock(&job.mutex);
+
+        g_free(tasks);
+        g_cond_clear(&job.cond);
+        g_mutex_clear(&job.mutex);
+    }
+
+    if (job.found < 0)
+        return FPRINT_RESULT_FAIL;
+
+    *index = job.found;
+
+    return FPRINT_RESULT_OK;
+}
+
+/*
+ * max_threads 为参与比对的最大线程数, 包括调用者所在的线程
+ * 小于等于0时使用CPU个数
+ */
+KiranFprintMatcher *
+kiran_fprint_matcher_new(int max_threads)
+{
+    KiranFprintMatcher *matcher;
+    KiranFprintMatcherPrivate *priv;
+    GError *error = NULL;
+
+    matcher = g_object_new(KIRAN_TYPE_FPRINT_MATCHER, NULL);
+    priv = matcher->priv;
+
+    if (max_threads <= 0)
+        max_threads = g_get_num_processors();
+
+    if (max_threads > 1)
+    {
+        priv->pool = g_thread_pool_new(kiran_fprint_matcher_worker,
+                                       NULL,
+                                       max_threads - 1,
+                                       FALSE,
+                                       &error);
+        if (priv->pool == NULL)
+        {
+            dzlog_error("create match thread pool failed: %s", error->message);
+            g_error_free(error);
+            max_threads = 1;
+        }
+    }
+
+    priv->threads = max_threads;
+    dzlog_debug("fprint matcher use %d threads", priv->threads);
+
+    return matcher;
+}
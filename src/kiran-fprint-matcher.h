@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_FPRINT_MATCHER_H__
+#define __KIRAN_FPRINT_MATCHER_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+#define KIRAN_TYPE_FPRINT_MATCHER (kiran_fprint_matcher_get_type())
+#define KIRAN_FPRINT_MATCHER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                                                              KIRAN_TYPE_FPRINT_MATCHER, KiranFprintMatcher))
+#define KIRAN_FPRINT_MATCHER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), \
+                                                                   KIRAN_TYPE_FPRINT_MATCHER, KiranFprintMatcherClass))
+#define KIRAN_IS_FPRINT_MATCHER(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                                                                 KIRAN_TYPE_FPRINT_MATCHER))
+#define KIRAN_IS_FPRINT_MATCHER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), \
+                                                                      KIRAN_TYPE_FPRINT_MATCHER))
+#define KIRAN_FPRINT_MATCHER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), \
+                                                                       KIRAN_TYPE_FPRINT_MATCHER, KiranFprintMatcherClass))
+
+typedef struct _KiranFprintMatcher KiranFprintMatcher;
+typedef struct _KiranFprintMatcherClass KiranFprintMatcherClass;
+typedef struct _KiranFprintMatcherPrivate KiranFprintMatcherPrivate;
+
+struct _KiranFprintMatcher
+{
+    GObject parent;
+
+    KiranFprintMatcherPrivate *priv;
+};
+
+struct _KiranFprintMatcherClass
+{
+    GObjectClass parent;
+};
+
+/*
+ * 两枚模板的比对函数, 返回 FPRINT_RESULT_OK 表示匹配
+ * 并行比对时会在多个线程中同时调用
+ */
+typedef int (*KiranFprintMatchFunc)(gpointer user_data,
+                                    unsigned char *fpTemplate1,
+                                    unsigned int cbfpTemplate1,
+                                    unsigned char *fpTemplate2,
+                                    unsigned int cbfpTemplate2);
+
+GType kiran_fprint_matcher_get_type();
+KiranFprintMatcher *kiran_fprint_matcher_new(int max_threads);
+int kiran_fprint_matcher_get_threads(KiranFprintMatcher *matcher);
+int kiran_fprint_matcher_search(KiranFprintMatcher *matcher,
+                                KiranFprintMatchFunc func,
+                                gpointer user_data,
+                                unsigned char *probe,
+                                unsigned int cbProbe,
+                                unsigned char **fpTemplates,
+                                unsigned int *cbTemplates,
+                                int number,
+                                int *index);
+
+#endif /* __KIRAN_FPRINT_MATCHER_H__ */
@@ -12,6 +12,8 @@
  * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
  */
 
+#include <string.h>
+
 #include "kiran-fprint-module.h"
 
 G_DEFINE_TYPE(KiranFprintModule, kiran_fprint_module, G_TYPE_TYPE_MODULE);
@@ -24,10 +26,69 @@ kiran_fprint_module_finalize(GObject *object)
     module = KIRAN_FPRINT_MODULE(object);
 
     g_free(module->path);
+    g_mutex_clear(&module->init_mutex);
 
     G_OBJECT_CLASS(kiran_fprint_module_parent_class)->finalize(object);
 }
 
+/*
+ * 根据模块的能力描述确定模块能力
+ * 旧模块没有能力描述时, 根据导出的符号推断
+ */
+static void
+kiran_fprint_module_load_capabilities(KiranFprintModule *module)
+{
+    KiranFprintCapabilities *caps = &module->caps;
+    const KiranFprintCapabilities *desc = NULL;
+    const int *reentrant = NULL;
+
+    memset(caps, 0x00, sizeof(KiranFprintCapabilities));
+    caps->version = KIRAN_FPRINT_CAPABILITIES_VERSION;
+
+    if (module->fprint_get_capabilities)
+        desc = module->fprint_get_capabilities();
+
+    if (desc && desc->version >= 1)
+    {
+        caps->flags = desc->flags;
+        caps->template_format = desc->template_format;
+        caps->max_template_size = desc->max_template_size;
+    }
+    else
+    {
+        if (module->fprint_verify_finger_print)
+            caps->flags |= KIRAN_FPRINT_CAP_IDENTIFY;
+        if (module->fprint_template_merge)
+            caps->flags |= KIRAN_FPRINT_CAP_MERGE;
+        if (module->fprint_template_match_batch)
+            caps->flags |= KIRAN_FPRINT_CAP_BATCH_MATCH;
+        if (g_module_symbol(module->library,
+                            "kiran_fprint_template_match_reentrant",
+                            (gpointer *)&reentrant) &&
+            reentrant && *reentrant)
+            caps->flags |= KIRAN_FPRINT_CAP_REENTRANT_MATCH;
+    }
+
+    //声明了能力但没有导出对应的接口
+    if (!module->fprint_verify_finger_print)
+        caps->flags &= ~KIRAN_FPRINT_CAP_IDENTIFY;
+    if (!module->fprint_template_merge)
+        caps->flags &= ~KIRAN_FPRINT_CAP_MERGE;
+    if (!module->fprint_template_match_batch)
+        caps->flags &= ~KIRAN_FPRINT_CAP_BATCH_MATCH;
+    if (!module->fprint_template_match)
+        caps->flags &= ~KIRAN_FPRINT_CAP_REENTRANT_MATCH;
+}
+
+static void
+kiran_fprint_module_optional_symbol(KiranFprintModule *module,
+                                    const gchar *name,
+                                    gpointer *symbol)
+{
+    if (!g_module_symbol(module->library, name, symbol))
+        *symbol = NULL;
+}
+
 static gboolean
 kiran_fprint_module_load(GTypeModule *gmodule)
 {
@@ -42,6 +103,7 @@ kiran_fprint_module_load(GTypeModule *gmodule)
         return FALSE;
     }
 
+    //必须实现的接口
     if (!g_module_symbol(module->library,
                          "kiran_fprint_init",
                          (gpointer *)&module->fprint_init) ||
@@ -57,21 +119,12 @@ kiran_fprint_module_load(GTypeModule *gmodule)
         !g_module_symbol(module->library,
                          "kiran_fprint_acquire_finger_print_stop",
                          (gpointer *)&module->fprint_acquire_finger_print_stop) ||
-        !g_module_symbol(module->library,
-                         "kiran_fprint_verify_finger_print",
-                         (gpointer *)&module->fprint_verify_finger_print) ||
         !g_module_symbol(module->library,
                          "kiran_fprint_close_device",
                          (gpointer *)&module->fprint_close_device) ||
         !g_module_symbol(module->library,
                          "kiran_fprint_get_dev_count",
-                         (gpointer *)&module->fprint_get_dev_count) ||
-        !g_module_symbol(module->library,
-                         "kiran_fprint_template_merge",
-                         (gpointer *)&module->fprint_template_merge) ||
-        !g_module_symbol(module->library,
-                         "kiran_fprint_template_match",
-                         (gpointer *)&module->fprint_template_match))
+                         (gpointer *)&module->fprint_get_dev_count))
     {
         g_warning("%s", g_module_error());
         g_module_close(module->library);
@@ -79,6 +132,31 @@ kiran_fprint_module_load(GTypeModule *gmodule)
         return FALSE;
     }
 
+    //可选接口
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_verify_finger_print",
+                                        (gpointer *)&module->fprint_verify_finger_print);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_template_merge",
+                                        (gpointer *)&module->fprint_template_merge);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_template_match",
+                                        (gpointer *)&module->fprint_template_match);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_template_match_batch",
+                                        (gpointer *)&module->fprint_template_match_batch);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_get_capabilities",
+                                        (gpointer *)&module->fprint_get_capabilities);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_template_free",
+                                        (gpointer *)&module->fprint_template_free);
+    kiran_fprint_module_optional_symbol(module,
+                                        "kiran_fprint_set_parameter",
+                                        (gpointer *)&module->fprint_set_parameter);
+
+    kiran_fprint_module_load_capabilities(module);
+
     return TRUE;
 }
 
@@ -100,7 +178,10 @@ kiran_fprint_module_unload(GTypeModule *gmodule)
     module->fprint_close_device = NULL;
     module->fprint_template_merge = NULL;
     module->fprint_template_match = NULL;
-    module->hDevice = NULL;
+    module->fprint_template_match_batch = NULL;
+    module->fprint_get_capabilities = NULL;
+    module->fprint_template_free = NULL;
+    module->fprint_set_parameter = NULL;
 }
 
 static void
@@ -117,6 +198,46 @@ kiran_fprint_module_class_init(KiranFprintModuleClass *class)
 static void
 kiran_fprint_module_init(KiranFprintModule *self)
 {
+    g_mutex_init(&self->init_mutex);
+    self->init_count = 0;
+}
+
+/*
+ * 初始化指纹模块, 模块已经初始化时只增加引用计数
+ * 每次成功调用都需要对应一次 kiran_fprint_module_init_unref
+ */
+int kiran_fprint_module_init_ref(KiranFprintModule *module)
+{
+    int ret = FPRINT_RESULT_OK;
+
+    g_mutex_lock(&module->init_mutex);
+
+    if (module->init_count == 0)
+        ret = module->fprint_init();
+
+    if (ret == FPRINT_RESULT_OK)
+        module->init_count++;
+
+    g_mutex_unlock(&module->init_mutex);
+
+    return ret;
+}
+
+/*
+ * 最后一个使用者释放时才反初始化指纹模块
+ */
+void kiran_fprint_module_init_unref(KiranFprintModule *module)
+{
+    g_mutex_lock(&module->init_mutex);
+
+    if (module->init_count > 0)
+    {
+        module->init_count--;
+        if (module->init_count == 0)
+            module->fprint_finalize();
+    }
+
+    g_mutex_unlock(&module->init_mutex);
 }
 
 KiranFprintModule *
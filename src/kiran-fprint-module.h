@@ -19,6 +19,8 @@
 #include <glib.h>
 #include <gmodule.h>
 
+#include "kiran-biometrics-types.h"
+
 #define KIRAN_TYPE_FPRINT_MODULE (kiran_fprint_module_get_type())
 #define KIRAN_FPRINT_MODULE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
                                                              KIRAN_TYPE_FPRINT_MODULE, KiranFprintModule))
@@ -41,7 +43,9 @@ struct _KiranFprintModule
     GModule *library;
     gchar *path;
 
-    gpointer hDevice;
+    GMutex init_mutex;
+    int init_count; /* 已打开的设备数, 多个设备共用一次模块初始化 */
+
     int (*fprint_init)();
     int (*fprint_finalize)();
     int (*fprint_get_dev_count)();
@@ -68,6 +72,26 @@ struct _KiranFprintModule
                                  unsigned int cbfpTemplate1,
                                  unsigned char *fpTemplate2,
                                  unsigned int cbfpTemplate2);
+
+    int (*fprint_template_match_batch)(gpointer hDevice,
+                                       unsigned char *fpTemplate,
+                                       unsigned int cbfpTemplate,
+                                       unsigned char **fpTemplates,
+                                       unsigned int *cbTemplates,
+                                       unsigned int number,
+                                       int *index,
+                                       int *score);
+
+    const KiranFprintCapabilities *(*fprint_get_capabilities)();
+
+    void (*fprint_template_free)(gpointer hDevice,
+                                 unsigned char *fpTemplate);
+
+    int (*fprint_set_parameter)(gpointer hDevice,
+                                const char *name,
+                                int value);
+
+    KiranFprintCapabilities caps; /* 模块能力, 加载时确定 */
 };
 
 struct _KiranFprintModuleClass
@@ -77,5 +101,7 @@ struct _KiranFprintModuleClass
 
 GType kiran_fprint_module_get_type();
 KiranFprintModule *kiran_fprint_module_new();
+int kiran_fprint_module_init_ref(KiranFprintModule *module);
+void kiran_fprint_module_init_unref(KiranFprintModule *module);
 
 #endif /* __KIRAN_FPRINT_MODULE_H__ */
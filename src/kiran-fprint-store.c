@@ -0,0 +1,1451 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-biometrics-trace.h"
+#include "kiran-fprint-store.h"
+
+/*
+ * 模板库由一个定长记录的索引文件和一个只追加的数据文件组成:
+ *   templates.idx      文件头 + N条 KiranFprintIndexRecord
+ *   templates-<G>.dat  模板数据, G为文件头中的数据文件编号
+ * 删除模板时清空记录中的ID, 已删除模板占用的空间超过 STORE_COMPACT_RATIO% 时
+ * 把剩余模板整理到编号为G+1的新数据文件中, 再通过rename原子地替换索引
+ */
+#define STORE_INDEX_FILE "templates.idx"
+#define STORE_INDEX_TMP_FILE "templates.idx.tmp"
+#define STORE_DATA_FILE "templates-%u.dat"
+#define STORE_INDEX_MAGIC "KFPIDX01"
+#define STORE_VERSION 1
+
+#define STORE_MIN_CAPACITY 16   /* 快照共享数组的最小容量 */
+#define STORE_COMPACT_RATIO 25  /* 已删除模板占数据文件的百分比超过这个值时整理 */
+#define STORE_COMPACT_MIN 65536 /* 已删除模板占用的空间小于这个值时不整理 */
+
+#define LEGACY_TEMPLATE_SUFFIX ".bat" /* 旧版本每个模板一个文件 */
+
+#define STORE_ID_SIZE 40
+#define STORE_MODULE_SIZE 64
+
+#pragma pack(1)
+
+typedef struct
+{
+    char magic[8];       //STORE_INDEX_MAGIC
+    guint32 version;     //STORE_VERSION
+    guint32 record_size; //sizeof(KiranFprintIndexRecord)
+    guint32 generation;  //数据文件编号
+    guint32 count;       //记录个数
+} KiranFprintIndexHeader;
+
+typedef struct
+{
+    char id[STORE_ID_SIZE];         //模板ID
+    guint64 offset;                 //模板在数据文件中的偏移
+    guint32 length;                 //模板长度
+    guint32 owner;                  //录入者的uid
+    gint64 ctime;                   //录入时间
+    char module[STORE_MODULE_SIZE]; //采集该模板的指纹模块
+} KiranFprintIndexRecord;
+
+#pragma pack()
+
+struct _KiranFprintStorePrivate
+{
+    gchar *dir;
+    gchar *index_path;
+
+    GMutex mutex;
+    KiranFprintGallery *gallery; /* 当前缓存的模板, NULL表示需要重新加载 */
+    int serial;                  /* 最后一次加载的快照序号 */
+
+    GFileMonitor *monitor; /* 监控模板目录, 外部修改时使缓存失效 */
+
+    /* 本进程最后一次读写后索引文件的状态 */
+    guint64 index_ino;
+    goffset index_size;
+    gint64 index_mtime; /* 纳秒 */
+
+    /* 数据文件大小和其中已删除模板占用的大小, 用于决定何时整理 */
+    goffset data_size;
+    goffset dead_size;
+
+    gboolean migrate_pending; /* 旧版本模板还没有导入, 导入前不能创建索引 */
+};
+
+#define KIRAN_FPRINT_STORE_GET_PRIVATE(O) \
+    (G_TYPE_INSTANCE_GET_PRIVATE((O), KIRAN_TYPE_FPRINT_STORE, KiranFprintStorePrivate))
+
+G_DEFINE_TYPE(KiranFprintStore, kiran_fprint_store, G_TYPE_OBJECT);
+
+/*
+ * 快照共享的模板数组和ID索引
+ * 数组只在末尾追加, 快照只访问自己 number 以内的元素, 追加不影响已有的快照
+ * 删除模板或容量不足时复制出新的共享数据
+ */
+struct _KiranFprintGalleryData
+{
+    gint ref_count;
+
+    int length;                /* 已使用的元素个数 */
+    int capacity;              /* 数组容量 */
+    unsigned char **templates; /* 模板数据 */
+    unsigned int *lens;        /* 模板长度 */
+    const gchar **ids;         /* 模板ID */
+    guint32 *records;          /* 模板在索引文件中的记录号 */
+
+    GMutex lock;       /* 保护 index, 查找可能在工作线程中进行 */
+    GHashTable *index; /* 模板ID到模板位置的索引 */
+
+    GPtrArray *owned;        /* 映射之后追加的模板和ID, 元素为 GBytes */
+    GMappedFile *data_file;  /* 模板数据文件映射 */
+    GMappedFile *index_file; /* 模板索引文件映射 */
+};
+
+static KiranFprintGalleryData *
+kiran_fprint_gallery_data_new(int capacity)
+{
+    KiranFprintGalleryData *data;
+
+    capacity = MAX(capacity, STORE_MIN_CAPACITY);
+
+    data = g_new0(KiranFprintGalleryData, 1);
+    data->ref_count = 1;
+    data->length = 0;
+    data->capacity = capacity;
+    data->templates = g_new0(unsigned char *, capacity + 1);
+    data->lens = g_new0(unsigned int, capacity + 1);
+    data->ids = g_new0(const gchar *, capacity + 1);
+    data->records = g_new0(guint32, capacity + 1);
+    g_mutex_init(&data->lock);
+    data->index = g_hash_table_new(g_str_hash, g_str_equal);
+    data->owned = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+    data->data_file = NULL;
+    data->index_file = NULL;
+
+    return data;
+}
+
+static KiranFprintGalleryData *
+kiran_fprint_gallery_data_ref(KiranFprintGalleryData *data)
+{
+    g_atomic_int_inc(&data->ref_count);
+
+    return data;
+}
+
+static void
+kiran_fprint_gallery_data_unref(KiranFprintGalleryData *data)
+{
+    if (!g_atomic_int_dec_and_test(&data->ref_count))
+        return;
+
+    if (data->data_file)
+        g_mapped_file_unref(data->data_file);
+
+    if (data->index_file)
+        g_mapped_file_unref(data->index_file);
+
+    g_ptr_array_free(data->owned, TRUE);
+    g_hash_table_destroy(data->index);
+    g_mutex_clear(&data->lock);
+    g_free(data->templates);
+    g_free(data->lens);
+    g_free(data->ids);
+    g_free(data->records);
+    g_free(data);
+}
+
+/*
+ * 在共享数据末尾追加模板, 模板和ID的内存由调用者保证在共享数据释放前有效
+ * ID已经存在或容量不足时返回-1, 否则返回模板的位置
+ */
+static int
+kiran_fprint_gallery_data_add(KiranFprintGalleryData *data,
+                              unsigned char *template,
+                              unsigned int length,
+                              const gchar *id,
+                              guint32 record)
+{
+    int n = data->length;
+
+    if (n >= data->capacity)
+        return -1;
+
+    g_mutex_lock(&data->lock);
+    if (g_hash_table_contains(data->index, id))
+    {
+        g_mutex_unlock(&data->lock);
+        return -1;
+    }
+    g_hash_table_insert(data->index, (gpointer)id, GINT_TO_POINTER(n));
+    g_mutex_unlock(&data->lock);
+
+    data->templates[n] = template;
+    data->lens[n] = length;
+    data->ids[n] = id;
+    data->records[n] = record;
+    data->length++;
+
+    return n;
+}
+
+/*
+ * 复制共享数据的前 number 个模板, 跳过位置为 skip 的模板, skip 为-1时不跳过
+ * 模板数据仍然指向原来的映射和追加的内存
+ */
+static KiranFprintGalleryData *
+kiran_fprint_gallery_data_copy(KiranFprintGalleryData *old,
+                               int number,
+                               int skip,
+                               int capacity)
+{
+    KiranFprintGalleryData *data;
+    guint i;
+    int n;
+
+    data = kiran_fprint_gallery_data_new(capacity);
+    for (n = 0; n < number; n++)
+    {
+        if (n == skip)
+            continue;
+
+        kiran_fprint_gallery_data_add(data,
+                                      old->templates[n],
+                                      old->lens[n],
+                                      old->ids[n],
+                                      old->records[n]);
+    }
+
+    for (i = 0; i < old->owned->len; i++)
+        g_ptr_array_add(data->owned, g_bytes_ref(g_ptr_array_index(old->owned, i)));
+    if (old->data_file)
+        data->data_file = g_mapped_file_ref(old->data_file);
+    if (old->index_file)
+        data->index_file = g_mapped_file_ref(old->index_file);
+
+    return data;
+}
+
+/* 创建包含共享数据前 number 个模板的快照 */
+static KiranFprintGallery *
+kiran_fprint_gallery_new(KiranFprintGalleryData *data,
+                         int number)
+{
+    KiranFprintGallery *gallery;
+
+    gallery = g_new0(KiranFprintGallery, 1);
+    gallery->ref_count = 1;
+    gallery->number = number;
+    gallery->templates = data->templates;
+    gallery->lens = data->lens;
+    gallery->ids = data->ids;
+    gallery->serial = 0;
+    gallery->data = kiran_fprint_gallery_data_ref(data);
+
+    return gallery;
+}
+
+/* 创建只包含部分模板的快照, 模板通过 kiran_fprint_gallery_subset_add 添加 */
+static KiranFprintGallery *
+kiran_fprint_gallery_new_subset(KiranFprintGalleryData *data,
+                                int size)
+{
+    KiranFprintGallery *gallery;
+
+    gallery = g_new0(KiranFprintGallery, 1);
+    gallery->ref_count = 1;
+    gallery->number = 0;
+    gallery->templates = g_new0(unsigned char *, size + 1);
+    gallery->lens = g_new0(unsigned int, size + 1);
+    gallery->ids = g_new0(const gchar *, size + 1);
+    gallery->serial = 0;
+    gallery->data = kiran_fprint_gallery_data_ref(data);
+
+    return gallery;
+}
+
+//快照是否有自己的数组
+static gboolean
+kiran_fprint_gallery_is_subset(KiranFprintGallery *gallery)
+{
+    return gallery->templates != gallery->data->templates;
+}
+
+KiranFprintGallery *
+kiran_fprint_gallery_ref(KiranFprintGallery *gallery)
+{
+    g_return_val_if_fail(gallery != NULL, NULL);
+
+    g_atomic_int_inc(&gallery->ref_count);
+
+    return gallery;
+}
+
+void kiran_fprint_gallery_unref(KiranFprintGallery *gallery)
+{
+    if (gallery == NULL)
+        return;
+
+    if (!g_atomic_int_dec_and_test(&gallery->ref_count))
+        return;
+
+    if (kiran_fprint_gallery_is_subset(gallery))
+    {
+        g_free(gallery->templates);
+        g_free(gallery->lens);
+        g_free(gallery->ids);
+    }
+    kiran_fprint_gallery_data_unref(gallery->data);
+    g_free(gallery);
+}
+
+/*
+ * 根据模板ID查找模板在快照中的位置, 找不到时返回-1
+ */
+int kiran_fprint_gallery_find(KiranFprintGallery *gallery,
+                              const gchar *id)
+{
+    KiranFprintGalleryData *data = gallery->data;
+    gpointer value;
+    gboolean found;
+    int i;
+
+    if (id == NULL)
+        return -1;
+
+    //部分模板的快照很小, 直接逐个比较
+    if (kiran_fprint_gallery_is_subset(gallery))
+    {
+        for (i = 0; i < gallery->number; i++)
+        {
+            if (g_strcmp0(gallery->ids[i], id) == 0)
+                return i;
+        }
+
+        return -1;
+    }
+
+    g_mutex_lock(&data->lock);
+    found = g_hash_table_lookup_extended(data->index, id, NULL, &value);
+    g_mutex_unlock(&data->lock);
+
+    //共享数据中可能有快照创建之后追加的模板
+    if (!found || GPOINTER_TO_INT(value) >= gallery->number)
+        return -1;
+
+    return GPOINTER_TO_INT(value);
+}
+
+static void
+kiran_fprint_gallery_subset_add(KiranFprintGallery *gallery,
+                                unsigned char *template,
+                                unsigned int length,
+                                const gchar *id)
+{
+    int n = gallery->number;
+
+    gallery->templates[n] = template;
+    gallery->lens[n] = length;
+    gallery->ids[n] = id;
+    gallery->number++;
+}
+
+static void
+kiran_fprint_store_finalize(GObject *object)
+{
+    KiranFprintStore *store;
+    KiranFprintStorePrivate *priv;
+
+    store = KIRAN_FPRINT_STORE(object);
+    priv = store->priv;
+
+    if (priv->monitor)
+    {
+        g_file_monitor_cancel(priv->monitor);
+        g_object_unref(priv->monitor);
+    }
+
+    kiran_fprint_gallery_unref(priv->gallery);
+    g_mutex_clear(&priv->mutex);
+    g_free(priv->index_path);
+    g_free(priv->dir);
+
+    G_OBJECT_CLASS(kiran_fprint_store_parent_class)->finalize(object);
+}
+
+static void
+kiran_fprint_store_class_init(KiranFprintStoreClass *class)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS(class);
+
+    object_class->finalize = kiran_fprint_store_finalize;
+
+    g_type_class_add_private(class, sizeof(KiranFprintStorePrivate));
+}
+
+static void
+kiran_fprint_store_init(KiranFprintStore *self)
+{
+    KiranFprintStorePrivate *priv;
+
+    priv = self->priv = KIRAN_FPRINT_STORE_GET_PRIVATE(self);
+    priv->dir = NULL;
+    priv->index_path = NULL;
+    priv->gallery = NULL;
+    priv->serial = 0;
+    priv->monitor = NULL;
+    priv->index_ino = 0;
+    priv->index_size = -1;
+    priv->index_mtime = 0;
+    priv->data_size = 0;
+    priv->dead_size = 0;
+    priv->migrate_pending = FALSE;
+
+    g_mutex_init(&priv->mutex);
+}
+
+static gchar *
+kiran_fprint_store_data_path(KiranFprintStore *store,
+                             guint32 generation)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    gchar *name;
+    gchar *path;
+
+    name = g_strdup_printf(STORE_DATA_FILE, generation);
+    path = g_build_filename(priv->dir, name, NULL);
+    g_free(name);
+
+    return path;
+}
+
+static int
+write_all(int fd, const void *buf, gsize len)
+{
+    const guint8 *p = buf;
+    gssize n;
+
+    while (len > 0)
+    {
+        n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int
+pwrite_all(int fd, const void *buf, gsize len, goffset offset)
+{
+    const guint8 *p = buf;
+    gssize n;
+
+    while (len > 0)
+    {
+        n = pwrite(fd, p, len, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        p += n;
+        len -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+//文件修改时间, 纳秒, 同一秒内的多次修改也能区分
+static gint64
+kiran_fprint_store_mtime(GStatBuf *st)
+{
+    return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
+}
+
+/* 记录本进程写入后索引文件的状态, 用于区分外部修改, 调用时需持有 priv->mutex */
+static void
+kiran_fprint_store_remember_index(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    GStatBuf st;
+
+    if (g_stat(priv->index_path, &st) != 0)
+    {
+        priv->index_ino = 0;
+        priv->index_size = -1;
+        priv->index_mtime = 0;
+        return;
+    }
+
+    priv->index_ino = st.st_ino;
+    priv->index_size = st.st_size;
+    priv->index_mtime = kiran_fprint_store_mtime(&st);
+}
+
+/* 索引文件是否在本进程最后一次读写之后被修改过, 调用时需持有 priv->mutex */
+static gboolean
+kiran_fprint_store_index_changed(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    GStatBuf st;
+
+    if (g_stat(priv->index_path, &st) != 0)
+        return priv->index_size != -1;
+
+    return st.st_ino != priv->index_ino ||
+           st.st_size != priv->index_size ||
+           kiran_fprint_store_mtime(&st) != priv->index_mtime;
+}
+
+static gboolean
+kiran_fprint_store_check_header(KiranFprintIndexHeader *header)
+{
+    return memcmp(header->magic, STORE_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == STORE_VERSION &&
+           header->record_size == sizeof(KiranFprintIndexRecord);
+}
+
+static void
+kiran_fprint_store_init_header(KiranFprintIndexHeader *header,
+                               guint32 generation,
+                               guint32 count)
+{
+    memset(header, 0x00, sizeof(KiranFprintIndexHeader));
+    memcpy(header->magic, STORE_INDEX_MAGIC, sizeof(header->magic));
+    header->version = STORE_VERSION;
+    header->record_size = sizeof(KiranFprintIndexRecord);
+    header->generation = generation;
+    header->count = count;
+}
+
+/* 索引映射中实际可用的记录数 */
+static guint32
+kiran_fprint_store_record_count(GMappedFile *index_file)
+{
+    KiranFprintIndexHeader *header;
+    gsize len;
+
+    len = g_mapped_file_get_length(index_file);
+    header = (KiranFprintIndexHeader *)g_mapped_file_get_contents(index_file);
+
+    return MIN(header->count,
+               (len - sizeof(KiranFprintIndexHeader)) / sizeof(KiranFprintIndexRecord));
+}
+
+/* 打开索引文件, 不存在时创建一个空的索引 */
+static int
+kiran_fprint_store_open_index(KiranFprintStore *store,
+                              KiranFprintIndexHeader *header)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    gssize n;
+    int fd;
+
+    fd = open(priv->index_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        dzlog_error("open fprint index %s failed: %s", priv->index_path, g_strerror(errno));
+        return -1;
+    }
+
+    n = pread(fd, header, sizeof(KiranFprintIndexHeader), 0);
+    if (n == 0)
+    {
+        kiran_fprint_store_init_header(header, 0, 0);
+        if (pwrite_all(fd, header, sizeof(KiranFprintIndexHeader), 0) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else if (n != sizeof(KiranFprintIndexHeader) ||
+             !kiran_fprint_store_check_header(header))
+    {
+        dzlog_error("fprint index %s is corrupted", priv->index_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* 追加一个模板到数据文件和索引文件, 调用时需持有 priv->mutex */
+static int
+kiran_fprint_store_append(KiranFprintStore *store,
+                          int index_fd,
+                          KiranFprintIndexHeader *header,
+                          unsigned char *template,
+                          unsigned int length,
+                          const gchar *id,
+                          guint32 owner,
+                          const gchar *module,
+                          gint64 ctime)
+{
+    KiranFprintIndexRecord record;
+    gchar *data_path;
+    goffset offset;
+    int fd;
+    int ret = -1;
+
+    data_path = kiran_fprint_store_data_path(store, header->generation);
+    fd = open(data_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        dzlog_error("open fprint data %s failed: %s", data_path, g_strerror(errno));
+        g_free(data_path);
+        return -1;
+    }
+
+    offset = lseek(fd, 0, SEEK_END);
+    if (offset < 0 ||
+        write_all(fd, template, length) != 0 ||
+        fsync(fd) != 0)
+    {
+        dzlog_error("write fprint data %s failed: %s", data_path, g_strerror(errno));
+        goto out;
+    }
+
+    memset(&record, 0x00, sizeof(record));
+    g_strlcpy(record.id, id, sizeof(record.id));
+    record.offset = offset;
+    record.length = length;
+    record.owner = owner;
+    record.ctime = ctime;
+    if (module)
+    {
+        gchar *name = g_path_get_basename(module);
+        g_strlcpy(record.module, name, sizeof(record.module));
+        g_free(name);
+    }
+
+    //先写记录再更新记录数, 中途失败时索引仍然保持一致
+    if (pwrite_all(index_fd, &record, sizeof(record),
+                   sizeof(KiranFprintIndexHeader) + (goffset)header->count * sizeof(record)) != 0)
+        goto out;
+
+    header->count++;
+    if (pwrite_all(index_fd, header, sizeof(KiranFprintIndexHeader), 0) != 0 ||
+        fsync(index_fd) != 0)
+    {
+        header->count--;
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    close(fd);
+    g_free(data_path);
+
+    return ret;
+}
+
+//没有模板时的快照
+static KiranFprintGallery *
+kiran_fprint_store_empty_gallery()
+{
+    KiranFprintGalleryData *shared;
+    KiranFprintGallery *gallery;
+
+    shared = kiran_fprint_gallery_data_new(0);
+    gallery = kiran_fprint_gallery_new(shared, 0);
+    kiran_fprint_gallery_data_unref(shared);
+
+    return gallery;
+}
+
+static KiranFprintGallery *
+kiran_fprint_store_do_load(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintGalleryData *shared;
+    KiranFprintGallery *gallery;
+    KiranFprintIndexHeader *header;
+    KiranFprintIndexRecord *records;
+    GMappedFile *index_file;
+    GMappedFile *data_file;
+    GError *error = NULL;
+    const gchar *data;
+    gchar *data_path;
+    gsize index_len;
+    gsize data_len;
+    goffset live = 0;
+    guint32 count;
+    guint32 i;
+
+    kiran_fprint_store_remember_index(store);
+    priv->data_size = 0;
+    priv->dead_size = 0;
+
+    index_file = g_mapped_file_new(priv->index_path, FALSE, &error);
+    if (index_file == NULL)
+    {
+        dzlog_debug("map fprint index %s failed: %s", priv->index_path, error->message);
+        g_error_free(error);
+        return kiran_fprint_store_empty_gallery();
+    }
+
+    index_len = g_mapped_file_get_length(index_file);
+    header = (KiranFprintIndexHeader *)g_mapped_file_get_contents(index_file);
+    if (index_len < sizeof(KiranFprintIndexHeader) ||
+        !kiran_fprint_store_check_header(header))
+    {
+        dzlog_error("fprint index %s is corrupted", priv->index_path);
+        g_mapped_file_unref(index_file);
+        return kiran_fprint_store_empty_gallery();
+    }
+
+    count = kiran_fprint_store_record_count(index_file);
+    records = (KiranFprintIndexRecord *)(header + 1);
+
+    data_path = kiran_fprint_store_data_path(store, header->generation);
+    data_file = g_mapped_file_new(data_path, FALSE, &error);
+    if (data_file == NULL)
+    {
+        if (count > 0)
+            dzlog_error("map fprint data %s failed: %s", data_path, error->message);
+        g_error_free(error);
+        g_free(data_path);
+        g_mapped_file_unref(index_file);
+        return kiran_fprint_store_empty_gallery();
+    }
+    g_free(data_path);
+
+    data = g_mapped_file_get_contents(data_file);
+    data_len = g_mapped_file_get_length(data_file);
+
+    //预留空间, 之后保存的模板直接追加到共享数据中
+    shared = kiran_fprint_gallery_data_new(count * 2);
+    shared->index_file = index_file;
+    shared->data_file = data_file;
+
+    for (i = 0; i < count; i++)
+    {
+        KiranFprintIndexRecord *record = &records[i];
+
+        //已删除的模板
+        if (record->id[0] == '\0')
+            continue;
+
+        if (record->offset > data_len ||
+            record->length > data_len - record->offset ||
+            memchr(record->id, '\0', sizeof(record->id)) == NULL)
+        {
+            dzlog_error("skip broken fprint record %u", i);
+            continue;
+        }
+
+        if (kiran_fprint_gallery_data_add(shared,
+                                          (unsigned char *)data + record->offset,
+                                          record->length,
+                                          record->id,
+                                          i) < 0)
+            dzlog_error("skip duplicate fprint record %s", record->id);
+        else
+            live += record->length;
+    }
+
+    priv->data_size = data_len;
+    priv->dead_size = data_len - live;
+
+    gallery = kiran_fprint_gallery_new(shared, shared->length);
+    kiran_fprint_gallery_data_unref(shared);
+
+    dzlog_debug("load %d fprint templates from %s", gallery->number, priv->dir);
+
+    return gallery;
+}
+
+/* 指纹模块根据快照序号判断模板库是否变化, 序号不能为0, 调用时需持有 priv->mutex */
+static int
+kiran_fprint_store_next_serial(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+
+    priv->serial = priv->serial == G_MAXINT ? 1 : priv->serial + 1;
+
+    return priv->serial;
+}
+
+/* 映射索引和数据文件, 生成模板快照, 调用时需持有 priv->mutex */
+static KiranFprintGallery *
+kiran_fprint_store_load(KiranFprintStore *store)
+{
+    KiranFprintGallery *gallery;
+
+    KIRAN_TRACE1(gallery_load__start, store->priv->dir);
+
+    gallery = kiran_fprint_store_do_load(store);
+    gallery->serial = kiran_fprint_store_next_serial(store);
+
+    KIRAN_TRACE1(gallery_load__done, gallery->number);
+
+    return gallery;
+}
+
+static void
+kiran_fprint_store_dir_changed(GFileMonitor *monitor,
+                               GFile *file,
+                               GFile *other_file,
+                               GFileMonitorEvent event_type,
+                               gpointer user_data)
+{
+    KiranFprintStore *store = KIRAN_FPRINT_STORE(user_data);
+    KiranFprintStorePrivate *priv = store->priv;
+    gchar *name;
+
+    if (event_type != G_FILE_MONITOR_EVENT_CREATED &&
+        event_type != G_FILE_MONITOR_EVENT_DELETED &&
+        event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+        return;
+
+    name = g_file_get_basename(file);
+    if (g_strcmp0(name, STORE_INDEX_FILE) != 0)
+    {
+        g_free(name);
+        return;
+    }
+    g_free(name);
+
+    g_mutex_lock(&priv->mutex);
+    if (priv->gallery)
+    {
+        //本进程写入的修改已经更新到缓存，其它修改使缓存失效
+        if (kiran_fprint_store_index_changed(store))
+        {
+            dzlog_debug("fprint index changed out of band, drop cache");
+            kiran_fprint_gallery_unref(priv->gallery);
+            priv->gallery = NULL;
+        }
+    }
+    g_mutex_unlock(&priv->mutex);
+}
+
+static void
+kiran_fprint_store_setup_monitor(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    GError *error = NULL;
+    GFile *file;
+
+    file = g_file_new_for_path(priv->dir);
+    priv->monitor = g_file_monitor_directory(file,
+                                             G_FILE_MONITOR_NONE,
+                                             NULL,
+                                             &error);
+    if (priv->monitor == NULL)
+    {
+        dzlog_error("monitor fprint dir %s failed: %s", priv->dir, error->message);
+        g_error_free(error);
+    }
+    else
+    {
+        g_signal_connect(priv->monitor,
+                         "changed",
+                         G_CALLBACK(kiran_fprint_store_dir_changed),
+                         store);
+    }
+
+    g_object_unref(file);
+}
+
+/*
+ * 将旧版本每个模板一个 .bat 文件的数据导入模板库, 只在索引文件不存在时执行
+ * 先写入临时索引, 全部写入后同步一次再替换索引, 无法读取的旧文件跳过并保留
+ * 写入失败时不创建索引, 保存模板前会重新导入, 返回是否导入成功
+ */
+static gboolean
+kiran_fprint_store_migrate(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintIndexHeader header;
+    GPtrArray *migrated;
+    GError *error = NULL;
+    GDir *dir;
+    const char *name;
+    gchar *data_path;
+    gchar *tmp_path;
+    goffset offset = 0;
+    gboolean ok = TRUE;
+    guint i;
+    int data_fd;
+    int fd;
+
+    if (g_file_test(priv->index_path, G_FILE_TEST_EXISTS))
+        return TRUE;
+
+    dir = g_dir_open(priv->dir, 0, &error);
+    if (dir == NULL)
+    {
+        dzlog_debug("open dir %s failed: %s", priv->dir, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    //丢弃上次导入失败留下的数据
+    kiran_fprint_store_init_header(&header, 0, 0);
+    data_path = kiran_fprint_store_data_path(store, header.generation);
+    tmp_path = g_build_filename(priv->dir, STORE_INDEX_TMP_FILE, NULL);
+    data_fd = open(data_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (data_fd < 0 || fd < 0 ||
+        write_all(fd, &header, sizeof(header)) != 0)
+    {
+        dzlog_error("create fprint store for migration failed: %s", g_strerror(errno));
+        ok = FALSE;
+    }
+
+    migrated = g_ptr_array_new_with_free_func(g_free);
+    while (ok && (name = g_dir_read_name(dir)))
+    {
+        KiranFprintIndexRecord record;
+        gchar *path;
+        gchar *id;
+        gchar *contents;
+        gsize length;
+        GStatBuf st;
+
+        if (!g_str_has_suffix(name, LEGACY_TEMPLATE_SUFFIX))
+            continue;
+
+        path = g_build_filename(priv->dir, name, NULL);
+
+        error = NULL;
+        if (!g_file_get_contents(path, &contents, &length, &error))
+        {
+            //一个文件损坏不影响其它模板, 保留原文件
+            dzlog_error("skip fprint template %s: %s", path, error->message);
+            g_error_free(error);
+            g_free(path);
+            continue;
+        }
+
+        if (g_stat(path, &st) != 0)
+            st.st_mtime = 0;
+
+        id = g_strndup(name, strlen(name) - strlen(LEGACY_TEMPLATE_SUFFIX));
+        memset(&record, 0x00, sizeof(record));
+        g_strlcpy(record.id, id, sizeof(record.id));
+        g_free(id);
+        record.offset = offset;
+        record.length = length;
+        record.ctime = st.st_mtime;
+
+        if (write_all(data_fd, contents, length) != 0 ||
+            write_all(fd, &record, sizeof(record)) != 0)
+        {
+            dzlog_error("write migrated fprint template failed: %s", g_strerror(errno));
+            ok = FALSE;
+        }
+        else
+        {
+            offset += length;
+            header.count++;
+            g_ptr_array_add(migrated, g_strdup(path));
+        }
+
+        g_free(contents);
+        g_free(path);
+    }
+    g_dir_close(dir);
+
+    //所有模板写入后只同步一次
+    if (ok &&
+        (pwrite_all(fd, &header, sizeof(header), 0) != 0 ||
+         fsync(data_fd) != 0 ||
+         fsync(fd) != 0))
+    {
+        dzlog_error("sync migrated fprint store failed: %s", g_strerror(errno));
+        ok = FALSE;
+    }
+    if (data_fd >= 0)
+        close(data_fd);
+    if (fd >= 0)
+        close(fd);
+
+    if (ok && g_rename(tmp_path, priv->index_path) != 0)
+    {
+        dzlog_error("replace fprint index failed: %s", g_strerror(errno));
+        ok = FALSE;
+    }
+
+    if (ok)
+    {
+        for (i = 0; i < migrated->len; i++)
+            g_remove(g_ptr_array_index(migrated, i));
+
+        dzlog_debug("migrate %u fprint templates into %s", migrated->len, priv->index_path);
+    }
+    else
+    {
+        g_remove(tmp_path);
+        g_remove(data_path);
+        dzlog_error("migrate fprint templates failed, keep legacy templates");
+    }
+
+    g_ptr_array_free(migrated, TRUE);
+    g_free(data_path);
+    g_free(tmp_path);
+
+    return ok;
+}
+
+/*
+ * 获取当前保存的指纹模板, 只有第一次调用或缓存失效时才会映射模板库
+ * 返回值需要调用 kiran_fprint_gallery_unref 释放
+ */
+KiranFprintGallery *
+kiran_fprint_store_get_gallery(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintGallery *gallery;
+
+    g_mutex_lock(&priv->mutex);
+
+    if (priv->gallery == NULL)
+        priv->gallery = kiran_fprint_store_load(store);
+
+    gallery = kiran_fprint_gallery_ref(priv->gallery);
+
+    g_mutex_unlock(&priv->mutex);
+
+    return gallery;
+}
+
+/*
+ * 获取给定ID的指纹模板, 用于只与某个用户的模板进行比对
+ * 返回值需要调用 kiran_fprint_gallery_unref 释放
+ */
+KiranFprintGallery *
+kiran_fprint_store_get_gallery_for_ids(KiranFprintStore *store,
+                                       const gchar *const *ids)
+{
+    KiranFprintGallery *all;
+    KiranFprintGallery *gallery;
+    int index;
+    int i;
+
+    all = kiran_fprint_store_get_gallery(store);
+
+    //模板数据仍然属于共享数据, 部分模板的快照引用共享数据
+    gallery = kiran_fprint_gallery_new_subset(all->data,
+                                              ids ? g_strv_length((gchar **)ids) : 0);
+
+    for (i = 0; ids && ids[i]; i++)
+    {
+        index = kiran_fprint_gallery_find(all, ids[i]);
+        if (index < 0 || kiran_fprint_gallery_find(gallery, ids[i]) >= 0)
+            continue;
+
+        kiran_fprint_gallery_subset_add(gallery,
+                                        all->templates[index],
+                                        all->lens[index],
+                                        all->ids[index]);
+    }
+
+    kiran_fprint_gallery_unref(all);
+
+    return gallery;
+}
+
+/* 重新映射模板库, 正在使用旧快照的操作不受影响, 调用时需持有 priv->mutex */
+static void
+kiran_fprint_store_reload(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+
+    kiran_fprint_gallery_unref(priv->gallery);
+    priv->gallery = kiran_fprint_store_load(store);
+}
+
+/* 缓存为空或索引被其它进程修改时重新映射模板库, 调用时需持有 priv->mutex */
+static void
+kiran_fprint_store_ensure_loaded(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+
+    if (priv->gallery == NULL || kiran_fprint_store_index_changed(store))
+        kiran_fprint_store_reload(store);
+}
+
+/* 用新的快照替换缓存, 调用时需持有 priv->mutex */
+static void
+kiran_fprint_store_replace_gallery(KiranFprintStore *store,
+                                   KiranFprintGalleryData *shared)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+
+    kiran_fprint_gallery_unref(priv->gallery);
+    priv->gallery = kiran_fprint_gallery_new(shared, shared->length);
+    priv->gallery->serial = kiran_fprint_store_next_serial(store);
+
+    kiran_fprint_store_remember_index(store);
+}
+
+/*
+ * 把刚保存的模板追加到缓存中, 不重新映射模板库
+ * 已有的快照不受影响, 调用时需持有 priv->mutex
+ */
+static void
+kiran_fprint_store_add_cached(KiranFprintStore *store,
+                              unsigned char *template,
+                              unsigned int length,
+                              const gchar *id,
+                              guint32 record)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintGallery *gallery = priv->gallery;
+    KiranFprintGalleryData *shared = gallery->data;
+    GBytes *template_bytes;
+    GBytes *id_bytes;
+
+    //只能在最新快照的末尾追加, 容量不足时复制到更大的数组中
+    if (gallery->number != shared->length || shared->length >= shared->capacity)
+        shared = kiran_fprint_gallery_data_copy(shared, gallery->number, -1, gallery->number * 2);
+    else
+        shared = kiran_fprint_gallery_data_ref(shared);
+
+    template_bytes = g_bytes_new(template, length);
+    id_bytes = g_bytes_new(id, strlen(id) + 1);
+    g_ptr_array_add(shared->owned, template_bytes);
+    g_ptr_array_add(shared->owned, id_bytes);
+
+    kiran_fprint_gallery_data_add(shared,
+                                  (unsigned char *)g_bytes_get_data(template_bytes, NULL),
+                                  length,
+                                  g_bytes_get_data(id_bytes, NULL),
+                                  record);
+    priv->data_size += length;
+
+    kiran_fprint_store_replace_gallery(store, shared);
+    kiran_fprint_gallery_data_unref(shared);
+}
+
+int kiran_fprint_store_save(KiranFprintStore *store,
+                            unsigned char *template,
+                            unsigned int length,
+                            guint32 owner,
+                            const gchar *module,
+                            gchar **id)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintIndexHeader header;
+    int ret;
+    int fd;
+
+    KIRAN_TRACE2(save__start, owner, length);
+
+    //模板是二进制数据, 必须按长度计算摘要
+    *id = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+                                      template,
+                                      length);
+
+    g_mutex_lock(&priv->mutex);
+
+    //创建索引后不会再导入旧模板, 导入成功前拒绝保存
+    if (priv->migrate_pending)
+    {
+        priv->migrate_pending = !kiran_fprint_store_migrate(store);
+        if (priv->migrate_pending)
+        {
+            g_mutex_unlock(&priv->mutex);
+            KIRAN_TRACE1(save__done, -1);
+            return -1;
+        }
+
+        if (priv->gallery)
+            kiran_fprint_store_reload(store);
+    }
+
+    //追加的记录号要和缓存对应, 索引被其它进程修改时先重新加载
+    kiran_fprint_store_ensure_loaded(store);
+
+    if (kiran_fprint_gallery_find(priv->gallery, *id) >= 0)
+    {
+        //相同的模板已经保存过
+        g_mutex_unlock(&priv->mutex);
+        KIRAN_TRACE1(save__done, 0);
+        return 0;
+    }
+
+    ret = -1;
+    fd = kiran_fprint_store_open_index(store, &header);
+    if (fd >= 0)
+    {
+        ret = kiran_fprint_store_append(store, fd, &header,
+                                        template, length,
+                                        *id, owner, module,
+                                        g_get_real_time() / G_USEC_PER_SEC);
+        close(fd);
+    }
+
+    if (ret == 0)
+        kiran_fprint_store_add_cached(store, template, length, *id, header.count - 1);
+    else
+        g_warning("save fingerprint template %s fail", *id);
+
+    g_mutex_unlock(&priv->mutex);
+
+    KIRAN_TRACE1(save__done, ret);
+
+    return ret;
+}
+
+/* 把未删除的模板整理到新的数据文件中, 调用后需要重新加载, 调用时需持有 priv->mutex */
+static int
+kiran_fprint_store_compact(KiranFprintStore *store)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintIndexHeader *old_header;
+    KiranFprintIndexRecord *old_records;
+    KiranFprintIndexHeader header;
+    GMappedFile *index_file = NULL;
+    GMappedFile *data_file = NULL;
+    GError *error = NULL;
+    gchar *old_data_path = NULL;
+    gchar *data_path = NULL;
+    gchar *tmp_path = NULL;
+    goffset offset = 0;
+    guint32 count = 0;
+    guint32 i;
+    int data_fd = -1;
+    int index_fd = -1;
+    int ret = -1;
+
+    //缓存中的映射不包含之后追加的模板, 重新映射
+    index_file = g_mapped_file_new(priv->index_path, FALSE, &error);
+    if (index_file == NULL)
+    {
+        dzlog_error("map fprint index %s failed: %s", priv->index_path, error->message);
+        g_error_free(error);
+        return -1;
+    }
+
+    old_header = (KiranFprintIndexHeader *)g_mapped_file_get_contents(index_file);
+    if (g_mapped_file_get_length(index_file) < sizeof(KiranFprintIndexHeader) ||
+        !kiran_fprint_store_check_header(old_header))
+    {
+        dzlog_error("fprint index %s is corrupted", priv->index_path);
+        goto out;
+    }
+    old_records = (KiranFprintIndexRecord *)(old_header + 1);
+
+    old_data_path = kiran_fprint_store_data_path(store, old_header->generation);
+    data_file = g_mapped_file_new(old_data_path, FALSE, &error);
+    if (data_file == NULL)
+    {
+        dzlog_error("map fprint data %s failed: %s", old_data_path, error->message);
+        g_error_free(error);
+        goto out;
+    }
+
+    data_path = kiran_fprint_store_data_path(store, old_header->generation + 1);
+    tmp_path = g_build_filename(priv->dir, STORE_INDEX_TMP_FILE, NULL);
+
+    data_fd = open(data_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    index_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (data_fd < 0 || index_fd < 0)
+    {
+        dzlog_error("create compacted fprint store failed: %s", g_strerror(errno));
+        goto out;
+    }
+
+    kiran_fprint_store_init_header(&header, old_header->generation + 1, 0);
+    if (write_all(index_fd, &header, sizeof(header)) != 0)
+        goto out;
+
+    for (i = 0; i < kiran_fprint_store_record_count(index_file); i++)
+    {
+        KiranFprintIndexRecord record;
+        const gchar *data;
+
+        record = old_records[i];
+        if (record.id[0] == '\0' ||
+            record.offset + record.length > g_mapped_file_get_length(data_file))
+            continue;
+
+        data = g_mapped_file_get_contents(data_file) + record.offset;
+        if (write_all(data_fd, data, record.length) != 0)
+            goto out;
+
+        record.offset = offset;
+        offset += record.length;
+
+        if (write_all(index_fd, &record, sizeof(record)) != 0)
+            goto out;
+        count++;
+    }
+
+    header.count = count;
+    if (pwrite_all(index_fd, &header, sizeof(header), 0) != 0 ||
+        fsync(data_fd) != 0 ||
+        fsync(index_fd) != 0)
+        goto out;
+
+    //替换索引后新数据文件才会生效
+    if (g_rename(tmp_path, priv->index_path) != 0)
+    {
+        dzlog_error("replace fprint index failed: %s", g_strerror(errno));
+        goto out;
+    }
+
+    g_remove(old_data_path);
+    ret = 0;
+
+out:
+    if (data_fd >= 0)
+        close(data_fd);
+    if (index_fd >= 0)
+        close(index_fd);
+
+    if (ret != 0 && tmp_path)
+    {
+        g_remove(tmp_path);
+        g_remove(data_path);
+    }
+
+    if (data_file)
+        g_mapped_file_unref(data_file);
+    g_mapped_file_unref(index_file);
+    g_free(old_data_path);
+    g_free(data_path);
+    g_free(tmp_path);
+
+    return ret;
+}
+
+/* 清空索引记录中的ID, 标记模板已删除, 调用时需持有 priv->mutex */
+static int
+kiran_fprint_store_mark_deleted(KiranFprintStore *store,
+                                guint32 record)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    const char empty = '\0';
+    int fd;
+    int ret = 0;
+
+    fd = open(priv->index_path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        dzlog_error("open fprint index %s failed: %s", priv->index_path, g_strerror(errno));
+        return -1;
+    }
+
+    if (pwrite_all(fd, &empty, sizeof(empty),
+                   sizeof(KiranFprintIndexHeader) +
+                       (goffset)record * sizeof(KiranFprintIndexRecord) +
+                       G_STRUCT_OFFSET(KiranFprintIndexRecord, id)) != 0 ||
+        fsync(fd) != 0)
+    {
+        dzlog_error("delete fprint record %u failed: %s", record, g_strerror(errno));
+        ret = -1;
+    }
+    close(fd);
+
+    return ret;
+}
+
+/*
+ * 删除模板, 只在索引中标记删除
+ * 已删除模板占用的空间超过数据文件的 STORE_COMPACT_RATIO% 时才整理数据文件
+ */
+int kiran_fprint_store_remove(KiranFprintStore *store,
+                              const gchar *id)
+{
+    KiranFprintStorePrivate *priv = store->priv;
+    KiranFprintGallery *gallery;
+    KiranFprintGalleryData *shared;
+    int index;
+    int ret;
+
+    g_mutex_lock(&priv->mutex);
+
+    kiran_fprint_store_ensure_loaded(store);
+
+    gallery = priv->gallery;
+    index = kiran_fprint_gallery_find(gallery, id);
+    if (index < 0)
+    {
+        g_mutex_unlock(&priv->mutex);
+        return -1;
+    }
+
+    ret = kiran_fprint_store_mark_deleted(store, gallery->data->records[index]);
+    if (ret == 0)
+    {
+        priv->dead_size += gallery->lens[index];
+        shared = kiran_fprint_gallery_data_copy(gallery->data,
+                                                gallery->number,
+                                                index,
+                                                gallery->data->capacity);
+        kiran_fprint_store_replace_gallery(store, shared);
+        kiran_fprint_gallery_data_unref(shared);
+
+        if (priv->dead_size >= STORE_COMPACT_MIN &&
+            priv->dead_size * 100 > priv->data_size * STORE_COMPACT_RATIO &&
+            kiran_fprint_store_compact(store) == 0)
+            kiran_fprint_store_reload(store);
+    }
+
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+
+KiranFprintStore *
+kiran_fprint_store_new(const char *dir)
+{
+    KiranFprintStore *store;
+    KiranFprintStorePrivate *priv;
+
+    store = g_object_new(KIRAN_TYPE_FPRINT_STORE, NULL);
+    priv = store->priv;
+    priv->dir = g_strdup(dir);
+    priv->index_path = g_build_filename(dir, STORE_INDEX_FILE, NULL);
+
+    if (!g_file_test(priv->dir, G_FILE_TEST_IS_DIR))
+    {
+        g_mkdir(priv->dir, S_IRWXU);
+    }
+
+    priv->migrate_pending = !kiran_fprint_store_migrate(store);
+    kiran_fprint_store_setup_monitor(store);
+
+    return store;
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+#ifndef __KIRAN_FPRINT_STORE_H__
+#define __KIRAN_FPRINT_STORE_H__
+
+#include <glib-object.h>
+#include <glib.h>
+
+#define KIRAN_TYPE_FPRINT_STORE (kiran_fprint_store_get_type())
+#define KIRAN_FPRINT_STORE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                                                            KIRAN_TYPE_FPRINT_STORE, KiranFprintStore))
+#define KIRAN_FPRINT_STORE_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), \
+                                                                 KIRAN_TYPE_FPRINT_STORE, KiranFprintStoreClass))
+#define KIRAN_IS_FPRINT_STORE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                                                               KIRAN_TYPE_FPRINT_STORE))
+#define KIRAN_IS_FPRINT_STORE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), \
+                                                                    KIRAN_TYPE_FPRINT_STORE))
+#define KIRAN_FPRINT_STORE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), \
+                                                                     KIRAN_TYPE_FPRINT_STORE, KiranFprintStoreClass))
+
+typedef struct _KiranFprintStore KiranFprintStore;
+typedef struct _KiranFprintStoreClass KiranFprintStoreClass;
+typedef struct _KiranFprintStorePrivate KiranFprintStorePrivate;
+typedef struct _KiranFprintGallery KiranFprintGallery;
+typedef struct _KiranFprintGalleryData KiranFprintGalleryData;
+
+struct _KiranFprintStore
+{
+    GObject parent;
+
+    KiranFprintStorePrivate *priv;
+};
+
+struct _KiranFprintStoreClass
+{
+    GObjectClass parent;
+};
+
+/*
+ * 已保存指纹模板的只读快照, 一旦创建不再修改, 通过引用计数在线程间共享
+ * templates/lens 可以直接传给指纹模块的比对接口
+ */
+struct _KiranFprintGallery
+{
+    gint ref_count;
+
+    int number;                /* 模板个数 */
+    unsigned char **templates; /* 模板数据 */
+    unsigned int *lens;        /* 模板长度 */
+    const gchar **ids;         /* 模板ID */
+    int serial;                /* 快照序号, 模板库每次变化时改变, 只包含部分模板的快照为0 */
+
+    KiranFprintGalleryData *data; /* 多个快照共享的模板数据和ID索引, 只在模板库内部使用 */
+};
+
+KiranFprintGallery *kiran_fprint_gallery_ref(KiranFprintGallery *gallery);
+void kiran_fprint_gallery_unref(KiranFprintGallery *gallery);
+int kiran_fprint_gallery_find(KiranFprintGallery *gallery,
+                              const gchar *id);
+
+GType kiran_fprint_store_get_type();
+KiranFprintStore *kiran_fprint_store_new(const char *dir);
+KiranFprintGallery *kiran_fprint_store_get_gallery(KiranFprintStore *store);
+KiranFprintGallery *kiran_fprint_store_get_gallery_for_ids(KiranFprintStore *store,
+                                                           const gchar *const *ids);
+int kiran_fprint_store_save(KiranFprintStore *store,
+                            unsigned char *template,
+                            unsigned int length,
+                            guint32 owner,
+                            const gchar *module,
+                            gchar **id);
+int kiran_fprint_store_remove(KiranFprintStore *store,
+                              const gchar *id);
+
+#endif /* __KIRAN_FPRINT_STORE_H__ */
@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#include "kiran-operation.h"
+
+void
+kiran_operation_init(KiranOperation *operation)
+{
+    g_atomic_int_set(&operation->state, KIRAN_OPERATION_IDLE);
+    g_atomic_int_set(&operation->generation, 0);
+}
+
+/*
+ * 开始一次操作, 只能从 IDLE 开始,
+ * 返回新操作的代数, 已经有操作时返回0
+ */
+guint
+kiran_operation_begin(KiranOperation *operation)
+{
+    guint generation;
+
+    if (!g_atomic_int_compare_and_exchange(&operation->state,
+                                           KIRAN_OPERATION_IDLE,
+                                           KIRAN_OPERATION_OPENING))
+        return 0;
+
+    //代数0保留给"没有操作"
+    do
+    {
+        generation = (guint)g_atomic_int_add(&operation->generation, 1) + 1;
+    } while (generation == 0);
+
+    return generation;
+}
+
+/*
+ * 工作线程切换操作的阶段,
+ * 操作已被取消时不切换, 返回 FALSE
+ */
+gboolean
+kiran_operation_enter(KiranOperation *operation,
+                      guint generation,
+                      KiranOperationState state)
+{
+    gint old;
+
+    do
+    {
+        if (kiran_operation_is_cancelled(operation, generation))
+            return FALSE;
+
+        old = g_atomic_int_get(&operation->state);
+        if (old == KIRAN_OPERATION_CANCELLING)
+            return FALSE;
+    } while (!g_atomic_int_compare_and_exchange(&operation->state, old, state));
+
+    //切换后再次检查, 并发的取消会随后把状态改成 CANCELLING
+    return !kiran_operation_is_cancelled(operation, generation);
+}
+
+/*
+ * 取消代数为 generation 的操作, O(1), 和 kiran_operation_begin 一样在主循环中调用
+ * 操作已经结束或已被取消时返回 FALSE
+ */
+gboolean
+kiran_operation_cancel(KiranOperation *operation,
+                       guint generation)
+{
+    gint old;
+
+    if (generation == 0 ||
+        !g_atomic_int_compare_and_exchange(&operation->generation,
+                                           (gint)generation,
+                                           (gint)(generation + 1)))
+        return FALSE;
+
+    //工作线程可能已经回到 IDLE, 这时不再改变状态
+    do
+    {
+        old = g_atomic_int_get(&operation->state);
+        if (old == KIRAN_OPERATION_IDLE)
+            break;
+    } while (!g_atomic_int_compare_and_exchange(&operation->state,
+                                                old,
+                                                KIRAN_OPERATION_CANCELLING));
+
+    return TRUE;
+}
+
+gboolean
+kiran_operation_is_cancelled(KiranOperation *operation,
+                             guint generation)
+{
+    return (guint)g_atomic_int_get(&operation->generation) != generation;
+}
+
+//操作结束, 由执行操作的线程调用
+void
+kiran_operation_end(KiranOperation *operation)
+{
+    g_atomic_int_set(&operation->state, KIRAN_OPERATION_IDLE);
+}
+
+KiranOperationState
+kiran_operation_get_state(KiranOperation *operation,
+                          guint *generation)
+{
+    if (generation)
+        *generation = (guint)g_atomic_int_get(&operation->generation);
+
+    return g_atomic_int_get(&operation->state);
+}
+
+const gchar *
+kiran_operation_state_to_string(KiranOperationState state)
+{
+    switch (state)
+    {
+    case KIRAN_OPERATION_IDLE:
+        return "idle";
+    case KIRAN_OPERATION_OPENING:
+        return "opening";
+    case KIRAN_OPERATION_ACQUIRING:
+        return "acquiring";
+    case KIRAN_OPERATION_MATCHING:
+        return "matching";
+    case KIRAN_OPERATION_SAVING:
+        return "saving";
+    case KIRAN_OPERATION_CANCELLING:
+        return "cancelling";
+    default:
+        return "unknown";
+    }
+}
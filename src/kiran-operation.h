@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifndef __KIRAN_OPERATION_H__
+#define __KIRAN_OPERATION_H__
+
+#include <glib.h>
+
+/*
+ * 设备操作的状态机, 主循环和工作线程都只通过原子操作访问, 不加锁
+ *
+ * 每次开始操作时代数(generation)加一, 工作线程记住自己操作的代数,
+ * 取消操作只是把代数再加一并切换到 CANCELLING, 工作线程发现代数变化即停止,
+ * 对已经结束的旧操作的取消不会影响之后的操作
+ * 开始和取消在主循环中调用, 切换阶段和结束在执行操作的线程中调用, 状态可以在任意线程中读取
+ *
+ *   IDLE -> OPENING -> ACQUIRING <-> MATCHING -> SAVING -> IDLE
+ *   除 IDLE 外的任何状态都可以被取消切换到 CANCELLING, 工作线程结束后回到 IDLE
+ */
+
+typedef enum
+{
+    KIRAN_OPERATION_IDLE = 0,   //空闲
+    KIRAN_OPERATION_OPENING,    //操作已开始, 准备设备和模板
+    KIRAN_OPERATION_ACQUIRING,  //等待采集
+    KIRAN_OPERATION_MATCHING,   //比对或合成模板
+    KIRAN_OPERATION_SAVING,     //保存模板
+    KIRAN_OPERATION_CANCELLING, //已取消, 等待工作线程结束
+} KiranOperationState;
+
+typedef struct
+{
+    gint state;      /* KiranOperationState */
+    gint generation; /* 当前操作的代数 */
+} KiranOperation;
+
+void kiran_operation_init(KiranOperation *operation);
+guint kiran_operation_begin(KiranOperation *operation);
+gboolean kiran_operation_enter(KiranOperation *operation,
+                               guint generation,
+                               KiranOperationState state);
+gboolean kiran_operation_cancel(KiranOperation *operation,
+                                guint generation);
+gboolean kiran_operation_is_cancelled(KiranOperation *operation,
+                                      guint generation);
+void kiran_operation_end(KiranOperation *operation);
+KiranOperationState kiran_operation_get_state(KiranOperation *operation,
+                                              guint *generation);
+const gchar *kiran_operation_state_to_string(KiranOperationState state);
+
+#endif /* __KIRAN_OPERATION_H__ */
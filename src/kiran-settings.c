@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-settings.h"
+
+/* 默认值, 可以在编译时修改 */
+#ifndef MAX_TRY_COUNT
+#define MAX_TRY_COUNT 50 /* 最大尝试次数 */
+#endif
+
+#define DEFAULT_TIME_OUT 600000     /* 一次等待指纹时间，单位毫秒*/
+#define SUPPORT_FINGER_NUMBER 10000 /* 最大指纹模板数目 */
+#define FPRINT_IDLE_TIMEOUT 60      /* 设备空闲多少秒后关闭 */
+
+#define ENROLL_FACE_NUM 10
+#define FACE_SIZE 160
+#define FACE_CAPTURE_INTERVAL 100 /* 人脸采集间隔, 毫秒 */
+#define FACE_IDLE_TIMEOUT 60      /* 人脸模块空闲多少秒后释放 */
+#define DEFAULT_ZMQ_ADDR "/tmp/KiranFaceService.ipc"
+#define FACE_ZMQ_ADDR "ipc:///tmp/KiranFaceCompareService.ipc"
+
+#define GROUP_GENERAL "General"
+#define GROUP_FPRINT "Fprint"
+#define GROUP_FACE "Face"
+
+static GMutex settings_mutex;
+static KiranSettings *current = NULL;
+
+static KiranSettings *
+kiran_settings_new(void)
+{
+    KiranSettings *settings;
+
+    settings = g_new0(KiranSettings, 1);
+    settings->ref_count = 1;
+
+    settings->idle_exit = 0;
+
+    settings->max_try_count = MAX_TRY_COUNT;
+    settings->acquire_timeout = DEFAULT_TIME_OUT;
+    settings->max_templates = SUPPORT_FINGER_NUMBER;
+    settings->device_idle_timeout = FPRINT_IDLE_TIMEOUT;
+    settings->quality_threshold = -1;
+
+    settings->enroll_face_num = ENROLL_FACE_NUM;
+    settings->face_size = FACE_SIZE;
+    settings->capture_interval = FACE_CAPTURE_INTERVAL;
+    settings->face_idle_timeout = FACE_IDLE_TIMEOUT;
+    settings->face_service_path = g_strdup(DEFAULT_ZMQ_ADDR);
+    settings->compare_service = g_strdup(FACE_ZMQ_ADDR);
+
+    return settings;
+}
+
+void kiran_settings_unref(KiranSettings *settings)
+{
+    if (settings == NULL)
+        return;
+
+    if (!g_atomic_int_dec_and_test(&settings->ref_count))
+        return;
+
+    g_free(settings->face_service_path);
+    g_free(settings->compare_service);
+    g_free(settings);
+}
+
+//读取整数配置, 没有配置或配置不合法时保留默认值
+static void
+kiran_settings_read_int(GKeyFile *keyfile,
+                        const gchar *group,
+                        const gchar *key,
+                        gint min,
+                        gint *value)
+{
+    GError *error = NULL;
+    gint v;
+
+    if (!g_key_file_has_key(keyfile, group, key, NULL))
+        return;
+
+    v = g_key_file_get_integer(keyfile, group, key, &error);
+    if (error)
+    {
+        dzlog_warn("invalid setting %s/%s: %s", group, key, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (v < min)
+    {
+        dzlog_warn("invalid setting %s/%s: %d is less than %d", group, key, v, min);
+        return;
+    }
+
+    *value = v;
+}
+
+static void
+kiran_settings_read_uint(GKeyFile *keyfile,
+                         const gchar *group,
+                         const gchar *key,
+                         guint min,
+                         guint *value)
+{
+    gint v = *value;
+
+    kiran_settings_read_int(keyfile, group, key, min, &v);
+    *value = v;
+}
+
+static void
+kiran_settings_read_string(GKeyFile *keyfile,
+                           const gchar *group,
+                           const gchar *key,
+                           gchar **value)
+{
+    gchar *v;
+
+    v = g_key_file_get_string(keyfile, group, key, NULL);
+    if (v == NULL || *v == '\0')
+    {
+        g_free(v);
+        return;
+    }
+
+    g_free(*value);
+    *value = g_strstrip(v);
+}
+
+/*
+ * 加载配置文件, 替换当前的配置, 只能在主线程中调用
+ * 文件不存在或不能解析时使用默认值, 返回 FALSE
+ */
+gboolean
+kiran_settings_load(const gchar *path)
+{
+    g_autoptr(GError) error = NULL;
+    KiranSettings *settings;
+    KiranSettings *old;
+    GKeyFile *keyfile;
+    gboolean ret;
+
+    settings = kiran_settings_new();
+    keyfile = g_key_file_new();
+
+    ret = g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, &error);
+    if (ret)
+    {
+        kiran_settings_read_uint(keyfile, GROUP_GENERAL, "IdleExit", 0, &settings->idle_exit);
+
+        kiran_settings_read_uint(keyfile, GROUP_FPRINT, "MaxTryCount", 1, &settings->max_try_count);
+        kiran_settings_read_uint(keyfile, GROUP_FPRINT, "AcquireTimeout", 1, &settings->acquire_timeout);
+        kiran_settings_read_uint(keyfile, GROUP_FPRINT, "MaxTemplates", 1, &settings->max_templates);
+        kiran_settings_read_uint(keyfile, GROUP_FPRINT, "DeviceIdleTimeout", 0, &settings->device_idle_timeout);
+        kiran_settings_read_int(keyfile, GROUP_FPRINT, "QualityThreshold", G_MININT, &settings->quality_threshold);
+
+        kiran_settings_read_uint(keyfile, GROUP_FACE, "EnrollFaceNum", 1, &settings->enroll_face_num);
+        kiran_settings_read_uint(keyfile, GROUP_FACE, "FaceSize", 20, &settings->face_size);
+        kiran_settings_read_uint(keyfile, GROUP_FACE, "CaptureInterval", 1, &settings->capture_interval);
+        kiran_settings_read_uint(keyfile, GROUP_FACE, "IdleTimeout", 0, &settings->face_idle_timeout);
+        kiran_settings_read_string(keyfile, GROUP_FACE, "ServicePath", &settings->face_service_path);
+        kiran_settings_read_string(keyfile, GROUP_FACE, "CompareService", &settings->compare_service);
+
+        dzlog_info("load settings from %s", path);
+    }
+    else
+    {
+        dzlog_warn("load settings from %s failed: %s, use default settings", path, error->message);
+    }
+
+    g_key_file_free(keyfile);
+
+    g_mutex_lock(&settings_mutex);
+    old = current;
+    current = settings;
+    g_mutex_unlock(&settings_mutex);
+
+    kiran_settings_unref(old);
+
+    return ret;
+}
+
+/*
+ * 获取当前配置的快照, 可以在任意线程中调用, 需要调用 kiran_settings_unref 释放
+ */
+KiranSettings *
+kiran_settings_get(void)
+{
+    KiranSettings *settings;
+
+    g_mutex_lock(&settings_mutex);
+
+    if (current == NULL)
+        current = kiran_settings_new();
+
+    settings = current;
+    g_atomic_int_inc(&settings->ref_count);
+
+    g_mutex_unlock(&settings_mutex);
+
+    return settings;
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifndef __KIRAN_SETTINGS_H__
+#define __KIRAN_SETTINGS_H__
+
+#include <glib.h>
+
+/*
+ * 运行时配置, 从 settings.conf 中读取, 没有配置的项使用编译时的默认值
+ *
+ * 配置是只读的快照, 通过引用计数在线程间共享, 重新加载时替换为新的快照,
+ * 操作开始时获取一次快照, 重新加载后的配置在下一次操作时生效
+ */
+
+typedef struct _KiranSettings KiranSettings;
+
+struct _KiranSettings
+{
+    gint ref_count;
+
+    /* [General] */
+    guint idle_exit; /* 空闲多少分钟后退出, 0表示不退出 */
+
+    /* [Fprint] */
+    guint max_try_count;       /* 一次录入或认证最多采集次数 */
+    guint acquire_timeout;     /* 一次等待指纹的时间, 毫秒 */
+    guint max_templates;       /* 最多保存的指纹模板数 */
+    guint device_idle_timeout; /* 设备空闲多少秒后关闭 */
+    gint quality_threshold;    /* 指纹图像质量阈值, 小于0表示使用指纹模块的默认值 */
+
+    /* [Face] */
+    guint enroll_face_num;     /* 录入需要的人脸图像数 */
+    guint face_size;           /* 合适的人脸宽度, 像素 */
+    guint capture_interval;    /* 人脸采集间隔, 毫秒 */
+    guint face_idle_timeout;   /* 人脸模块空闲多少秒后释放 */
+    gchar *face_service_path;  /* 发布人脸图像的ipc文件 */
+    gchar *compare_service;    /* 人脸比对服务地址 */
+};
+
+gboolean kiran_settings_load(const gchar *path);
+KiranSettings *kiran_settings_get(void);
+void kiran_settings_unref(KiranSettings *settings);
+
+#endif /* __KIRAN_SETTINGS_H__ */
@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifdef ENABLE_ZLOG_EX
+#include <zlog_ex.h>
+#else
+#include <zlog.h>
+#endif
+
+#include "kiran-stats.h"
+
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define NUM_BUCKETS ((32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct
+{
+    GMutex mutex;
+    guint64 count;
+    guint64 failures;
+    guint64 total; /* 总耗时 */
+    guint64 max;
+    guint64 buckets[NUM_BUCKETS];
+} KiranStatsHistogram;
+
+static const gchar *stage_names[KIRAN_STATS_NUM] = {
+    "template-load",
+    "acquire",
+    "identify",
+    "match",
+    "search",
+    "save",
+    "face-detect",
+    "face-compare",
+};
+
+//静态分配的 GMutex 不需要初始化
+static KiranStatsHistogram histograms[KIRAN_STATS_NUM];
+
+/*
+ * 小于 SUB_BUCKETS 的值每个值一个桶,
+ * 其余的值按最高位所在的2的幂区间分组, 每组再按接下来的 SUB_BUCKET_BITS 位分成子桶
+ */
+static guint
+kiran_stats_bucket_index(guint64 value)
+{
+    guint msb;
+
+    if (value >= G_MAXUINT32)
+        return NUM_BUCKETS - 1;
+
+    if (value < SUB_BUCKETS)
+        return value;
+
+    msb = g_bit_nth_msf(value, -1);
+
+    return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+           ((value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+//桶中最大的值, 百分位数按桶的上界报告
+static guint64
+kiran_stats_bucket_upper(guint index)
+{
+    guint group;
+    guint sub;
+
+    if (index < SUB_BUCKETS)
+        return index;
+
+    group = index / SUB_BUCKETS;
+    sub = index % SUB_BUCKETS;
+
+    return ((guint64)(SUB_BUCKETS + sub + 1) << (group - 1)) - 1;
+}
+
+static guint64
+kiran_stats_percentile(KiranStatsHistogram *histogram,
+                       gdouble percentile)
+{
+    guint64 rank;
+    guint64 seen = 0;
+    guint i;
+
+    if (histogram->count == 0)
+        return 0;
+
+    rank = (guint64)(histogram->count * percentile / 100.0 + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    for (i = 0; i < NUM_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+            return MIN(kiran_stats_bucket_upper(i), histogram->max);
+    }
+
+    return histogram->max;
+}
+
+/*
+ * 记录一次 stage 阶段的耗时, start 为阶段开始时的 g_get_monotonic_time()
+ */
+void
+kiran_stats_record(KiranStatsStage stage,
+                   gint64 start,
+                   gboolean success)
+{
+    KiranStatsHistogram *histogram;
+    gint64 elapsed;
+
+    g_return_if_fail(stage < KIRAN_STATS_NUM);
+
+    histogram = &histograms[stage];
+    elapsed = g_get_monotonic_time() - start;
+    if (elapsed < 0)
+        elapsed = 0;
+
+    g_mutex_lock(&histogram->mutex);
+    histogram->count++;
+    if (!success)
+        histogram->failures++;
+    histogram->total += elapsed;
+    if ((guint64)elapsed > histogram->max)
+        histogram->max = elapsed;
+    histogram->buckets[kiran_stats_bucket_index(elapsed)]++;
+    g_mutex_unlock(&histogram->mutex);
+}
+
+/*
+ * 返回所有阶段的统计, 类型为 a(sttttttt):
+ * 阶段名, 次数, 失败次数, 平均耗时, p50, p90, p99, 最大耗时, 耗时单位为微秒
+ */
+GVariant *
+kiran_stats_get(void)
+{
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sttttttt)"));
+
+    for (i = 0; i < KIRAN_STATS_NUM; i++)
+    {
+        KiranStatsHistogram *histogram = &histograms[i];
+
+        g_mutex_lock(&histogram->mutex);
+        g_variant_builder_add(&builder, "(sttttttt)",
+                              stage_names[i],
+                              histogram->count,
+                              histogram->failures,
+                              histogram->count ? histogram->total / histogram->count : 0,
+                              kiran_stats_percentile(histogram, 50),
+                              kiran_stats_percentile(histogram, 90),
+                              kiran_stats_percentile(histogram, 99),
+                              histogram->max);
+        g_mutex_unlock(&histogram->mutex);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+//把 kiran_stats_get 返回的统计格式化为文本表格, 每个阶段一行
+gchar *
+kiran_stats_format(GVariant *stats)
+{
+    GString *str;
+    GVariantIter iter;
+    const gchar *name;
+    guint64 count, failures, mean, p50, p90, p99, max;
+
+    str = g_string_new(NULL);
+    g_string_append_printf(str, "%-14s %10s %10s %10s %10s %10s %10s %10s\n",
+                           "stage", "count", "failures", "mean(us)",
+                           "p50(us)", "p90(us)", "p99(us)", "max(us)");
+
+    g_variant_iter_init(&iter, stats);
+    while (g_variant_iter_next(&iter, "(&sttttttt)",
+                               &name, &count, &failures, &mean,
+                               &p50, &p90, &p99, &max))
+    {
+        g_string_append_printf(str,
+                               "%-14s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                               " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                               " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                               " %10" G_GUINT64_FORMAT "\n",
+                               name, count, failures, mean, p50, p90, p99, max);
+    }
+
+    return g_string_free(str, FALSE);
+}
+
+//把统计写到日志中, 收到 SIGUSR1 时调用
+void
+kiran_stats_dump(void)
+{
+    GVariant *stats;
+    gchar *text;
+    gchar **lines;
+    gint i;
+
+    stats = g_variant_ref_sink(kiran_stats_get());
+    text = kiran_stats_format(stats);
+    lines = g_strsplit(text, "\n", -1);
+
+    for (i = 0; lines[i] != NULL; i++)
+    {
+        if (lines[i][0] != '\0')
+            dzlog_info("stats: %s", lines[i]);
+    }
+
+    g_strfreev(lines);
+    g_free(text);
+    g_variant_unref(stats);
+}
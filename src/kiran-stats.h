@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2020 ~ 2021 KylinSec Co., Ltd. 
+ * kiran-cc-daemon is licensed under Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2. 
+ * You may obtain a copy of Mulan PSL v2 at:
+ *          http://license.coscl.org.cn/MulanPSL2 
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, 
+ * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, 
+ * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.  
+ * See the Mulan PSL v2 for more details.  
+ * 
+ * Author:     wangxiaoqing <wangxiaoqing@kylinos.com.cn>
+ */
+
+
+#ifndef __KIRAN_STATS_H__
+#define __KIRAN_STATS_H__
+
+#include <glib.h>
+
+/*
+ * 各处理阶段的耗时统计, 进程内全局, 可以在任意线程中记录
+ *
+ * 每个阶段一个对数分桶的直方图(HDR风格, 每个2的幂区间分8个子桶, 相对误差不超过12.5%),
+ * 记录次数, 失败次数, 总耗时和最大耗时, 单位微秒
+ */
+
+typedef enum
+{
+    KIRAN_STATS_TEMPLATE_LOAD = 0, //获取参与比对的模板
+    KIRAN_STATS_ACQUIRE,           //采集指纹
+    KIRAN_STATS_IDENTIFY,          //模块内部采集并比对
+    KIRAN_STATS_MATCH,             //1:1比对和模板合成
+    KIRAN_STATS_SEARCH,            //1:N比对
+    KIRAN_STATS_SAVE,              //保存模板
+    KIRAN_STATS_FACE_DETECT,       //人脸和眼睛检测
+    KIRAN_STATS_FACE_COMPARE,      //人脸比对服务
+    KIRAN_STATS_NUM,
+} KiranStatsStage;
+
+void kiran_stats_record(KiranStatsStage stage,
+                        gint64 start,
+                        gboolean success);
+GVariant *kiran_stats_get(void);
+gchar *kiran_stats_format(GVariant *stats);
+void kiran_stats_dump(void);
+
+#endif /* __KIRAN_STATS_H__ */
@@ -14,28 +14,264 @@
 
 #include "config.h"
 
-#include <dbus/dbus-glib-bindings.h>
+#include <gio/gio.h>
 #include <glib-object.h>
+#include <glib-unix.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gmodule.h>
 #include <locale.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #ifdef ENABLE_ZLOG_EX
 #include <zlog_ex.h>
 #else
 #include <zlog.h>
 #endif
+#include "kiran-biometrics-i.h"
 #include "kiran-biometrics.h"
+#include "kiran-settings.h"
+#include "kiran-stats.h"
+
+static GMainLoop *loop = NULL;
+static int exit_status = 0;
+static guint owner_id = 0;
+static gboolean exiting = FALSE; /* 空闲退出时已经释放名字, 等待已收到的调用处理完 */
+
+#define IDLE_CHECK_INTERVAL 30 /* 检查是否空闲的间隔, 秒 */
+
+static gboolean dump_stats = FALSE;
+static gint idle_exit = -1;  /* 空闲多少分钟后退出, 0表示不退出, 小于0时使用配置文件中的值 */
+static gint64 last_busy = 0; /* 最后一次有操作或客户端的时间 */
+
+static GOptionEntry entries[] = {
+    {"dump-stats", 0, 0, G_OPTION_ARG_NONE, &dump_stats, "Print the statistics of the running daemon and exit", NULL},
+    {"idle-exit", 0, 0, G_OPTION_ARG_INT, &idle_exit, "Exit after MINUTES without operations, 0 means never, overrides IdleExit in settings", "MINUTES"},
+    {NULL}};
+
+//释放名字后, 之前已经发给这里的调用都处理完才退出
+static gboolean
+on_drained(gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+
+    //处理这些调用时开始了新的操作, 由 on_idle_check 等待它们结束
+    if (kiran_biometrics_is_idle(kirBiometrics))
+        g_main_loop_quit(loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * 空闲一段时间后退出, 退出前保存状态, 之后由总线激活重新启动
+ * 有操作或者还有客户端连接时不算空闲, 空闲时间从最后一次方法调用, 操作结束或客户端断开开始计算
+ */
+static gboolean
+on_idle_check(gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+    gint64 now = g_get_monotonic_time();
+    KiranSettings *settings;
+    guint minutes;
+
+    if (exiting)
+    {
+        if (!kiran_biometrics_is_idle(kirBiometrics))
+            return G_SOURCE_CONTINUE;
+
+        g_main_loop_quit(loop);
+        return G_SOURCE_REMOVE;
+    }
+
+    if (idle_exit >= 0)
+    {
+        minutes = idle_exit;
+    }
+    else
+    {
+        settings = kiran_settings_get();
+        minutes = settings->idle_exit;
+        kiran_settings_unref(settings);
+    }
+
+    if (minutes == 0 ||
+        !kiran_biometrics_is_idle(kirBiometrics) ||
+        kiran_biometrics_has_clients(kirBiometrics))
+    {
+        last_busy = now;
+        return G_SOURCE_CONTINUE;
+    }
+
+    last_busy = MAX(last_busy, kiran_biometrics_get_last_active(kirBiometrics));
+    if (now - last_busy < (gint64)minutes * 60 * G_USEC_PER_SEC)
+        return G_SOURCE_CONTINUE;
+
+    /*
+     * 先释放名字, 之后的调用会重新激活守护进程
+     * 释放名字的应答之前总线已经把发给这里的调用都发过来了, 方法调用以默认优先级分发,
+     * 低优先级的 on_drained 在它们之后执行
+     */
+    dzlog_info("idle for %u minutes, exit", minutes);
+    exiting = TRUE;
+    g_bus_unown_name(owner_id);
+    owner_id = 0;
+    g_idle_add_full(G_PRIORITY_LOW, on_drained, kirBiometrics, NULL);
+
+    return G_SOURCE_CONTINUE;
+}
+
+//重新加载配置, 超时时间立即生效, 其它配置在下一次操作时生效
+static void
+reload_settings(KiranBiometrics *kirBiometrics)
+{
+    kiran_settings_load(KIRAN_BIO_SETTING_FILE);
+    kiran_biometrics_apply_settings(kirBiometrics);
+}
+
+static gboolean
+on_reload_settings(gpointer user_data)
+{
+    reload_settings(KIRAN_BIOMETRICS(user_data));
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+on_settings_changed(GFileMonitor *monitor,
+                    GFile *file,
+                    GFile *other_file,
+                    GFileMonitorEvent event_type,
+                    gpointer user_data)
+{
+    if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+        event_type == G_FILE_MONITOR_EVENT_CREATED ||
+        event_type == G_FILE_MONITOR_EVENT_DELETED)
+        reload_settings(KIRAN_BIOMETRICS(user_data));
+}
+
+static gboolean
+on_terminate(gpointer user_data)
+{
+    g_main_loop_quit(loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+//收到 SIGUSR1 时把统计写到日志中
+static gboolean
+on_dump_stats(gpointer user_data)
+{
+    kiran_stats_dump();
+
+    return G_SOURCE_CONTINUE;
+}
+
+//从正在运行的守护进程获取统计并输出
+static int
+print_daemon_stats()
+{
+    g_autoptr(GError) error = NULL;
+    GDBusConnection *connection;
+    GVariant *result;
+    GVariant *stats;
+    gchar *text;
+
+    connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+    if (connection == NULL)
+    {
+        fprintf(stderr, "Failed to connect to system bus: %s\n", error->message);
+        return 1;
+    }
+
+    result = g_dbus_connection_call_sync(connection,
+                                         SERVICE_NAME,
+                                         SERVICE_PATH,
+                                         SERVICE_INTERFACE,
+                                         "GetStatistics",
+                                         NULL,
+                                         G_VARIANT_TYPE("(a(sttttttt))"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1,
+                                         NULL,
+                                         &error);
+    g_object_unref(connection);
+    if (result == NULL)
+    {
+        fprintf(stderr, "Failed to get statistics: %s\n", error->message);
+        return 1;
+    }
+
+    stats = g_variant_get_child_value(result, 0);
+    text = kiran_stats_format(stats);
+    fputs(text, stdout);
+
+    g_free(text);
+    g_variant_unref(stats);
+    g_variant_unref(result);
+
+    return 0;
+}
+
+static void
+on_bus_acquired(GDBusConnection *connection,
+                const gchar *name,
+                gpointer user_data)
+{
+    KiranBiometrics *kirBiometrics = KIRAN_BIOMETRICS(user_data);
+    g_autoptr(GError) error = NULL;
+
+    //对象要在获取名字之前导出, 避免客户端看到名字后调用失败
+    if (!kiran_biometrics_register(kirBiometrics, connection, SERVICE_PATH, &error))
+    {
+        dzlog_error("Failed to export %s: %s", SERVICE_PATH, error->message);
+        exit_status = 1;
+        g_main_loop_quit(loop);
+    }
+}
+
+static void
+on_name_acquired(GDBusConnection *connection,
+                 const gchar *name,
+                 gpointer user_data)
+{
+    dzlog_debug("Acquired name %s", name);
+}
+
+static void
+on_name_lost(GDBusConnection *connection,
+             const gchar *name,
+             gpointer user_data)
+{
+    if (connection == NULL)
+        dzlog_error("Failed to open connection to bus");
+    else
+        dzlog_error("Failed to get name %s", name);
+
+    exit_status = 1;
+    g_main_loop_quit(loop);
+}
 
 int main(int argc, char **argv)
 {
-    GMainLoop *loop;
-    GError *error = NULL;
     KiranBiometrics *kirBiometrics;
-    DBusGConnection *kiran_biometrics_dbus_conn;
-    DBusGProxy *driver_proxy;
-    guint request_name_ret;
+    GOptionContext *context;
+    GFileMonitor *monitor;
+    GFile *file;
+    g_autoptr(GError) error = NULL;
+
+    context = g_option_context_new(NULL);
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        fprintf(stderr, "%s\n", error->message);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if (dump_stats)
+        return print_daemon_stats();
 
 #ifdef ENABLE_ZLOG_EX
     if (dzlog_init_ex(NULL, "kylinsec-system", "kiran-biometrics", "kiran_biometrics_manager") < 0)
@@ -55,38 +291,45 @@ int main(int argc, char **argv)
     g_type_init();
 #endif
 
-    kiran_biometrics_dbus_conn = dbus_g_bus_get(DBUS_BUS_SYSTEM, &error);
-    if (kiran_biometrics_dbus_conn == NULL)
-    {
-        dzlog_error("Failed to open connection to bus: %s", error->message);
-        return 1;
-    }
-
-    driver_proxy = dbus_g_proxy_new_for_name(kiran_biometrics_dbus_conn,
-                                             DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS);
-
     loop = g_main_loop_new(NULL, FALSE);
+    kiran_settings_load(KIRAN_BIO_SETTING_FILE);
+    kirBiometrics = kiran_biometrics_new();
 
-    if (!org_freedesktop_DBus_request_name(driver_proxy, SERVICE_NAME,
-                                           0, &request_name_ret, &error))
-    {
-        dzlog_error("Failed to get name: %s", error->message);
-    }
+    g_unix_signal_add(SIGUSR1, on_dump_stats, NULL);
+    g_unix_signal_add(SIGTERM, on_terminate, NULL);
+    g_unix_signal_add(SIGHUP, on_reload_settings, kirBiometrics);
 
-    if (request_name_ret != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER)
-    {
-        dzlog_error("Got result code %u from requesting name", request_name_ret);
-        return 1;
-    }
+    file = g_file_new_for_path(KIRAN_BIO_SETTING_FILE);
+    monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+    if (monitor)
+        g_signal_connect(monitor, "changed", G_CALLBACK(on_settings_changed), kirBiometrics);
+    g_object_unref(file);
 
-    kirBiometrics = kiran_biometrics_new();
-    dbus_g_connection_register_g_object(kiran_biometrics_dbus_conn,
-                                        SERVICE_PATH, G_OBJECT(kirBiometrics));
+    //是否退出由配置决定, 配置可能在运行中修改, 所以总是检查
+    last_busy = g_get_monotonic_time();
+    g_timeout_add_seconds(IDLE_CHECK_INTERVAL, on_idle_check, kirBiometrics);
+
+    owner_id = g_bus_own_name(G_BUS_TYPE_SYSTEM,
+                              SERVICE_NAME,
+                              G_BUS_NAME_OWNER_FLAGS_NONE,
+                              on_bus_acquired,
+                              on_name_acquired,
+                              on_name_lost,
+                              kirBiometrics,
+                              NULL);
 
     g_main_loop_run(loop);
 
+    //先释放名字, 退出过程中的调用会重新激活守护进程
+    if (owner_id)
+        g_bus_unown_name(owner_id);
+    if (exit_status == 0)
+        kiran_biometrics_save_cache(kirBiometrics);
+    if (monitor)
+        g_object_unref(monitor);
     g_object_unref(kirBiometrics);
+    g_main_loop_unref(loop);
     zlog_fini();
 
-    return 0;
+    return exit_status;
 }